@@ -6,9 +6,14 @@
  * by Matt Farrugia <matt.farrugia@unimelb.edu.au>
  */
 
+// for sysconf()
+#define _POSIX_C_SOURCE 200112L
+
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "hashtbl.h"
 
@@ -18,6 +23,18 @@
 #include "tables/xtndbln.h" // create for part 2
 #include "tables/xuckoo.h"	// create for part 3
 #include "tables/xuckoon.h"
+#include "tables/hopscotch.h"
+#include "tables/chained.h"
+#include "tables/cacheline.h"
+
+// how many keys hash_table_foreach() scans at a time
+#define SCAN_CHUNK 256
+
+// set operations probe one table for another's keys on up to this many
+// threads, with at least this many keys for each thread (so that small sets
+// aren't held up starting threads)
+#define MAX_SET_THREADS 16
+#define KEYS_PER_THREAD 65536
 
 // converts from a string representation to a TableType constant:
 // "linear"			->	LINEAR
@@ -25,6 +42,9 @@
 // "1" or "cuckoo"	->	CUCKOO
 // "2" or "xtndbln"	->	XTNDBLN
 // "3" or "xuckoo"	->	XUCKOO
+// "4" or "xuckoon"	->	XUCKOON
+// "hopscotch"		->	HOPSCOTCH
+// "chained"		->	CHAINED
 TableType strtotype(char *str) {
 	if (strcmp("linear",  str) == 0) {
 		return LINEAR;
@@ -44,6 +64,12 @@ TableType strtotype(char *str) {
 	if (strcmp("4", str) == 0 || strcmp("xuckoon",  str) == 0){
 		return XUCKOON;
 	}
+	if (strcmp("hopscotch", str) == 0) {
+		return HOPSCOTCH;
+	}
+	if (strcmp("chained", str) == 0) {
+		return CHAINED;
+	}
 	return NOTYPE;
 }
 // a HashTable is a wrapper for an actual table structure of some type,
@@ -51,19 +77,39 @@ TableType strtotype(char *str) {
 
 struct table {
 	TableType type;	// what type of hash table is this?
+	int size;		// the initial size it was made with
 	void *table;	// the hash table itself
 };
 
+// some of the keys of one table being probed for in another by one thread
+typedef struct probe_job {
+	HashTable *table;		// the table to probe
+	const int64 *keys;		// the keys to look for
+	int n;					// how many keys there are
+	unsigned char *found;	// bit i set if keys[i] is in 'table'
+	int nfound;				// how many of the keys were found
+} ProbeJob;
+
+// one range of a table being scanned for its keys by one thread
+typedef struct scan_job {
+	HashTable *table;		// the table to scan
+	ScanCursor cursor;		// the range of it to scan
+	int64 *keys;			// the keys found in the range
+	int n;					// how many keys there are
+	int size;				// how many keys there's room for
+} ScanJob;
+
 // initialise a hash table of type 'type' with initial size 'size',
 // and return its pointer
 HashTable *new_hash_table(TableType type, int size) {
 	
 	// allocate space for the table wrapper
-	HashTable *table = malloc(sizeof *table);
+	HashTable *table = cache_line_alloc(sizeof *table);
 	assert(table);
 
 	// store the table type, so we know which functions to call later
 	table->type = type;
+	table->size = size;
 
 	// create and store the table itself
 	switch (type) {
@@ -85,15 +131,58 @@ HashTable *new_hash_table(TableType type, int size) {
 		case XUCKOON:
 			table->table = new_xuckoon_hash_table(size);
 			break;
+		case HOPSCOTCH:
+			table->table = new_hopscotch_hash_table(size);
+			break;
+		case CHAINED:
+			table->table = new_chained_hash_table(size);
+			break;
 		default:
 			// no such table type? error. release memory and return NULL
-			free(table);
+			cache_line_free(table);
 			return NULL;
 	}
 
 	return table;
 }
 
+// build a hash table of type 'type' (with initial size 'size', as for
+// 'new_hash_table()') holding the 'n' keys in 'keys', and return its pointer
+HashTable *hash_table_build(TableType type, int size, const int64 *keys, int n,
+	bool unique) {
+
+	// allocate space for the table wrapper
+	HashTable *table = cache_line_alloc(sizeof *table);
+	assert(table);
+	table->type = type;
+	table->size = size;
+
+	// build the table itself, all at once if its type knows how
+	switch (type) {
+		case LINEAR:
+			table->table = build_linear_hash_table(size, keys, n, unique);
+			break;
+		case XTNDBL1:
+			table->table = build_xtndbl1_hash_table(keys, n, unique);
+			break;
+		case XTNDBLN:
+			table->table = build_xtndbln_hash_table(size, keys, n, unique);
+			break;
+		default:
+			// otherwise (cuckoo, xuckoo, xuckoon, hopscotch, chained) make a
+			// table with room for the keys, and insert them in one batch
+			cache_line_free(table);
+			table = new_hash_table(type, size);
+			if (table) {
+				hash_table_reserve(table, n);
+				hash_table_insert_batch(table, keys, n, NULL);
+			}
+			break;
+	}
+
+	return table;
+}
+
 // free all memory associated with 'table'
 void free_hash_table(HashTable *table) {
 	assert(table != NULL);
@@ -118,12 +207,74 @@ void free_hash_table(HashTable *table) {
 		case XUCKOON:
 			free_xuckoon_hash_table(table->table);
 			break;
+		case HOPSCOTCH:
+			free_hopscotch_hash_table(table->table);
+			break;
+		case CHAINED:
+			free_chained_hash_table(table->table);
+			break;
 		default:
 			break;
 	}
 
 	// free the wrapper struct itself
-	free(table);
+	cache_line_free(table);
+}
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void hash_table_reserve(HashTable *table, int nkeys) {
+	assert(table != NULL);
+	assert(nkeys >= 0);
+
+	// forward the call onto the relevant reserve function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_reserve(table->table, nkeys);
+			break;
+		case XTNDBL1:
+			xtndbl1_hash_table_reserve(table->table, nkeys);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_reserve(table->table, nkeys);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_reserve(table->table, nkeys);
+			break;
+		case XUCKOO:
+			xuckoo_hash_table_reserve(table->table, nkeys);
+			break;
+		case XUCKOON:
+			xuckoon_hash_table_reserve(table->table, nkeys);
+			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_reserve(table->table, nkeys);
+			break;
+		case CHAINED:
+			chained_hash_table_reserve(table->table, nkeys);
+			break;
+		default:
+			break;
+	}
+}
+
+// shrink 'table' to fit the keys it holds now
+void hash_table_shrink_to_fit(HashTable *table) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant shrink function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_shrink_to_fit(table->table);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_shrink_to_fit(table->table);
+			break;
+		default:
+			// extendible tables only ever split their buckets, and hopscotch
+			// and chained tables have no shrinking yet: leave them be
+			break;
+	}
 }
 
 // insert 'key' into 'table', if it's not in there already
@@ -145,6 +296,10 @@ bool hash_table_insert(HashTable *table, int64 key) {
 			return xuckoo_hash_table_insert(table->table, key);
 		case XUCKOON:
 			return xuckoon_hash_table_insert(table->table, key);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_insert(table->table, key);
+		case CHAINED:
+			return chained_hash_table_insert(table->table, key);
 		default:
 			return false;
 	}
@@ -169,11 +324,606 @@ bool hash_table_lookup(HashTable *table, int64 key) {
 			return xuckoo_hash_table_lookup(table->table, key);
 		case XUCKOON:
 			return xuckoon_hash_table_lookup(table->table, key);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_lookup(table->table, key);
+		case CHAINED:
+			return chained_hash_table_lookup(table->table, key);
+		default:
+			return false;
+	}
+}
+
+// insert 'key' into 'table' with value 'value', replacing the value it had
+// if it was already in there
+// returns true if 'key' was inserted, false if it was already in there
+bool hash_table_put(HashTable *table, int64 key, int64 value) {
+	return hash_table_upsert(table, key, value, merge_replace);
+}
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool hash_table_get(HashTable *table, int64 key, int64 *value) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant get function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_get(table->table, key, value);
+		case XTNDBL1:
+			return xtndbl1_hash_table_get(table->table, key, value);
+		case CUCKOO:
+			return cuckoo_hash_table_get(table->table, key, value);
+		case XTNDBLN:
+			return xtndbln_hash_table_get(table->table, key, value);
+		case XUCKOO:
+			return xuckoo_hash_table_get(table->table, key, value);
+		case XUCKOON:
+			return xuckoon_hash_table_get(table->table, key, value);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_get(table->table, key, value);
+		case CHAINED:
+			return chained_hash_table_get(table->table, key, value);
+		default:
+			return false;
+	}
+}
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool hash_table_upsert(HashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	assert(table != NULL);
+	assert(merge != NULL);
+
+	// forward the call onto the relevant upsert function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_upsert(table->table, key, value, merge);
+		case XTNDBL1:
+			return xtndbl1_hash_table_upsert(table->table, key, value, merge);
+		case CUCKOO:
+			return cuckoo_hash_table_upsert(table->table, key, value, merge);
+		case XTNDBLN:
+			return xtndbln_hash_table_upsert(table->table, key, value, merge);
+		case XUCKOO:
+			return xuckoo_hash_table_upsert(table->table, key, value, merge);
+		case XUCKOON:
+			return xuckoon_hash_table_upsert(table->table, key, value, merge);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_upsert(table->table, key, value, merge);
+		case CHAINED:
+			return chained_hash_table_upsert(table->table, key, value, merge);
 		default:
 			return false;
 	}
 }
 
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void hash_table_lookup_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant batch lookup function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case XTNDBL1:
+			xtndbl1_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case XUCKOO:
+			xuckoo_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case XUCKOON:
+			xuckoon_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		case CHAINED:
+			chained_hash_table_lookup_batch(table->table, keys, n, found);
+			break;
+		default:
+			break;
+	}
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', without
+// timing or changing it
+void hash_table_probe_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant probe function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case XTNDBL1:
+			xtndbl1_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case XUCKOO:
+			xuckoo_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case XUCKOON:
+			xuckoon_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		case CHAINED:
+			chained_hash_table_probe_batch(table->table, keys, n, found);
+			break;
+		default:
+			break;
+	}
+}
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int hash_table_insert_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *inserted) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant batch insert function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case XTNDBL1:
+			return xtndbl1_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case CUCKOO:
+			return cuckoo_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case XTNDBLN:
+			return xtndbln_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case XUCKOO:
+			return xuckoo_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case XUCKOON:
+			return xuckoon_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		case CHAINED:
+			return chained_hash_table_insert_batch(table->table, keys, n,
+				inserted);
+		default:
+			return 0;
+	}
+}
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values'), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int hash_table_scan(HashTable *table, ScanCursor *cursor, int64 *keys,
+	int64 *values, int max) {
+	assert(table != NULL);
+	assert(max >= 0);
+
+	// forward the call onto the relevant scan function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case XTNDBL1:
+			return xtndbl1_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case CUCKOO:
+			return cuckoo_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case XTNDBLN:
+			return xtndbln_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case XUCKOO:
+			return xuckoo_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case XUCKOON:
+			return xuckoon_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_scan(table->table, cursor, keys,
+				values, max);
+		case CHAINED:
+			return chained_hash_table_scan(table->table, cursor, keys, values,
+				max);
+		default:
+			return 0;
+	}
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void hash_table_scan_ranges(HashTable *table, ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+
+	// forward the call onto the relevant function
+	switch (table->type) {
+		case LINEAR:
+			linear_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case XTNDBL1:
+			xtndbl1_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case CUCKOO:
+			cuckoo_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case XTNDBLN:
+			xtndbln_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case XUCKOO:
+			xuckoo_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case XUCKOON:
+			xuckoon_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		case CHAINED:
+			chained_hash_table_scan_ranges(table->table, cursors, n);
+			break;
+		default:
+			break;
+	}
+}
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values'), carrying on from where 'cursor' is up to, without timing or
+// changing 'table'
+// returns how many keys were copied, which is 0 once the scan has finished
+int hash_table_probe_scan(HashTable *table, ScanCursor *cursor, int64 *keys,
+	int64 *values, int max) {
+	assert(table != NULL);
+	assert(max >= 0);
+
+	// forward the call onto the relevant probe function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case XTNDBL1:
+			return xtndbl1_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case CUCKOO:
+			return cuckoo_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case XTNDBLN:
+			return xtndbln_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case XUCKOO:
+			return xuckoo_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case XUCKOON:
+			return xuckoon_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		case CHAINED:
+			return chained_hash_table_probe_scan(table->table, cursor, keys,
+				values, max);
+		default:
+			return 0;
+	}
+}
+
+// call 'visit' on every key in 'table' along with its value
+void hash_table_foreach(HashTable *table,
+	void (*visit)(int64 key, int64 value, void *arg), void *arg) {
+	assert(table != NULL);
+	assert(visit != NULL);
+
+	// scan the keys a chunk at a time into buffers that stay in the cache
+	int64 keys[SCAN_CHUNK];
+	int64 values[SCAN_CHUNK];
+	ScanCursor cursor = {0};
+	int n;
+	while ((n = hash_table_scan(table, &cursor, keys, values, SCAN_CHUNK))) {
+		int i;
+		for (i = 0; i < n; i++) {
+			visit(keys[i], values[i], arg);
+		}
+	}
+}
+
+// how many keys are in 'table'
+int hash_table_nkeys(HashTable *table) {
+	assert(table != NULL);
+
+	// forward the call onto the relevant nkeys function
+	switch (table->type) {
+		case LINEAR:
+			return linear_hash_table_nkeys(table->table);
+		case XTNDBL1:
+			return xtndbl1_hash_table_nkeys(table->table);
+		case CUCKOO:
+			return cuckoo_hash_table_nkeys(table->table);
+		case XTNDBLN:
+			return xtndbln_hash_table_nkeys(table->table);
+		case XUCKOO:
+			return xuckoo_hash_table_nkeys(table->table);
+		case XUCKOON:
+			return xuckoon_hash_table_nkeys(table->table);
+		case HOPSCOTCH:
+			return hopscotch_hash_table_nkeys(table->table);
+		case CHAINED:
+			return chained_hash_table_nkeys(table->table);
+		default:
+			return 0;
+	}
+}
+
+// how many threads set operations should share 'n' keys out between: as many
+// as there are cores, unless there aren't enough keys to go around
+static int set_threads(int n) {
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > n / KEYS_PER_THREAD) {
+		nthreads = n / KEYS_PER_THREAD;
+	}
+	if (nthreads > MAX_SET_THREADS) {
+		nthreads = MAX_SET_THREADS;
+	}
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+	return nthreads;
+}
+
+// call 'run' on each of the 'njobs' jobs in 'jobs' (each 'size' bytes), on
+// separate threads. this thread takes the first job, and if another thread
+// can't be started, its job too
+static void run_jobs(void *(*run)(void *), void *jobs, size_t size,
+	int njobs) {
+	pthread_t threads[MAX_SET_THREADS];
+	bool started[MAX_SET_THREADS];
+	char *job = jobs;
+	int t;
+	for (t = 1; t < njobs; t++) {
+		started[t] = pthread_create(&threads[t], NULL, run,
+			job + t * size) == 0;
+	}
+	run(job);
+	for (t = 1; t < njobs; t++) {
+		if (started[t]) {
+			pthread_join(threads[t], NULL);
+		} else {
+			run(job + t * size);
+		}
+	}
+}
+
+// thread body: probe for one job's keys, and count how many were found
+static void *run_probe_job(void *arg) {
+	ProbeJob *job = arg;
+	hash_table_probe_batch(job->table, job->keys, job->n, job->found);
+	job->nfound = 0;
+	int i;
+	for (i = 0; i < job->n; i++) {
+		job->nfound += (job->found[i / 8] >> (i % 8)) & 1;
+	}
+	return NULL;
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not. the
+// keys are split into disjoint ranges, probed by separate threads
+// returns how many of the keys were found
+static int probe_keys(HashTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	int nthreads = set_threads(n);
+
+	// share the keys out in whole cache lines' worth of found bits, so that
+	// no two threads ever write to the same line
+	int per_line = CACHE_LINE * 8;
+	int per_thread = (n / nthreads + per_line - 1) / per_line * per_line;
+	ProbeJob jobs[MAX_SET_THREADS];
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		int start = t * per_thread < n ? t * per_thread : n;
+		int end = t < nthreads - 1 && start + per_thread < n
+			? start + per_thread : n;
+		jobs[t].table = table;
+		jobs[t].keys = keys + start;
+		jobs[t].n = end - start;
+		jobs[t].found = found + start / 8;
+	}
+	run_jobs(run_probe_job, jobs, sizeof *jobs, nthreads);
+
+	int nfound = 0;
+	for (t = 0; t < nthreads; t++) {
+		nfound += jobs[t].nfound;
+	}
+	return nfound;
+}
+
+// thread body: copy the keys in one job's range, growing its array as it
+// fills up. the cursor and array are kept locally until the scan finishes,
+// so the thread doesn't keep writing next to the other jobs
+static void *run_scan_job(void *arg) {
+	ScanJob *job = arg;
+	ScanCursor cursor = job->cursor;
+	int64 *keys = job->keys;
+	int n = 0, size = job->size;
+	int got;
+	do {
+		if (size - n < SCAN_CHUNK) {
+			size = size * 2 + SCAN_CHUNK;
+			keys = realloc(keys, (sizeof *keys) * size);
+			assert(keys);
+		}
+		got = hash_table_probe_scan(job->table, &cursor, keys + n, NULL,
+			size - n);
+		n += got;
+	} while (got);
+	job->cursor = cursor;
+	job->keys = keys;
+	job->n = n;
+	job->size = size;
+	return NULL;
+}
+
+// copy every key in 'table' into a new array, storing how many there are in
+// '*n'. the table is split into ranges, scanned by separate threads
+static int64 *table_keys(HashTable *table, int *n) {
+	int nkeys = hash_table_nkeys(table);
+	int nthreads = set_threads(nkeys);
+	ScanCursor cursors[MAX_SET_THREADS];
+	hash_table_scan_ranges(table, cursors, nthreads);
+
+	// each range starts with room for its share of the keys, and a little
+	// more, since ranges don't all hold quite the same number
+	ScanJob jobs[MAX_SET_THREADS];
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		jobs[t].table = table;
+		jobs[t].cursor = cursors[t];
+		jobs[t].size = nkeys / nthreads + nkeys / nthreads / 8 + SCAN_CHUNK;
+		jobs[t].keys = malloc((sizeof *jobs[t].keys) * jobs[t].size);
+		assert(jobs[t].keys);
+		jobs[t].n = 0;
+	}
+	run_jobs(run_scan_job, jobs, sizeof *jobs, nthreads);
+
+	// put the other ranges' keys after the first range's
+	assert(jobs[0].n <= nkeys);
+	int64 *keys = realloc(jobs[0].keys, (sizeof *keys) * (nkeys + 1));
+	assert(keys);
+	int total = jobs[0].n;
+	for (t = 1; t < nthreads; t++) {
+		assert(total + jobs[t].n <= nkeys);
+		memcpy(keys + total, jobs[t].keys, (sizeof *keys) * jobs[t].n);
+		total += jobs[t].n;
+		free(jobs[t].keys);
+	}
+	assert(total == nkeys);
+	*n = nkeys;
+	return keys;
+}
+
+// probe 'table' for the 'n' keys in 'keys', and move those which were found
+// (or, if 'keep_found' is false, those which weren't) to the front of 'keys'
+// returns how many keys were moved to the front
+static int filter_keys(HashTable *table, int64 *keys, int n, bool keep_found) {
+	unsigned char *found = malloc((n + 7) / 8 + 1);
+	assert(found);
+	probe_keys(table, keys, n, found);
+	int kept = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		if (((found[i / 8] >> (i % 8)) & 1) == keep_found) {
+			keys[kept++] = keys[i];
+		}
+	}
+	free(found);
+	return kept;
+}
+
+// make a new hash table of the keys in either 'a' or 'b'
+HashTable *hash_table_union(HashTable *a, HashTable *b) {
+	assert(a != NULL && b != NULL);
+
+	// take all of the bigger table's keys, and the smaller table's keys
+	// which aren't already among them
+	HashTable *small = hash_table_nkeys(a) < hash_table_nkeys(b) ? a : b;
+	HashTable *large = small == a ? b : a;
+	int nlarge, nsmall;
+	int64 *keys = table_keys(large, &nlarge);
+	int64 *extra = table_keys(small, &nsmall);
+	nsmall = filter_keys(large, extra, nsmall, false);
+	keys = realloc(keys, (sizeof *keys) * (nlarge + nsmall + 1));
+	assert(keys);
+	int i;
+	for (i = 0; i < nsmall; i++) {
+		keys[nlarge + i] = extra[i];
+	}
+	free(extra);
+
+	HashTable *result = hash_table_build(a->type, a->size, keys,
+		nlarge + nsmall, true);
+	free(keys);
+	return result;
+}
+
+// make a new hash table of the keys in both 'a' and 'b'
+HashTable *hash_table_intersect(HashTable *a, HashTable *b) {
+	assert(a != NULL && b != NULL);
+
+	// take the smaller table's keys which are also in the bigger table
+	HashTable *small = hash_table_nkeys(a) < hash_table_nkeys(b) ? a : b;
+	HashTable *large = small == a ? b : a;
+	int n;
+	int64 *keys = table_keys(small, &n);
+	n = filter_keys(large, keys, n, true);
+
+	HashTable *result = hash_table_build(a->type, a->size, keys, n, true);
+	free(keys);
+	return result;
+}
+
+// make a new hash table of the keys in 'a' but not in 'b'
+HashTable *hash_table_difference(HashTable *a, HashTable *b) {
+	assert(a != NULL && b != NULL);
+
+	// every key in the result comes from 'a', so 'a' has to be scanned even
+	// if it's the bigger table
+	int n;
+	int64 *keys = table_keys(a, &n);
+	n = filter_keys(b, keys, n, false);
+
+	HashTable *result = hash_table_build(a->type, a->size, keys, n, true);
+	free(keys);
+	return result;
+}
+
+// how many keys are in both 'a' and 'b'
+int hash_table_intersect_count(HashTable *a, HashTable *b) {
+	assert(a != NULL && b != NULL);
+
+	// probe the bigger table for the smaller table's keys
+	HashTable *small = hash_table_nkeys(a) < hash_table_nkeys(b) ? a : b;
+	HashTable *large = small == a ? b : a;
+	int n;
+	int64 *keys = table_keys(small, &n);
+	unsigned char *found = malloc((n + 7) / 8 + 1);
+	assert(found);
+	int nfound = probe_keys(large, keys, n, found);
+	free(found);
+	free(keys);
+	return nfound;
+}
+
+// how many keys are in either 'a' or 'b'
+int hash_table_union_count(HashTable *a, HashTable *b) {
+	return hash_table_nkeys(a) + hash_table_nkeys(b)
+		- hash_table_intersect_count(a, b);
+}
+
+// how many keys are in 'a' but not in 'b'
+int hash_table_difference_count(HashTable *a, HashTable *b) {
+	return hash_table_nkeys(a) - hash_table_intersect_count(a, b);
+}
+
 // print the contents of 'table' to stdout
 void hash_table_print(HashTable *table) {
 	assert(table != NULL);
@@ -198,6 +948,12 @@ void hash_table_print(HashTable *table) {
 		case XUCKOON:
 			xuckoon_hash_table_print(table->table);
 			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_print(table->table);
+			break;
+		case CHAINED:
+			chained_hash_table_print(table->table);
+			break;
 		default:
 			break;
 	}
@@ -227,6 +983,12 @@ void hash_table_stats(HashTable *table) {
 		case XUCKOON:
 			xuckoon_hash_table_stats(table->table);
 			break;
+		case HOPSCOTCH:
+			hopscotch_hash_table_stats(table->table);
+			break;
+		case CHAINED:
+			chained_hash_table_stats(table->table);
+			break;
 		default:
 			break;
 	}
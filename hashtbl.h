@@ -11,11 +11,14 @@
 
 #include <stdbool.h>
 #include "inthash.h"
+#include "tables/merge.h"
+#include "tables/cursor.h"
 
 // enumerated type containing constants for the various types of hash table
 // supported
 typedef enum type {
-	NOTYPE = -1, LINEAR, XTNDBL1, CUCKOO, XTNDBLN, XUCKOO, XUCKOON
+	NOTYPE = -1, LINEAR, XTNDBL1, CUCKOO, XTNDBLN, XUCKOO, XUCKOON, HOPSCOTCH,
+	CHAINED
 } TableType;
 
 // converts from a string representation to a TableType constant:
@@ -24,6 +27,9 @@ typedef enum type {
 // "1" or "cuckoo"	->	CUCKOO
 // "2" or "xtndbln"	->	XTNDBLN
 // "3" or "xuckoo"	->	XUCKOO
+// "4" or "xuckoon"	->	XUCKOON
+// "hopscotch"		->	HOPSCOTCH
+// "chained"		->	CHAINED
 TableType strtotype(char *str);
 
 typedef struct table HashTable;
@@ -32,9 +38,35 @@ typedef struct table HashTable;
 // and return its pointer
 HashTable *new_hash_table(TableType type, int size);
 
+// build a hash table of type 'type' (with initial size 'size', as for
+// 'new_hash_table()') holding the 'n' keys in 'keys' (each with value 0), and
+// return its pointer. linear, xtndbl1 and xtndbln tables are sized for the
+// keys up front and filled in one pass over them, partitioned by their hash
+// values, which is much faster than inserting them one by one. if 'unique' is
+// true, the keys must all be different, and the time spent checking for
+// repeats is saved (otherwise repeats are only stored once, but the table is
+// still sized for all 'n' keys)
+// the other types (cuckoo, xuckoo, xuckoon, hopscotch and chained) aren't
+// built in one pass: where a key goes in them depends on the keys placed
+// before it. they fall back to 'hash_table_reserve()' for 'n' keys followed
+// by 'hash_table_insert_batch()', which saves their resizes but still inserts
+// (and checks for repeats of) every key one at a time, whatever 'unique' is
+HashTable *hash_table_build(TableType type, int size, const int64 *keys, int n,
+	bool unique);
+
 // free all memory associated with 'table'
 void free_hash_table(HashTable *table);
 
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes: each type of table sizes its arrays, or splits its
+// buckets, once up front rather than growing step by step
+void hash_table_reserve(HashTable *table, int nkeys);
+
+// shrink 'table' to fit the keys it holds now, giving back the memory it no
+// longer needs (say, after reserving far more room than was used). only
+// linear and cuckoo tables shrink: other types of table are left as they are
+void hash_table_shrink_to_fit(HashTable *table);
+
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool hash_table_insert(HashTable *table, int64 key);
@@ -43,6 +75,109 @@ bool hash_table_insert(HashTable *table, int64 key);
 // returns true if found, false if not
 bool hash_table_lookup(HashTable *table, int64 key);
 
+// insert 'key' into 'table' with value 'value', replacing the value it had
+// if it was already in there
+// returns true if 'key' was inserted, false if it was already in there
+bool hash_table_put(HashTable *table, int64 key, int64 value);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool hash_table_get(HashTable *table, int64 key, int64 *value);
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value'). e.g. merge_add
+// keeps a running count for each key
+// returns true if 'key' was inserted, false if it was already in there
+bool hash_table_upsert(HashTable *table, int64 key, int64 value,
+	MergeFunction merge);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+// ('found' needs room for (n + 7) / 8 bytes). the memory each key needs is
+// prefetched a few keys ahead, so this is much faster than 'n' lookups on
+// tables too big for the cache
+void hash_table_lookup_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *found);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', as for
+// 'hash_table_lookup_batch()', but without timing (or otherwise changing)
+// 'table', so that any number of threads can probe it at once, as long as
+// none of them changes it meanwhile. each type of table has a probe_batch
+// function doing this, which its lookup_batch function calls and times
+void hash_table_probe_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there (it needs
+// room for (n + 7) / 8 bytes). prefetches like 'hash_table_lookup_batch()'
+// returns how many of the keys were inserted
+int hash_table_insert_batch(HashTable *table, const int64 *keys, int n,
+	unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// (start a new scan with a zeroed cursor). returns how many keys were copied,
+// which is 0 once the scan has finished (as long as 'max' > 0)
+// a scan can be stopped after any chunk and carried on later, with keys
+// inserted in between. every key in the table for the whole scan is returned
+// at least once, and if the table isn't changed during the scan, exactly once.
+// the exception is cuckoo, xuckoo, xuckoon and hopscotch tables: their inserts
+// (and cuckoo tables' lookups of hot keys) move keys around, and a key moved
+// into the part of the table the scan has already passed will be missed
+int hash_table_scan(HashTable *table, ScanCursor *cursor, int64 *keys,
+	int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges, starting each of the 'n' cursors
+// in 'cursors' on one of them. scanning every range to its end returns each
+// key in 'table' exactly once, as long as 'table' isn't changed until all of
+// the scans have finished. ranges have about the same number of positions,
+// but extendible tables' splits are moved to the edges of their buckets
+void hash_table_scan_ranges(HashTable *table, ScanCursor *cursors, int n);
+
+// copy up to 'max' keys from 'table' as for 'hash_table_scan()', but without
+// timing (or otherwise changing) 'table', as for 'hash_table_probe_batch()':
+// separate threads can each scan a range from 'hash_table_scan_ranges()' at
+// once. the cursor must have been started by 'hash_table_scan_ranges()' (even
+// for a single range), which gets 'table' ready to be scanned like this
+int hash_table_probe_scan(HashTable *table, ScanCursor *cursor, int64 *keys,
+	int64 *values, int max);
+
+// call 'visit' on every key in 'table' along with its value, passing 'arg'
+// through to it. keys are scanned a chunk at a time, as by 'hash_table_scan()'
+void hash_table_foreach(HashTable *table,
+	void (*visit)(int64 key, int64 value, void *arg), void *arg);
+
+// how many keys are in 'table'
+int hash_table_nkeys(HashTable *table);
+
+// make a new hash table holding every key in 'a' or 'b' (or both), and return
+// its pointer. the new table has the same type and initial size as 'a', and
+// every key in it has value 0 (as with 'hash_table_build()'). the smaller
+// table's keys are scanned and looked for in the bigger table, split across
+// threads, and the new table is built all at once. neither table may be
+// changed until this returns (but they may be the same table)
+HashTable *hash_table_union(HashTable *a, HashTable *b);
+
+// make a new hash table holding the keys in both 'a' and 'b', as for
+// 'hash_table_union()'
+HashTable *hash_table_intersect(HashTable *a, HashTable *b);
+
+// make a new hash table holding the keys in 'a' but not in 'b', as for
+// 'hash_table_union()', except that it's always 'a' that is scanned
+HashTable *hash_table_difference(HashTable *a, HashTable *b);
+
+// how many keys are in 'a' or 'b' (or both), without building a new table:
+// only the smaller table is scanned
+int hash_table_union_count(HashTable *a, HashTable *b);
+
+// how many keys are in both 'a' and 'b', as for 'hash_table_union_count()'
+int hash_table_intersect_count(HashTable *a, HashTable *b);
+
+// how many keys are in 'a' but not in 'b', as for 'hash_table_union_count()'
+int hash_table_difference_count(HashTable *a, HashTable *b);
+
 // print the contents of 'table' to stdout
 void hash_table_print(HashTable *table);
 
@@ -30,6 +30,19 @@ typedef uint64_t int64;
 // when using these functions, remember to modulo by the size of your hash table
 // to get a valid address
 
+// the constants are exposed so that code computing several hashes at once
+// (e.g. with SIMD instructions) can reproduce these functions exactly
+
+// constants for first hash function
+#define H1_A 885390553
+#define H1_B 639360243
+#define H1_P 2147483629
+
+// constants for second hash function
+#define H2_A 853977193
+#define H2_B 306837493
+#define H2_P 2147483563
+
 // first available hash function
 int h1(int64 k);
 
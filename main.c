@@ -20,6 +20,7 @@
 typedef struct options {
 	TableType type;
 	int initial_size;
+	int expected_keys;	// how many keys to make room for up front (0 for none)
 } Options;
 Options get_options(int argc, char** argv);
 
@@ -48,6 +49,11 @@ int main(int argc, char **argv) {
 	// create hashtable (of given type)
 	HashTable *table = new_hash_table(options.type, options.initial_size);
 
+	// make room for the keys we're expecting, if we've been told
+	if (options.expected_keys > 0) {
+		hash_table_reserve(table, options.expected_keys);
+	}
+
 	// start the interpreter loop
 	run_interpreter(table);
 
@@ -172,11 +178,12 @@ int get_command(char *operation, int64 *key) {
 Options get_options(int argc, char** argv) {
 	
 	// create the Options structure with defaults
-	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE };
+	Options options = { .type = NOTYPE, .initial_size = DEFAULT_SIZE,
+		.expected_keys = 0 };
 
 	// use C's built-in getopt function to scan inputs by flag
 	char option;
-	while ((option = getopt(argc, argv, "t:s:")) != EOF){
+	while ((option = getopt(argc, argv, "t:s:n:")) != EOF){
 		switch (option){
 			case 't': // set hash table type
 				options.type = strtotype(optarg);
@@ -184,6 +191,9 @@ Options get_options(int argc, char** argv) {
 			case 's': // set hash table size
 				options.initial_size = atoi(optarg);
 				break;
+			case 'n': // set number of keys expected
+				options.expected_keys = atoi(optarg);
+				break;
 			default:
 				break;
 		}
@@ -202,6 +212,8 @@ Options get_options(int argc, char** argv) {
 		fprintf(stderr,
 			" -t 2 or xtnbdln: n-key extendible hash table (part 2)\n");
 		fprintf(stderr, " -t 3 or xuckoo:  extendible cuckoo table (part 3)\n");
+		fprintf(stderr, " -t hopscotch: hopscotch hash table\n");
+		fprintf(stderr, " -t chained: chained hash table\n");
 		valid = false;
 	}
 
@@ -212,6 +224,13 @@ Options get_options(int argc, char** argv) {
 		valid = false;
 	}
 
+	// validate expected number of keys
+	if(options.expected_keys < 0) {
+		fprintf(stderr,
+			"please specify expected number of keys (>=0) using the -n flag\n");
+		valid = false;
+	}
+
 	// check overall validity before continuing
 	if(!valid){
 		exit(EXIT_FAILURE);
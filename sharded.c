@@ -0,0 +1,265 @@
+/* * * * * * * * *
+ * Thread-safe hash table made of several independent hash tables (shards)
+ * of any type, each guarded by its own lock. keys are spread across the
+ * shards by their hash value, so threads working on different keys rarely
+ * wait for each other, and growing one shard only holds up the keys in it
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+// for pthread spin locks and clock_gettime()
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sharded.h"
+#include "tables/cacheline.h"
+
+// a shard is one hash table, along with the lock guarding it and some
+// statistics (which are also only changed while holding the lock). the
+// shards' tables time themselves with clock(), which counts the CPU time of
+// every thread in the process, so the shards keep their own (wall clock)
+// times as well
+typedef struct shard {
+	HashTable *table;	// the keys in this shard (allocated on cache lines of
+						// its own, like all tables, see cacheline.h)
+	union {
+		pthread_spinlock_t spin;
+		pthread_mutex_t mutex;
+	} lock;				// the lock guarding this shard (see LockType)
+	int nkeys;			// how many keys are being stored in this shard
+	int nwaits;			// how many times a thread found this shard locked
+	int64 busy;			// nanoseconds spent on operations in this shard
+	int64 waiting;		// nanoseconds spent waiting for this shard's lock
+} Shard;
+
+// each shard gets a whole number of cache lines to itself, so that threads
+// locking neighbouring shards don't fight over the same line
+typedef union padded_shard {
+	Shard shard;
+	char padding[(sizeof (Shard) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE];
+} PaddedShard;
+
+struct sharded_table {
+	PaddedShard *shards;	// the shards, aligned to the start of a cache line
+	int nshards;			// how many shards there are
+	LockType lock;			// what kind of lock guards each shard
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// the time now, in nanoseconds since some fixed point in the past
+static int64 now(void) {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// which shard 'key' belongs to. this uses the high bits of a multiplicative
+// hash, which have nothing to do with the h1()/h2() values the shards' own
+// tables use, so the keys of each shard still spread evenly over its table
+static Shard *shard_for(ShardedHashTable *table, int64 key) {
+	int64 hash = (key * 0x9e3779b97f4a7c15ULL) >> 32;
+	return &table->shards[(hash * table->nshards) >> 32].shard;
+}
+
+// take the lock of 'shard', waiting for it if another thread has it
+// returns the time at which the lock was taken
+static int64 lock_shard(ShardedHashTable *table, Shard *shard) {
+	int64 start = now();
+	if (table->lock == SPIN_LOCK) {
+		if (pthread_spin_trylock(&shard->lock.spin) == 0) {
+			return start;
+		}
+		pthread_spin_lock(&shard->lock.spin);
+	} else {
+		if (pthread_mutex_trylock(&shard->lock.mutex) == 0) {
+			return start;
+		}
+		pthread_mutex_lock(&shard->lock.mutex);
+	}
+	int64 locked = now();
+	shard->nwaits++;
+	shard->waiting += locked - start;
+	return locked;
+}
+
+// release the lock of 'shard'
+static void unlock_shard(ShardedHashTable *table, Shard *shard) {
+	if (table->lock == SPIN_LOCK) {
+		pthread_spin_unlock(&shard->lock.spin);
+	} else {
+		pthread_mutex_unlock(&shard->lock.mutex);
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a sharded hash table of 'nshards' hash tables of type 'type',
+// each with initial size 'size' and guarded by a lock of type 'lock', and
+// return its pointer
+ShardedHashTable *new_sharded_hash_table(TableType type, int size,
+	int nshards, LockType lock) {
+	assert(nshards > 0);
+	ShardedHashTable *table = malloc(sizeof *table);
+	assert(table);
+
+	table->shards = cache_line_alloc(sizeof *table->shards * nshards);
+	table->nshards = nshards;
+	table->lock = lock;
+
+	int i, error;
+	for (i = 0; i < nshards; i++) {
+		Shard *shard = &table->shards[i].shard;
+		shard->table = new_hash_table(type, size);
+		if (lock == SPIN_LOCK) {
+			error = pthread_spin_init(&shard->lock.spin,
+				PTHREAD_PROCESS_PRIVATE);
+		} else {
+			error = pthread_mutex_init(&shard->lock.mutex, NULL);
+		}
+		assert(error == 0);
+		shard->nkeys = 0;
+		shard->nwaits = 0;
+		shard->busy = 0;
+		shard->waiting = 0;
+	}
+	return table;
+}
+
+
+// free all memory associated with 'table'
+void free_sharded_hash_table(ShardedHashTable *table) {
+	assert(table != NULL);
+	int i;
+	for (i = 0; i < table->nshards; i++) {
+		Shard *shard = &table->shards[i].shard;
+		free_hash_table(shard->table);
+		if (table->lock == SPIN_LOCK) {
+			pthread_spin_destroy(&shard->lock.spin);
+		} else {
+			pthread_mutex_destroy(&shard->lock.mutex);
+		}
+	}
+	cache_line_free(table->shards);
+	free(table);
+}
+
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool sharded_hash_table_insert(ShardedHashTable *table, int64 key) {
+	return sharded_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool sharded_hash_table_lookup(ShardedHashTable *table, int64 key) {
+	return sharded_hash_table_get(table, key, NULL);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool sharded_hash_table_upsert(ShardedHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	Shard *shard = shard_for(table, key);
+
+	int64 start = lock_shard(table, shard);
+	bool inserted = hash_table_upsert(shard->table, key, value, merge);
+	shard->nkeys += inserted;
+	shard->busy += now() - start;
+	unlock_shard(table, shard);
+
+	return inserted;
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool sharded_hash_table_get(ShardedHashTable *table, int64 key,
+	int64 *value) {
+	assert(table != NULL);
+	Shard *shard = shard_for(table, key);
+
+	// lookups need the lock too: some tables rearrange keys during lookups
+	// (e.g. moving hot keys), and a lookup mustn't see a half-finished insert
+	int64 start = lock_shard(table, shard);
+	bool found = hash_table_get(shard->table, key, value);
+	shard->busy += now() - start;
+	unlock_shard(table, shard);
+
+	return found;
+}
+
+
+// print the contents of each shard of 'table' to stdout
+void sharded_hash_table_print(ShardedHashTable *table) {
+	assert(table != NULL);
+	int i;
+	for (i = 0; i < table->nshards; i++) {
+		Shard *shard = &table->shards[i].shard;
+		printf("--- shard %d:\n", i);
+		lock_shard(table, shard);
+		hash_table_print(shard->table);
+		unlock_shard(table, shard);
+	}
+}
+
+
+// print some statistics about 'table' (and each of its shards) to stdout
+void sharded_hash_table_stats(ShardedHashTable *table) {
+	assert(table != NULL);
+
+	// gather up the shards' own statistics first
+	int nkeys = 0, nwaits = 0, maxkeys = 0;
+	int64 busy = 0, waiting = 0;
+	int i;
+	for (i = 0; i < table->nshards; i++) {
+		Shard *shard = &table->shards[i].shard;
+		lock_shard(table, shard);
+		nkeys += shard->nkeys;
+		nwaits += shard->nwaits;
+		busy += shard->busy;
+		waiting += shard->waiting;
+		if (shard->nkeys > maxkeys) {
+			maxkeys = shard->nkeys;
+		}
+		unlock_shard(table, shard);
+	}
+
+	printf("--- sharded table stats ---\n");
+	printf("      shards: %d (%s locks)\n", table->nshards,
+		table->lock == SPIN_LOCK ? "spin" : "mutex");
+	printf("current load: %d items\n", nkeys);
+	printf(" fullest shard: %d items (%.3f%% of the average)\n", maxkeys,
+		nkeys ? maxkeys * 100.0 * table->nshards / nkeys : 0.0);
+	printf("  lock waits: %d (%.6f sec)\n", nwaits, waiting / 1e9);
+	printf("   time busy: %.6f sec (summed over shards; the CPU times\n"
+		"              below count every thread's CPU time)\n", busy / 1e9);
+	printf("--- end sharded table stats ---\n");
+
+	// then print each shard's stats
+	for (i = 0; i < table->nshards; i++) {
+		Shard *shard = &table->shards[i].shard;
+		printf("--- shard %d:\n", i);
+		lock_shard(table, shard);
+		hash_table_stats(shard->table);
+		unlock_shard(table, shard);
+	}
+}
@@ -0,0 +1,64 @@
+/* * * * * * * * *
+ * Thread-safe hash table made of several independent hash tables (shards)
+ * of any type, each guarded by its own lock. keys are spread across the
+ * shards by their hash value, so threads working on different keys rarely
+ * wait for each other, and growing one shard only holds up the keys in it
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef SHARDED_H
+#define SHARDED_H
+
+#include <stdbool.h>
+#include "inthash.h"
+#include "hashtbl.h"
+
+// the kinds of lock which can guard each shard: spin locks are cheapest when
+// operations are short and threads have cores to themselves, mutexes put
+// waiting threads to sleep instead of burning CPU time
+typedef enum lock_type {
+	SPIN_LOCK, MUTEX_LOCK
+} LockType;
+
+typedef struct sharded_table ShardedHashTable;
+
+// initialise a sharded hash table of 'nshards' hash tables of type 'type',
+// each with initial size 'size' and guarded by a lock of type 'lock', and
+// return its pointer
+ShardedHashTable *new_sharded_hash_table(TableType type, int size,
+	int nshards, LockType lock);
+
+// free all memory associated with 'table' (which no other threads may be
+// using any more)
+void free_sharded_hash_table(ShardedHashTable *table);
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool sharded_hash_table_insert(ShardedHashTable *table, int64 key);
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool sharded_hash_table_lookup(ShardedHashTable *table, int64 key);
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value'), all while
+// holding the key's shard's lock (so e.g. merge_add counts atomically)
+// returns true if 'key' was inserted, false if it was already in there
+bool sharded_hash_table_upsert(ShardedHashTable *table, int64 key,
+	int64 value, MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool sharded_hash_table_get(ShardedHashTable *table, int64 key,
+	int64 *value);
+
+// print the contents of each shard of 'table' to stdout
+void sharded_hash_table_print(ShardedHashTable *table);
+
+// print some statistics about 'table' (and each of its shards) to stdout
+void sharded_hash_table_stats(ShardedHashTable *table);
+
+#endif
@@ -0,0 +1,163 @@
+/* * * * * * * * *
+ * Stress test for the lock-free hash table: several threads insert keys at
+ * once, from overlapping ranges (so they race to insert the same keys),
+ * starting from a tiny table so that the keys are moved through many
+ * cooperative resizes along the way. afterwards, every key must be in the
+ * table exactly once, and the table's count must match
+ *
+ * usage:
+ *   make stress
+ *   ./stress nthreads nkeys
+ *       nthreads: number of threads inserting keys at once
+ *       nkeys: number of keys each thread inserts
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "inthash.h"
+#include "tables/lockfree.h"
+
+// the table starts out this small, so that it has to resize many times
+#define INITIAL_SIZE 8
+
+// the work of one thread: insert keys 'first' to 'first' + 'nkeys' - 1 (well,
+// a key made from each of those numbers) into 'table', counting how many of
+// them this thread was the one to insert
+typedef struct job {
+	LockFreeHashTable *table;
+	int first;
+	int nkeys;
+	int ninserted;	// how many keys this thread inserted
+	int nlost;		// how many keys couldn't be found straight after inserting
+} Job;
+
+/*************************************************************************/
+
+void printusageexit(char *exe) {
+	fprintf(stderr, "usage: %s nthreads nkeys\n", exe);
+	fprintf(stderr, " nthreads: number of threads inserting keys at once\n");
+	fprintf(stderr, " nkeys: number of keys each thread inserts\n");
+	exit(1);
+}
+
+// the key made from number 'i': spread out, so that the keys aren't all in a
+// neat run of slots, and including the marker values 0 and -1 (see lockfree.c)
+int64 key_for(int i) {
+	if (i == 1) {
+		return (int64)-1;
+	}
+	return (int64)i * 0x9e3779b97f4a7c15ULL;
+}
+
+// insert a thread's keys, checking that each can be found straight away
+void *insert_keys(void *arg) {
+	Job *job = arg;
+	int i;
+	for (i = job->first; i < job->first + job->nkeys; i++) {
+		if (lockfree_hash_table_insert(job->table, key_for(i))) {
+			job->ninserted++;
+		}
+		if (!lockfree_hash_table_lookup(job->table, key_for(i))) {
+			job->nlost++;
+		}
+	}
+	return NULL;
+}
+
+// qsort comparison function for keys
+int compare_keys(const void *a, const void *b) {
+	int64 x = *(const int64 *)a;
+	int64 y = *(const int64 *)b;
+	return (x > y) - (x < y);
+}
+
+/*************************************************************************/
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		printusageexit(argv[0]);
+	}
+	int nthreads = atoi(argv[1]);
+	int nkeys = atoi(argv[2]);
+	if (nthreads < 1 || nkeys < 1) {
+		printusageexit(argv[0]);
+	}
+
+	// each thread's range of keys overlaps half of the next thread's range
+	LockFreeHashTable *table = new_lockfree_hash_table(INITIAL_SIZE);
+	Job *jobs = malloc(sizeof *jobs * nthreads);
+	pthread_t *threads = malloc(sizeof *threads * nthreads);
+	if (!jobs || !threads) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	int t;
+	for (t = 0; t < nthreads; t++) {
+		jobs[t].table = table;
+		jobs[t].first = t * (nkeys / 2);
+		jobs[t].nkeys = nkeys;
+		jobs[t].ninserted = 0;
+		jobs[t].nlost = 0;
+		if (pthread_create(&threads[t], NULL, insert_keys, &jobs[t]) != 0) {
+			fprintf(stderr, "couldn't start thread %d\n", t);
+			return 1;
+		}
+	}
+
+	int ninserted = 0, nlost = 0;
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(threads[t], NULL);
+		ninserted += jobs[t].ninserted;
+		nlost += jobs[t].nlost;
+	}
+
+	// between them, the threads inserted every number up to this one
+	int nexpected = (nthreads - 1) * (nkeys / 2) + nkeys;
+
+	// every key should be in the table exactly once
+	int64 *keys = malloc(sizeof *keys * nexpected);
+	int64 *expected = malloc(sizeof *expected * nexpected);
+	if (!keys || !expected) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	int nfound = lockfree_hash_table_keys(table, keys, nexpected);
+	int i;
+	for (i = 0; i < nexpected; i++) {
+		expected[i] = key_for(i);
+	}
+	int ncopied = nfound < nexpected ? nfound : nexpected;
+	qsort(keys, ncopied, sizeof *keys, compare_keys);
+	qsort(expected, nexpected, sizeof *expected, compare_keys);
+	int nwrong = 0;
+	for (i = 0; i < nfound || i < nexpected; i++) {
+		if (i >= ncopied || keys[i] != expected[i]) {
+			nwrong++;
+		}
+	}
+
+	int count = lockfree_hash_table_nkeys(table);
+	printf("threads: %d, keys: %d\n", nthreads, nexpected);
+	printf("inserted: %d, in table: %d, counted: %d\n", ninserted, nfound,
+		count);
+	printf("lost straight after inserting: %d, missing or repeated: %d\n",
+		nlost, nwrong);
+	lockfree_hash_table_stats(table);
+
+	bool ok = ninserted == nexpected && nfound == nexpected
+		&& count == nexpected && nlost == 0 && nwrong == 0;
+	printf("%s\n", ok ? "ok" : "FAILED");
+
+	free(keys);
+	free(expected);
+	free(jobs);
+	free(threads);
+	free_lockfree_hash_table(table);
+	return ok ? 0 : 1;
+}
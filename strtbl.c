@@ -0,0 +1,204 @@
+/* * * * * * * * *
+ * Interface for using the hash tables with variable-length byte string keys
+ * (e.g. identifiers) instead of 64-bit integers
+ *
+ * the bytes of each key are kept in an append-only key arena. the underlying
+ * hash table stores each key's full 64-bit hash value as its key, and the
+ * key's offset into the arena as its value. so probing compares cached hash
+ * values only (which for the linear and n-key extendible tables are kept
+ * densely packed for scanning), and the key bytes are only read once the
+ * hash values match. in the very rare case that two different keys have the
+ * same hash value, the table holds the newer one, which chains on to the
+ * older one through the arena
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "strtbl.h"
+#include "tables/keyarena.h"
+
+// helper structure to store statistics gathered
+typedef struct stats {
+	int nkeys;			// how many keys are being stored in the table
+	int ncollisions;	// how many keys share their hash value with an older
+						// (different) key
+	int nbyte_compares;	// how many times key bytes have been compared
+	int time;			// how much CPU time has been used to insert/lookup keys
+						// (including the time spent in the table itself)
+} Stats;
+
+struct str_table {
+	HashTable *table;	// maps each hash value to the arena offset of the
+						// newest key with that hash value
+	KeyArena *arena;	// the bytes (and values) of all of the keys
+	Stats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// the arena offset of the 'len' bytes at 'key' in 'table', looking only at
+// keys in the chain starting at 'offset'. returns NO_KEY if it's not there
+static int64 find_in_chain(StrHashTable *table, int64 offset, const char *key,
+	int len) {
+	while (offset != NO_KEY) {
+		table->stats.nbyte_compares++;
+		if (key_arena_equals(table->arena, offset, key, len)) {
+			return offset;
+		}
+		offset = key_arena_next(table->arena, offset);
+	}
+	return NO_KEY;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a hash table for byte string keys, built on a hash table of type
+// 'type' with initial size 'size', and return its pointer
+StrHashTable *new_str_hash_table(TableType type, int size) {
+	StrHashTable *table = malloc(sizeof *table);
+	assert(table);
+
+	table->table = new_hash_table(type, size);
+	table->arena = new_key_arena();
+
+	table->stats.nkeys = 0;
+	table->stats.ncollisions = 0;
+	table->stats.nbyte_compares = 0;
+	table->stats.time = 0;
+	return table;
+}
+
+
+// free all memory associated with 'table'
+void free_str_hash_table(StrHashTable *table) {
+	assert(table != NULL);
+	free_hash_table(table->table);
+	free_key_arena(table->arena);
+	free(table);
+}
+
+
+// insert the 'len' bytes at 'key' into 'table' as a key, if it's not in
+// there already
+// returns true if insertion succeeds, false if it was already in there
+bool str_hash_table_insert(StrHashTable *table, const char *key, int len) {
+	return str_hash_table_upsert(table, key, len, 0, merge_keep);
+}
+
+
+// lookup whether the 'len' bytes at 'key' are a key inside 'table'
+// returns true if found, false if not
+bool str_hash_table_lookup(StrHashTable *table, const char *key, int len) {
+	return str_hash_table_get(table, key, len, NULL);
+}
+
+
+// insert the 'len' bytes at 'key' into 'table' with value 'value' if they're
+// not in there already, otherwise replace their value with
+// merge(their value, 'value')
+// returns true if the key was inserted, false if it was already in there
+bool str_hash_table_upsert(StrHashTable *table, const char *key, int len,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int64 hash = key_hash(key, len);
+	int64 first = NO_KEY;
+	if (hash_table_get(table->table, hash, &first)) {
+		int64 offset = find_in_chain(table, first, key, len);
+		if (offset != NO_KEY) {
+			// this key already exists in the table! just update its value
+			int64 *stored = key_arena_value(table->arena, offset);
+			*stored = merge(*stored, value);
+			table->stats.time += clock() - start_time;
+			return false;
+		}
+		table->stats.ncollisions++;
+	}
+
+	// copy the key into the arena, in front of any others with its hash value
+	int64 offset = key_arena_add(table->arena, key, len, value, first);
+	hash_table_put(table->table, hash, offset);
+	table->stats.nkeys++;
+
+	table->stats.time += clock() - start_time;
+	return true;
+}
+
+
+// lookup whether the 'len' bytes at 'key' are a key inside 'table', and if
+// so, store its value in '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool str_hash_table_get(StrHashTable *table, const char *key, int len,
+	int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int64 offset = NO_KEY;
+	if (hash_table_get(table->table, key_hash(key, len), &offset)) {
+		offset = find_in_chain(table, offset, key, len);
+	}
+	if (offset != NO_KEY && value) {
+		*value = *key_arena_value(table->arena, offset);
+	}
+
+	table->stats.time += clock() - start_time;
+	return offset != NO_KEY;
+}
+
+
+// print the keys (and values) in 'table' to stdout, in the order they were
+// inserted
+void str_hash_table_print(StrHashTable *table) {
+	assert(table != NULL);
+
+	printf("--- %d keys:\n", table->stats.nkeys);
+
+	// print header
+	printf("    offset | key => value\n");
+
+	int64 offset;
+	int64 end = key_arena_size(table->arena);
+	for (offset = 0; offset < end;
+		offset = key_arena_after(table->arena, offset)) {
+		int len;
+		const char *key = key_arena_key(table->arena, offset, &len);
+		printf(" %9llu | %.*s => %llu\n", offset, len, key,
+			*key_arena_value(table->arena, offset));
+	}
+
+	printf("--- end keys ---\n");
+}
+
+
+// print some statistics about 'table' to stdout
+void str_hash_table_stats(StrHashTable *table) {
+	assert(table != NULL);
+	printf("--- string key stats ---\n");
+
+	printf("current load: %d keys\n", table->stats.nkeys);
+	printf("  key arena size: %llu bytes\n", key_arena_size(table->arena));
+	printf("  hash collisions: %d\n", table->stats.ncollisions);
+	printf("  key byte compares: %d\n", table->stats.nbyte_compares);
+
+	// also calculate CPU usage in seconds and print this
+	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	printf("    CPU time spent: %.6f sec\n", seconds);
+
+	printf("--- end string key stats ---\n");
+
+	// and then the stats of the table holding the hash values
+	hash_table_stats(table->table);
+}
@@ -0,0 +1,53 @@
+/* * * * * * * * *
+ * Interface for using the hash tables with variable-length byte string keys
+ * (e.g. identifiers) instead of 64-bit integers
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef STRTBL_H
+#define STRTBL_H
+
+#include <stdbool.h>
+#include "inthash.h"
+#include "hashtbl.h"
+
+typedef struct str_table StrHashTable;
+
+// initialise a hash table for byte string keys, built on a hash table of type
+// 'type' with initial size 'size', and return its pointer
+StrHashTable *new_str_hash_table(TableType type, int size);
+
+// free all memory associated with 'table'
+void free_str_hash_table(StrHashTable *table);
+
+// insert the 'len' bytes at 'key' (which need not be null-terminated) into
+// 'table' as a key, if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool str_hash_table_insert(StrHashTable *table, const char *key, int len);
+
+// lookup whether the 'len' bytes at 'key' are a key inside 'table'
+// returns true if found, false if not
+bool str_hash_table_lookup(StrHashTable *table, const char *key, int len);
+
+// insert the 'len' bytes at 'key' into 'table' with value 'value' if they're
+// not in there already, otherwise replace their value with
+// merge(their value, 'value')
+// returns true if the key was inserted, false if it was already in there
+bool str_hash_table_upsert(StrHashTable *table, const char *key, int len,
+	int64 value, MergeFunction merge);
+
+// lookup whether the 'len' bytes at 'key' are a key inside 'table', and if
+// so, store its value in '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool str_hash_table_get(StrHashTable *table, const char *key, int len,
+	int64 *value);
+
+// print the keys (and values) in 'table' to stdout
+void str_hash_table_print(StrHashTable *table);
+
+// print some statistics about 'table' to stdout
+void str_hash_table_stats(StrHashTable *table);
+
+#endif
@@ -0,0 +1,128 @@
+/* * * * * * * * *
+ * Key scans for the buckets of bucketised hash tables: buckets keep an 8-bit
+ * tag per key, so that most keys can be ruled out without reading them. where
+ * SSE2 is available, a whole block of tags is compared at once. also the
+ * macros that the bucketised tables' templates are built with
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef BUCKETSCAN_H
+#define BUCKETSCAN_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// tags are compared this many at a time, so bucket tag arrays are allocated in
+// blocks of this many tags
+#define TAG_BLOCK 16
+
+// a key's tag is the leftmost 8 bits of the key times a large odd constant
+// (2^64 divided by the golden ratio). it doesn't come from the key's hash
+// values at all, because buckets can be addressed by up to all 31 of their
+// bits: keys sharing a deep bucket would share most of a tag taken from them
+#define KEY_TAG(key) ((unsigned char)(((key) * 0x9e3779b97f4a7c15ULL) >> 56))
+
+// how many tags to allocate for a bucket with room for 'capacity' keys
+static inline int tag_space(int capacity) {
+	return (capacity + TAG_BLOCK - 1) / TAG_BLOCK * TAG_BLOCK;
+}
+
+// where is 'key' (with tag 'tag') among the first 'nkeys' keys in 'keys',
+// whose tags are in 'tags'? returns its index, or -1 if it's not there. keys
+// are only read if their tag matches, so with SSE2 a key which isn't there
+// usually costs one comparison of a block of tags per TAG_BLOCK keys
+static inline int bucket_index(const unsigned char *tags, const int64 *keys,
+	int nkeys, unsigned char tag, int64 key) {
+#ifdef __SSE2__
+	int base;
+	__m128i want = _mm_set1_epi8((char)tag);
+	for (base = 0; base < nkeys; base += TAG_BLOCK) {
+		__m128i have = _mm_loadu_si128((const __m128i *)(tags + base));
+		unsigned int matches = _mm_movemask_epi8(_mm_cmpeq_epi8(have, want));
+		if (nkeys - base < TAG_BLOCK) {
+			matches &= (1u << (nkeys - base)) - 1;
+		}
+		while (matches) {
+			int i = __builtin_ctz(matches);
+			if (keys[base + i] == key) {
+				return base + i;
+			}
+			matches &= matches - 1;
+		}
+	}
+	return -1;
+#else
+	int i;
+	for (i = 0; i < nkeys; i++) {
+		if (tags[i] == tag && keys[i] == key) {
+			return i;
+		}
+	}
+	return -1;
+#endif
+}
+
+// is 'key' (with tag 'tag') among the first 'nkeys' keys in 'keys', whose tags
+// are in 'tags'? (see 'bucket_index()')
+static inline bool bucket_find(const unsigned char *tags, const int64 *keys,
+	int nkeys, unsigned char tag, int64 key) {
+	return bucket_index(tags, keys, nkeys, tag, key) >= 0;
+}
+
+// the bucketised tables (xtndbln.c and xuckoon.c) are generated from templates
+// (buckettmpl.h and the tables' own), included once for each bucket size they
+// have an instance for, with BUCKET_SLOTS defined as that size, and once with
+// BUCKET_SLOTS defined as 0 for the generic instance, which reads its bucket
+// size at run time. the macros below are for use inside those templates
+
+// 'name', with the bucket size of the instance being generated tacked onto
+// it (e.g. find_slot_4), so that the instances can live side by side
+#define SIZED(name) SIZED_(name, BUCKET_SLOTS)
+#define SIZED_(name, size) SIZED__(name, size)
+#define SIZED__(name, size) name##_##size
+
+// how many keys the buckets of 'table' have room for: a constant, except in
+// the generic instance
+#define SLOTS(table) (BUCKET_SLOTS ? BUCKET_SLOTS : (table)->bucketsize)
+
+// do the buckets of this instance keep tags? buckets of fewer than TAG_BLOCK
+// keys compare every one of their keys directly instead, which costs no more
+// than comparing tags would. without SSE2 to compare a block of tags at once,
+// only the generic instance (whose buckets could be any size) keeps them
+#ifdef __SSE2__
+#define BUCKET_TAGS (BUCKET_SLOTS == 0 || BUCKET_SLOTS >= TAG_BLOCK)
+#else
+#define BUCKET_TAGS (BUCKET_SLOTS == 0)
+#endif
+
+// unroll the loop that follows completely (its trip count must be fixed at
+// compile time). with optimisation turned off, nothing is unrolled
+#if defined(__clang__)
+#define UNROLL _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define UNROLL _Pragma("GCC unroll 32")
+#else
+#define UNROLL
+#endif
+
+// the position of the lowest set bit of 'bits' (which mustn't be 0)
+static inline int lowest_bit(unsigned long long bits) {
+#ifdef __GNUC__
+	return __builtin_ctzll(bits);
+#else
+	int i = 0;
+	while ((bits & 1) == 0) {
+		bits >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+#endif
@@ -0,0 +1,149 @@
+/* * * * * * * * *
+ * Template for the bucket operations shared by the bucketised tables
+ * (xtndbln.c and xuckoon.c): storing and finding keys, their values and their
+ * tags (see bucketscan.h) in buckets of BUCKET_SLOTS keys, or of any size if
+ * BUCKET_SLOTS is 0
+ *
+ * before including this, the table's template defines BUCKET_SLOTS and the
+ * type Bucket, with 'nkeys' keys in its 'keys' and their values in 'values'
+ * (and their tags in 'tags', if BUCKET_TAGS). these are fixed-size arrays
+ * inside the bucket if BUCKET_ARRAYS is true, and otherwise pointers into the
+ * same block of memory as the bucket (see alloc_bucket())
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+// (no include guard: this is included once for every instance)
+
+#define block_index		SIZED(block_index)
+#define find_slot		SIZED(find_slot)
+#define bucket_put		SIZED(bucket_put)
+#define bucket_remove	SIZED(bucket_remove)
+#define bucket_move		SIZED(bucket_move)
+#define print_keys		SIZED(print_keys)
+#define alloc_bucket	SIZED(alloc_bucket)
+
+#if BUCKET_SLOTS
+// where is 'key' among the keys of 'bucket' from slot 'base' on, looking at
+// BUCKET_SLOTS of them? returns its slot, or -1 if it's not there. all of the
+// slots are compared whether they're in use or not (the ones which aren't
+// hold a zero or an old key, and are masked off afterwards), so every loop
+// runs a fixed number of times and is unrolled, with no branches until the end
+static inline int block_index(Bucket *bucket, int base, int64 key) {
+	int nkeys = bucket->nkeys - base;
+	unsigned long long matches = 0;
+	int i;
+#if BUCKET_TAGS
+	// compare tags a block at a time, and then the keys whose tags match
+	const unsigned char *tags = bucket->tags + base;
+	__m128i want = _mm_set1_epi8((char)KEY_TAG(key));
+	UNROLL
+	for (i = 0; i < BUCKET_SLOTS; i += TAG_BLOCK) {
+		__m128i have = _mm_loadu_si128((const __m128i *)(tags + i));
+		matches |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(have, want)) << i;
+	}
+	if (nkeys < BUCKET_SLOTS) {
+		matches &= (1ULL << nkeys) - 1;
+	}
+	for (; matches; matches &= matches - 1) {
+		i = lowest_bit(matches);
+		if (bucket->keys[base + i] == key) {
+			return base + i;
+		}
+	}
+	return -1;
+#else
+	// compare the keys themselves
+	const int64 *keys = bucket->keys + base;
+	UNROLL
+	for (i = 0; i < BUCKET_SLOTS; i++) {
+		matches |= (unsigned long long)(keys[i] == key) << i;
+	}
+	if (nkeys < BUCKET_SLOTS) {
+		matches &= (1ULL << nkeys) - 1;
+	}
+	return matches ? base + lowest_bit(matches) : -1;
+#endif
+}
+#endif
+
+// which slot of 'bucket' holds 'key'? (or -1 if none). buckets which have room
+// for more than BUCKET_SLOTS keys are looked through BUCKET_SLOTS at a time
+static inline int find_slot(Bucket *bucket, int64 key) {
+#if BUCKET_SLOTS
+	int base;
+	for (base = 0; base < bucket->nkeys; base += BUCKET_SLOTS) {
+		int i = block_index(bucket, base, key);
+		if (i >= 0) {
+			return i;
+		}
+	}
+	return -1;
+#else
+	return bucket_index(bucket->tags, bucket->keys, bucket->nkeys,
+		KEY_TAG(key), key);
+#endif
+}
+
+// put 'key' and its value in slot 'i' of 'bucket', adding a slot to the end
+// of the bucket if 'i' is just past it
+static inline void bucket_put(Bucket *bucket, int i, int64 key, int64 value) {
+	bucket->keys[i] = key;
+	bucket->values[i] = value;
+#if BUCKET_TAGS
+	bucket->tags[i] = KEY_TAG(key);
+#endif
+	if (i == bucket->nkeys) {
+		bucket->nkeys++;
+	}
+}
+
+// remove the key in slot 'i' of 'bucket', filling the gap with its last key
+static inline void bucket_remove(Bucket *bucket, int i) {
+	int last = --bucket->nkeys;
+	bucket->keys[i] = bucket->keys[last];
+	bucket->values[i] = bucket->values[last];
+#if BUCKET_TAGS
+	bucket->tags[i] = bucket->tags[last];
+#endif
+}
+
+// move the key in slot 'i' of 'bucket' (with its value and tag) to the end of
+// 'dest', filling the gap in 'bucket' with its last key
+static inline void bucket_move(Bucket *bucket, int i, Bucket *dest) {
+	bucket_put(dest, dest->nkeys, bucket->keys[i], bucket->values[i]);
+	bucket_remove(bucket, i);
+}
+
+// print the keys in 'bucket', with a - for each of the rest of its
+// 'capacity' slots
+static inline void print_keys(Bucket *bucket, int capacity) {
+	printf("[");
+	for(int j = 0; j < capacity; j++) {
+		if (j < bucket->nkeys) {
+			printf(" %llu", bucket->keys[j]);
+		} else {
+			printf(" -");
+		}
+	}
+	printf(" ]");
+}
+
+#if !BUCKET_ARRAYS
+// make a new, zeroed bucket with room for 'capacity' keys, whose keys, values
+// (and tags) follow it in the same block of memory, so that it takes a single
+// allocation and its keys can be read straight after it. free it with free()
+static inline Bucket *alloc_bucket(int capacity) {
+	size_t ntags = BUCKET_TAGS ? tag_space(capacity) : 0;
+	char *memory = calloc(1, sizeof(Bucket) + sizeof(int64) * 2 * capacity
+		+ ntags);
+	assert(memory);
+	Bucket *bucket = (Bucket *)memory;
+	bucket->keys = (int64 *)(memory + sizeof(Bucket));
+	bucket->values = bucket->keys + capacity;
+	bucket->tags = ntags ? (unsigned char *)(bucket->values + capacity) : NULL;
+	return bucket;
+}
+#endif
@@ -0,0 +1,44 @@
+/* * * * * * * * *
+ * Allocations which get whole cache lines to themselves: the structs of
+ * tables which different threads may be using at once (such as the shards of
+ * a sharded table) are allocated like this, so that one thread updating its
+ * table's statistics never evicts the line another thread is reading its own
+ * table from
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef CACHELINE_H
+#define CACHELINE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+// size of a cache line
+#define CACHE_LINE 64
+
+// allocate 'size' bytes starting at the start of a cache line, rounded up to
+// a whole number of cache lines. the memory must be freed with
+// cache_line_free(), not free()
+static inline void *cache_line_alloc(size_t size) {
+	size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+
+	// malloc's own alignment leaves room before the first line boundary
+	// past the start of the block for a pointer back to the block
+	char *block = malloc(size + CACHE_LINE);
+	assert(block);
+	char *start = block + CACHE_LINE - (uintptr_t)block % CACHE_LINE;
+	((void **)start)[-1] = block;
+	return start;
+}
+
+// free memory allocated by cache_line_alloc() (if it's not NULL)
+static inline void cache_line_free(void *start) {
+	if (start) {
+		free(((void **)start)[-1]);
+	}
+}
+
+#endif
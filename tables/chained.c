@@ -0,0 +1,567 @@
+/* * * * * * * * *
+ * Dynamic hash table using separate chaining to resolve collisions: keys
+ * sharing a slot are kept in a linked list (chain) hanging off that slot
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "chained.h"
+#include "prefetch.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 2
+
+// the table doubles in size once it holds more than this many keys per slot
+#define MAX_LOAD_FACTOR 2
+
+// marks the end of a chain of nodes
+#define NO_NODE -1
+
+// helper structure to store statistics gathered
+typedef struct stats {
+	int nkeys;		// how many keys are being stored in the table
+	int nnodes;		// how many keys are stored in nodes (not in slots)
+	int time;		// how much CPU time has been used to insert/lookup keys
+					// in this table
+} Stats;
+
+// a slot stores the first key of its chain directly (full=true) or is empty
+// (full=false), so short chains don't need to follow any links at all
+typedef struct slot {
+	int64 key;		// the first key in this slot's chain
+	int64 value;	// the value stored with that key
+	int next;		// index of the node with the next key, or NO_NODE if none
+	bool full;		// does this slot contain a key
+} Slot;
+
+// a node holds one more key of a chain, and links to the next node
+typedef struct node {
+	int64 key;		// the key stored in this node
+	int64 value;	// the value stored with that key
+	int next;		// index of the next node, or NO_NODE if none
+} Node;
+
+// a chained hash table is an array of slots, along with a pool of nodes for
+// the rest of each chain. nodes are linked by their index in the pool, so the
+// pool can grow (and the slot array can be replaced) without breaking chains
+struct chained_table {
+	Slot *slots;	// array of slots
+	int size;		// how many slots there are
+	Node *nodes;	// pool of nodes
+	int nnodes;		// how many nodes the pool has room for
+	int freenode;	// first unused node in the pool, or NO_NODE if none
+	Stats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// set up 'size' empty slots for 'table'
+static void initialise_slots(ChainedHashTable *table, int size) {
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+	table->slots = malloc((sizeof *table->slots) * size);
+	assert(table->slots);
+	int i;
+	for (i = 0; i < size; i++) {
+		table->slots[i].next = NO_NODE;
+		table->slots[i].full = false;
+	}
+	table->size = size;
+}
+
+// give the pool room for 'nnodes' nodes, threading the new ones onto the
+// front of the free list
+static void grow_pool(ChainedHashTable *table, int nnodes) {
+	int old_size = table->nnodes;
+	table->nnodes = nnodes;
+	table->nodes = realloc(table->nodes, sizeof *table->nodes
+		* table->nnodes);
+	assert(table->nodes);
+
+	int i;
+	for (i = old_size; i < table->nnodes; i++) {
+		table->nodes[i].next = i + 1 < table->nnodes ? i + 1 : table->freenode;
+	}
+	table->freenode = old_size;
+}
+
+// take a node from the pool, growing the pool if it's empty
+static int new_node(ChainedHashTable *table) {
+	if (table->freenode == NO_NODE) {
+		grow_pool(table, table->nnodes ? table->nnodes * 2 : 4);
+	}
+	int node = table->freenode;
+	table->freenode = table->nodes[node].next;
+	table->stats.nnodes++;
+	return node;
+}
+
+// return a node to the pool
+static void free_node(ChainedHashTable *table, int node) {
+	table->nodes[node].next = table->freenode;
+	table->freenode = node;
+	table->stats.nnodes--;
+}
+
+// where is the value of 'key' stored in the chain of 'slot'? returns NULL if
+// 'key' isn't in the chain
+static int64 *chain_value(ChainedHashTable *table, Slot *slot, int64 key) {
+	if (!slot->full) {
+		return NULL;
+	}
+	if (slot->key == key) {
+		return &slot->value;
+	}
+	int node;
+	for (node = slot->next; node != NO_NODE; node = table->nodes[node].next) {
+		if (table->nodes[node].key == key) {
+			return &table->nodes[node].value;
+		}
+	}
+	return NULL;
+}
+
+// add 'key' and its value to the chain of 'slot': into the slot itself if it's
+// empty, or into a new node at the front of the chain
+static void chain_add_key(ChainedHashTable *table, Slot *slot, int64 key,
+	int64 value) {
+	if (!slot->full) {
+		slot->key = key;
+		slot->value = value;
+		slot->full = true;
+		return;
+	}
+	int node = new_node(table);
+	table->nodes[node].key = key;
+	table->nodes[node].value = value;
+	table->nodes[node].next = slot->next;
+	slot->next = node;
+}
+
+// add the key in 'node' to the chain of 'slot', linking the node itself into
+// the chain (or giving it back to the pool if the key can go in the slot)
+static void chain_add_node(ChainedHashTable *table, Slot *slot, int node) {
+	if (!slot->full) {
+		slot->key = table->nodes[node].key;
+		slot->value = table->nodes[node].value;
+		slot->full = true;
+		free_node(table, node);
+		return;
+	}
+	table->nodes[node].next = slot->next;
+	slot->next = node;
+}
+
+// how many keys are in the chain of 'slot'
+static int chain_length(ChainedHashTable *table, Slot *slot) {
+	int length = slot->full;
+	int node;
+	for (node = slot->next; node != NO_NODE; node = table->nodes[node].next) {
+		length++;
+	}
+	return length;
+}
+
+// change the number of slots to 'size', moving every chain's keys over to
+// their new slots. keys already in nodes keep their nodes, which are just
+// relinked
+static void resize_table(ChainedHashTable *table, int size) {
+	Slot *oldslots = table->slots;
+	int oldsize = table->size;
+	initialise_slots(table, size);
+
+	int i;
+	for (i = 0; i < oldsize; i++) {
+		if (!oldslots[i].full) {
+			continue;
+		}
+		int64 key = oldslots[i].key;
+		chain_add_key(table, &table->slots[h1(key) % table->size], key,
+			oldslots[i].value);
+
+		int node = oldslots[i].next;
+		while (node != NO_NODE) {
+			int next = table->nodes[node].next;
+			key = table->nodes[node].key;
+			chain_add_node(table, &table->slots[h1(key) % table->size], node);
+			node = next;
+		}
+	}
+
+	free(oldslots);
+}
+
+
+// start loading the memory that looking up 'key' will need at stage 'stage':
+// 2 for its slot, and 1 for the first node of the slot's chain, if any (which
+// reads the slot stage 2 loaded)
+static void prefetch_key(ChainedHashTable *table, int64 key, int stage) {
+	Slot *slot = &table->slots[h1(key) % table->size];
+	if (stage == 2) {
+		prefetch(slot);
+	} else if (slot->full && slot->next != NO_NODE) {
+		prefetch(&table->nodes[slot->next]);
+	}
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in chained_hash_table_upsert(), but untimed)
+static bool upsert_key(ChainedHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	Slot *slot = &table->slots[h1(key) % table->size];
+	int64 *stored = chain_value(table, slot, key);
+	if (stored) {
+		// this key already exists in the table! just update its value
+		*stored = merge(*stored, value);
+		return false;
+	}
+
+	// keep chains short by growing the table once it gets too full
+	if (table->stats.nkeys >= table->size * MAX_LOAD_FACTOR) {
+		resize_table(table, table->size * 2);
+		slot = &table->slots[h1(key) % table->size];
+	}
+
+	chain_add_key(table, slot, key, value);
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in chained_hash_table_get(), but untimed)
+static bool get_key(ChainedHashTable *table, int64 key,
+	int64 *value) {
+	int64 *stored = chain_value(table, &table->slots[h1(key) % table->size],
+		key);
+	if (stored && value) {
+		*value = *stored;
+	}
+	return stored != NULL;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a chained hash table with initial size 'size'
+ChainedHashTable *new_chained_hash_table(int size) {
+	assert(size > 0);
+	ChainedHashTable *table = cache_line_alloc(sizeof *table);
+	assert(table);
+
+	initialise_slots(table, size);
+	table->nodes = NULL;
+	table->nnodes = 0;
+	table->freenode = NO_NODE;
+
+	table->stats.nkeys = 0;
+	table->stats.nnodes = 0;
+	table->stats.time = 0;
+	return table;
+}
+
+
+// free all memory associated with 'table'
+void free_chained_hash_table(ChainedHashTable *table) {
+	assert(table != NULL);
+
+	// free the slots and the pool of nodes
+	free(table->slots);
+	free(table->nodes);
+
+	// free the table struct itself
+	cache_line_free(table);
+}
+
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting that many
+// keys won't need to resize it. the pool gets a node for every key too, so it
+// never has to grow either (even though the first key of each chain doesn't
+// need one)
+void chained_hash_table_reserve(ChainedHashTable *table, int nkeys) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int size = nkeys / MAX_LOAD_FACTOR + 1;
+	if (table->size < size) {
+		resize_table(table, size);
+	}
+	if (table->nnodes < nkeys) {
+		grow_pool(table, nkeys);
+	}
+	table->stats.time += clock() - start_time;
+}
+
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool chained_hash_table_insert(ChainedHashTable *table, int64 key) {
+	return chained_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool chained_hash_table_upsert(ChainedHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool inserted = upsert_key(table, key, value, merge);
+	table->stats.time += clock() - start_time;
+	return inserted;
+}
+
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool chained_hash_table_lookup(ChainedHashTable *table, int64 key) {
+	return chained_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool chained_hash_table_get(ChainedHashTable *table, int64 key,
+	int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void chained_hash_table_lookup_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	chained_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void chained_hash_table_probe_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
+		}
+	}
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int chained_hash_table_insert_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
+	}
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int chained_hash_table_scan(ChainedHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int n = chained_hash_table_probe_scan(table, cursor, keys, values, max);
+
+	table->stats.time += clock() - start_time;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void chained_hash_table_scan_ranges(ChainedHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+
+	// chains are split up evenly, and the cursors told the table's size
+	scan_split(cursors, n, table->size);
+	int i;
+	for (i = 0; i < n; i++) {
+		cursors[i].size = table->size;
+	}
+	scan_skip_empty(cursors, n, table->size);
+
+	table->stats.time += clock() - start_time;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int chained_hash_table_probe_scan(ChainedHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+
+	// growing the table moves every key, so if it has grown since the scan
+	// started, the scan has to start over
+	if (cursor->pos != SCAN_DONE && cursor->size != table->size) {
+		cursor->pos = 0;
+		cursor->size = table->size;
+	}
+
+	int n = 0;
+	while (n < max && cursor->pos != SCAN_DONE) {
+		Slot *slot = &table->slots[cursor->pos];
+
+		// new keys go in near the front of a chain, so if the last chunk
+		// stopped partway through this chain and it has grown since, go back
+		// over it from the start
+		if (cursor->skip > 0
+			&& !scan_can_resume(cursor, chain_length(table, slot), 0)) {
+			cursor->skip = 0;
+		}
+
+		// copy the keys in the chain that haven't been returned yet, as long
+		// as there's room for them
+		int i = 0;
+		if (slot->full) {
+			if (i >= cursor->skip) {
+				keys[n] = slot->key;
+				if (values) {
+					values[n] = slot->value;
+				}
+				n++;
+			}
+			i++;
+		}
+		int node;
+		for (node = slot->next; node != NO_NODE && n < max;
+			node = table->nodes[node].next) {
+			if (i >= cursor->skip) {
+				keys[n] = table->nodes[node].key;
+				if (values) {
+					values[n] = table->nodes[node].value;
+				}
+				n++;
+			}
+			i++;
+		}
+
+		// ran out of room partway through the chain? pick up here next time
+		if (node != NO_NODE) {
+			cursor->skip = i;
+			cursor->nkeys = chain_length(table, slot);
+			cursor->depth = 0;
+			break;
+		}
+		cursor->skip = 0;
+		cursor->pos = cursor->pos + 1 < scan_end(cursor, table->size)
+			? cursor->pos + 1 : SCAN_DONE;
+	}
+
+	return n;
+}
+
+
+// how many keys are in 'table'
+int chained_hash_table_nkeys(ChainedHashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
+}
+
+
+// print the contents of 'table' to stdout
+void chained_hash_table_print(ChainedHashTable *table) {
+	assert(table != NULL);
+
+	printf("--- table size: %d\n", table->size);
+
+	// print header
+	printf("   address | keys\n");
+
+	// print the rows of the hash table
+	int i;
+	for (i = 0; i < table->size; i++) {
+		Slot *slot = &table->slots[i];
+
+		// print the address
+		printf(" %9d | ", i);
+
+		// print the chain for this slot
+		if (slot->full) {
+			printf("[%llu]", slot->key);
+			int node;
+			for (node = slot->next; node != NO_NODE;
+				node = table->nodes[node].next) {
+				printf(" +[%llu]", table->nodes[node].key);
+			}
+			printf("\n");
+		} else {
+			printf("-\n");
+		}
+	}
+
+	printf("--- end table ---\n");
+}
+
+
+// print some statistics about 'table' to stdout
+void chained_hash_table_stats(ChainedHashTable *table) {
+	assert(table != NULL);
+	printf("--- table stats ---\n");
+
+	// print some information about the table
+	printf("current size: %d slots\n", table->size);
+	printf("current load: %d items\n", table->stats.nkeys);
+	printf(" load factor: %.3f%%\n", table->stats.nkeys * 100.0 / table->size);
+	printf("  keys in nodes: %d\n", table->stats.nnodes);
+	printf("  node pool size: %d\n", table->nnodes);
+
+	// also calculate CPU usage in seconds and print this
+	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	printf("    CPU time spent: %.6f sec\n", seconds);
+
+	printf("--- end stats ---\n");
+}
@@ -0,0 +1,88 @@
+/* * * * * * * * *
+ * Dynamic hash table using separate chaining to resolve collisions: keys
+ * sharing a slot are kept in a linked list (chain) hanging off that slot
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef CHAINED_H
+#define CHAINED_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
+
+typedef struct chained_table ChainedHashTable;
+
+// initialise a chained hash table with initial size 'size'
+ChainedHashTable *new_chained_hash_table(int size);
+
+// free all memory associated with 'table'
+void free_chained_hash_table(ChainedHashTable *table);
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void chained_hash_table_reserve(ChainedHashTable *table, int nkeys);
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool chained_hash_table_insert(ChainedHashTable *table, int64 key);
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool chained_hash_table_lookup(ChainedHashTable *table, int64 key);
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool chained_hash_table_upsert(ChainedHashTable *table, int64 key,
+	int64 value, MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool chained_hash_table_get(ChainedHashTable *table, int64 key, int64 *value);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void chained_hash_table_lookup_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// chained_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void chained_hash_table_probe_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int chained_hash_table_insert_batch(ChainedHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int chained_hash_table_scan(ChainedHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void chained_hash_table_scan_ranges(ChainedHashTable *table,
+	ScanCursor *cursors, int n);
+
+// chained_hash_table_scan(), untimed (see hash_table_probe_scan())
+int chained_hash_table_probe_scan(ChainedHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int chained_hash_table_nkeys(ChainedHashTable *table);
+
+// print the contents of 'table' to stdout
+void chained_hash_table_print(ChainedHashTable *table);
+
+// print some statistics about 'table' to stdout
+void chained_hash_table_stats(ChainedHashTable *table);
+
+#endif
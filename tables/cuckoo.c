@@ -14,6 +14,22 @@
 #include <assert.h>
 #include <time.h>
 #include "cuckoo.h"
+#include "sketch.h"
+#include "prefetch.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 1
+
+// the batch lookup kernel uses AVX2 gathers when the CPU has them (checked at
+// run time), so it's only compiled where the compiler can target AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#else
+#define HAVE_AVX2_KERNEL 0
+#endif
 
 /*
 #include <windows.h>
@@ -28,17 +44,35 @@
 
 #define EMPTY 0
 
+// a chain of kicks this long probably means the keys being kicked around form
+// a cycle (which needn't involve the key being inserted), so the tables grow
+#define MAX_KICKS 128
+
+// reserving room for n keys gives each table n + n / RESERVE_SPARE slots
+#define RESERVE_SPARE 4
+
+// the 'inuse' arrays have this many extra bytes on the end, so that the batch
+// lookup kernel can read a whole 4-byte word at any slot's 'inuse' flag
+#define INUSE_PADDING sizeof(int)
+
 typedef struct stats {
 	int nkeys;		// how many keys are being stored in the table
+	int nmoved;		// how many hot keys have been moved to table one
 	int time;		// how much CPU time has been used to insert/lookup keys
 					// in this table
 } Stats;
 
+// a slot holds a key along with its value, so both are in the same cache line
+typedef struct slot {
+	int64 key;		// the key stored in this slot
+	int64 value;	// the value stored with it
+} Slot;
+
 // an inner table represents one of the two internal tables for a cuckoo
-// hash table. it stores two parallel arrays: 'slots' for storing keys and
-// 'inuse' for marking which entries are occupied
+// hash table. it stores two parallel arrays: 'slots' for storing keys (and
+// their values) and 'inuse' for marking which entries are occupied
 typedef struct inner_table {
-	int64 *slots;	// array of slots holding keys
+	Slot  *slots;	// array of slots holding keys
 	bool  *inuse;	// is this slot in use or not?
 } InnerTable;
 
@@ -47,26 +81,95 @@ struct cuckoo_table {
 	InnerTable *table1; // first table
 	InnerTable *table2; // second table
 	int size;			// size of each table
+	Sketch *hot;		// how often keys are being looked up
 	Stats stats;
 };
 
 void upsize_table(CuckooHashTable *table, int size);
 void upsize_inner(InnerTable *table, int size);
 InnerTable *new_inner_table(int size);
-void try_insert(CuckooHashTable *table, int64 size, int orig_pos, 
-				int64 key, int loop);
+void try_insert(CuckooHashTable *table, Slot slot, int orig_pos, 
+				int64 orig_key, int loop);
+static void promote_if_hot(CuckooHashTable *table, int64 key, int hash1, int hash2);
+static bool contains(CuckooHashTable *table, int64 key);
+static Slot *find_slot(CuckooHashTable *table, int64 key);
+static bool rebuild_table(CuckooHashTable *table, int size);
+#if HAVE_AVX2_KERNEL
+static int lookup_batch_avx2(CuckooHashTable *table, const int64 *keys, int n,
+	unsigned char *found);
+#endif
+
+// start loading both of the slots 'key' could be in
+static void prefetch_key(CuckooHashTable *table, int64 key, int stage) {
+	int pos1 = h1(key) % table->size;
+	int pos2 = h2(key) % table->size;
+	prefetch(&table->table1->slots[pos1]);
+	prefetch(&table->table1->inuse[pos1]);
+	prefetch(&table->table2->slots[pos2]);
+	prefetch(&table->table2->inuse[pos2]);
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in cuckoo_hash_table_upsert(), but untimed)
+static bool upsert_key(CuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	// Check if the key is already in the table, if so, update its value and
+	// return false
+	Slot *slot = find_slot(table, key);
+	if (slot != NULL){
+		slot->value = merge(slot->value, value);
+		return false;
+	}
+	// call recursive function with the key and hash. If false, then
+	// return unsuccessful insert, else return success
+	Slot new_slot = {key, value};
+	try_insert(table, new_slot, (h1(key)%table->size), key, EMPTY);
+	return true;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in cuckoo_hash_table_get(), but untimed)
+static bool get_key(CuckooHashTable *table, int64 key, int64 *value) {
+	// Check both positions the key could possibly be in, first choice first
+	// (only working out the second position if we need to)
+	int hash1 = h1(key);
+	int pos1 = hash1 % table->size;
+	// If key is found, return true
+	if (table->table1->inuse[pos1] && table->table1->slots[pos1].key == key){
+		if (value) {
+			*value = table->table1->slots[pos1].value;
+		}
+		return true;
+	}
+	int hash2 = h2(key);
+	int pos2 = hash2 % table->size;
+	if (table->table2->inuse[pos2] && table->table2->slots[pos2].key == key){
+		if (value) {
+			*value = table->table2->slots[pos2].value;
+		}
+		// a key which keeps being found here should move to table one
+		if (TRACK_HOT_KEYS) {
+			promote_if_hot(table, key, hash1, hash2);
+		}
+		return true;
+	}
+	return false;
+}
+
 
 // initialise a cuckoo hash table with 'size' slots in each table
 CuckooHashTable *new_cuckoo_hash_table(int size) {
 	// Create a cuckoo table
-	CuckooHashTable *cuckoo = malloc(sizeof* cuckoo);
+	CuckooHashTable *cuckoo = cache_line_alloc(sizeof *cuckoo);
 	assert(cuckoo != NULL);
 	// Create two new inner tables (use helpter function here)
 	cuckoo->table1 = new_inner_table(size);
 	cuckoo->table2 = new_inner_table(size);
 	cuckoo->size = size;
+	cuckoo->hot = new_sketch();
 	cuckoo->stats.time = 0;
 	cuckoo->stats.nkeys = 0;
+	cuckoo->stats.nmoved = 0;
 	return cuckoo;
 }
 
@@ -78,48 +181,229 @@ void free_cuckoo_hash_table(CuckooHashTable *table) {
 	free(table->table2->slots);
 	free(table->table2->inuse);
 	// Free inner tables
-	free(table->table1);
-	free(table->table2);
+	cache_line_free(table->table1);
+	cache_line_free(table->table2);
+	free_sketch(table->hot);
 	// Free table
-	free(table);
+	cache_line_free(table);
+}
+
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting that many
+// keys won't need to resize it. cuckoo hashing only reliably works while the
+// tables are under half full, so each table gets 'nkeys' slots plus a margin
+// of 1 / RESERVE_SPARE of that
+void cuckoo_hash_table_reserve(CuckooHashTable *table, int nkeys) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int size = nkeys + nkeys / RESERVE_SPARE + 1;
+	if (table->size < size) {
+		upsize_table(table, size);
+	}
+	table->stats.time += clock() - start_time;
+}
+
+
+// shrink 'table' to the room reserving its keys would give it, if it's bigger
+// than that. the keys are moved over in a loop rather than through
+// upsize_table's recursive reinsertion, and if they don't all fit, the new
+// tables are doubled until they do (or until they're no smaller any more)
+void cuckoo_hash_table_shrink_to_fit(CuckooHashTable *table) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int nkeys = table->stats.nkeys;
+	int size = nkeys + nkeys / RESERVE_SPARE + 1;
+	while (size < table->size && !rebuild_table(table, size)) {
+		size *= 2;
+	}
+	table->stats.time += clock() - start_time;
 }
 
 
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key) {
-	// Check if the key is already in the table, if so, return false
+	return cuckoo_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool cuckoo_hash_table_upsert(CuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	assert(table != NULL);
 	int start_time = clock(); // start timing
-	if (cuckoo_hash_table_lookup(table, key) == true){
-		table->stats.time += clock() - start_time;
-		return false;
-	}
-	// call recursive function with the key and hash. If false, then
-	// return unsuccessful insert, else return success
-	try_insert(table, key, (h1(key)%table->size), key, EMPTY);
+	bool inserted = upsert_key(table, key, value, merge);
 	table->stats.time += clock() - start_time;
-	return true;
+	return inserted;
 }
 
 
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool cuckoo_hash_table_lookup(CuckooHashTable *table, int64 key) {
-	int start_time = clock(); 
-	// Check both positions the key could possibly be in
-	int pos1 = h1(key) % table->size;
-	int pos2 = h2(key) % table->size;
-	// If key is found, return true
-	if (table->table1->slots[pos1] == key){
-		table->stats.time += clock() - start_time;		
-		return true;
+	return cuckoo_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool cuckoo_hash_table_get(CuckooHashTable *table, int64 key, int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int cuckoo_hash_table_insert_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
 	}
-	else if (table->table2->slots[pos2] == key){
-		table->stats.time += clock() - start_time;
-		return true;
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void cuckoo_hash_table_lookup_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock();
+	cuckoo_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void cuckoo_hash_table_probe_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int i;
+	// each key's slots are prefetched PREFETCH_DISTANCE keys before it's
+	// checked, so start off the first few keys' slots now
+	for (i = 0; i < PREFETCH_DISTANCE && i < n; i++) {
+		prefetch_key(table, keys[i], 1);
 	}
+	i = 0;
+#if HAVE_AVX2_KERNEL
+	// check keys 8 at a time with the vector kernel if we can
+	if (__builtin_cpu_supports("avx2")) {
+		i = lookup_batch_avx2(table, keys, n, found);
+	}
+#endif
+	// and the rest (or all of them, without AVX2) one at a time
+	for (; i < n; i++) {
+		if (i + PREFETCH_DISTANCE < n) {
+			prefetch_key(table, keys[i + PREFETCH_DISTANCE], 1);
+		}
+		set_bit(found, i, contains(table, keys[i]));
+	}
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int cuckoo_hash_table_scan(CuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int n = cuckoo_hash_table_probe_scan(table, cursor, keys, values, max);
+
 	table->stats.time += clock() - start_time;
-	return false;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void cuckoo_hash_table_scan_ranges(CuckooHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+
+	// positions (through both tables) are split up evenly, and the cursors
+	// told the table's size
+	int64 end = 2 * (int64)table->size;
+	scan_split(cursors, n, end);
+	int i;
+	for (i = 0; i < n; i++) {
+		cursors[i].size = table->size;
+	}
+	scan_skip_empty(cursors, n, end);
+
+	table->stats.time += clock() - start_time;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int cuckoo_hash_table_probe_scan(CuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+
+	// growing the table moves every key, so if it has grown since the scan
+	// started, the scan has to start over
+	if (cursor->pos != SCAN_DONE && cursor->size != table->size) {
+		cursor->pos = 0;
+		cursor->size = table->size;
+	}
+
+	// positions run through the first table and then the second
+	int n = 0;
+	if (cursor->pos != SCAN_DONE) {
+		int64 end = scan_end(cursor, 2 * (int64)table->size);
+		int64 i;
+		for (i = cursor->pos; i < end && n < max; i++) {
+			InnerTable *inner_table = i < table->size ? table->table1
+				: table->table2;
+			int pos = i % table->size;
+			if (inner_table->inuse[pos]) {
+				keys[n] = inner_table->slots[pos].key;
+				if (values) {
+					values[n] = inner_table->slots[pos].value;
+				}
+				n++;
+			}
+		}
+		cursor->pos = i < end ? i : SCAN_DONE;
+	}
+
+	return n;
+}
+
+
+// how many keys are in 'table'
+int cuckoo_hash_table_nkeys(CuckooHashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
 }
 
 
@@ -138,7 +422,7 @@ void cuckoo_hash_table_print(CuckooHashTable *table) {
 
 		// table 1 key
 		if (table->table1->inuse[i]) {
-			printf(" %20llu ", table->table1->slots[i]);
+			printf(" %20llu ", table->table1->slots[i].key);
 		} else {
 			printf(" %20s ", "-");
 		}
@@ -148,7 +432,7 @@ void cuckoo_hash_table_print(CuckooHashTable *table) {
 
 		// table 2 key
 		if (table->table2->inuse[i]) {
-			printf(" %llu\n", table->table2->slots[i]);
+			printf(" %llu\n", table->table2->slots[i].key);
 		} else {
 			printf(" %s\n",  "-");
 		}
@@ -167,6 +451,7 @@ void cuckoo_hash_table_stats(CuckooHashTable *table) {
 	printf("current size: %d slots\n", table->size);
 	printf("current load: %d items\n", table->stats.nkeys);
 	printf(" load factor: %.3f%%\n", table->stats.nkeys * 100.0 / table->size*2);
+	printf("    hot keys moved: %d\n", table->stats.nmoved);
 	// also calculate CPU usage in seconds and print this
 	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
 	printf("    CPU time spent: %.6f sec\n", seconds);
@@ -179,13 +464,13 @@ void cuckoo_hash_table_stats(CuckooHashTable *table) {
 InnerTable *new_inner_table(int size) {
 	int i;
 	// Malloc the new inner table
-	InnerTable *table = malloc(sizeof(*table));
+	InnerTable *table = cache_line_alloc(sizeof *table);
 	assert(table != NULL);
 	// Malloc the size of the inner table slots array
 	table->slots = malloc(sizeof(*table->slots) * size);
 	assert(table->slots != NULL);
 	// Malloc the size of the inner table inuse array
-	table->inuse = malloc(sizeof(*table->inuse) * size);
+	table->inuse = malloc(sizeof(*table->inuse) * size + INUSE_PADDING);
 	assert(table->inuse != NULL);
 
 	// Set all inuse values to false
@@ -196,8 +481,9 @@ InnerTable *new_inner_table(int size) {
 }
 
 // Recursive function which performs cuckoo hash
-void try_insert(CuckooHashTable *table, int64 key, int orig_pos, 
+void try_insert(CuckooHashTable *table, Slot slot, int orig_pos, 
 				int64 orig_key, int loop){
+	int64 key = slot.key;
 	int init_pos; 
 	// Increment loop
 	loop++;
@@ -217,7 +503,14 @@ void try_insert(CuckooHashTable *table, int64 key, int orig_pos,
 	if ((init_pos == orig_pos) && (key == orig_key) && (loop > 1) && 
 		(loop % 2 == 1)) {
 		upsize_table(table, table->size*2);
-		try_insert(table, key, orig_pos, orig_key, EMPTY);
+		try_insert(table, slot, orig_pos, orig_key, EMPTY);
+		return;
+	}
+	// Same if the chain of kicks has just gone on for too long, but starting
+	// over with whichever key is now left without a place
+	if (loop > MAX_KICKS) {
+		upsize_table(table, table->size*2);
+		try_insert(table, slot, h1(key) % table->size, key, EMPTY);
 		return;
 	}
 	// check if there is already something in the position
@@ -225,19 +518,59 @@ void try_insert(CuckooHashTable *table, int64 key, int orig_pos,
 		// if there's already something in that position, then insert and
 		// recursively call insert with the opposite table and the key
 		// taken out
-		int64 rehash_key = inner_table->slots[init_pos];
-		inner_table->slots[init_pos] = key;
-		try_insert(table, rehash_key, orig_pos, orig_key, loop);
+		Slot rehash_slot = inner_table->slots[init_pos];
+		inner_table->slots[init_pos] = slot;
+		try_insert(table, rehash_slot, orig_pos, orig_key, loop);
 		return;
 	}
 	else {
 		// If there's nothing there, insert!
 		inner_table->inuse[init_pos] = true;
-		inner_table->slots[init_pos] = key;
+		inner_table->slots[init_pos] = slot;
 		table->stats.nkeys++;
 	}
 }
 
+// Counts a lookup of 'key', found in table two, and if it's been looked up
+// often enough, moves it to its position in table one (as long as whatever is
+// there is less popular and has somewhere to go in table two)
+static void promote_if_hot(CuckooHashTable *table, int64 key, int hash1, int hash2) {
+	int count = sketch_add(table->hot, hash1, hash2);
+	if (count < HOT_THRESHOLD) {
+		return;
+	}
+	int pos1 = hash1 % table->size;
+	int pos2 = hash2 % table->size;
+	InnerTable *table1 = table->table1;
+	InnerTable *table2 = table->table2;
+
+	// nothing in the way? just move over
+	if (table1->inuse[pos1] == false) {
+		table1->inuse[pos1] = true;
+		table1->slots[pos1] = table2->slots[pos2];
+		table2->inuse[pos2] = false;
+		table->stats.nmoved++;
+		return;
+	}
+
+	// otherwise the key in the way has to go to table two, either into the 
+	// slot we're leaving, or into an empty slot
+	Slot resident = table1->slots[pos1];
+	int resident_hash1 = h1(resident.key);
+	int resident_hash2 = h2(resident.key);
+	if (sketch_estimate(table->hot, resident_hash1, resident_hash2) >= count) {
+		return;
+	}
+	int resident_pos2 = resident_hash2 % table->size;
+	if (resident_pos2 == pos2 || table2->inuse[resident_pos2] == false) {
+		table1->slots[pos1] = table2->slots[pos2];
+		table2->inuse[pos2] = false;
+		table2->inuse[resident_pos2] = true;
+		table2->slots[resident_pos2] = resident;
+		table->stats.nmoved++;
+	}
+}
+
 // Function doubles the size of the table
 void upsize_table(CuckooHashTable *table, int size) {
 	// Check the table for size and emptiness
@@ -245,8 +578,8 @@ void upsize_table(CuckooHashTable *table, int size) {
 	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
 	int i;
 	// Copy old keys into their respective arrays
-	int64 *old_keys_1 = table->table1->slots;
-	int64 *old_keys_2 = table->table2->slots;
+	Slot *old_slots_1 = table->table1->slots;
+	Slot *old_slots_2 = table->table2->slots;
 	bool *old_inuse_1 = table->table1->inuse;
 	bool *old_inuse_2 = table->table2->inuse;
 	int old_size = table->size;
@@ -255,18 +588,21 @@ void upsize_table(CuckooHashTable *table, int size) {
 	upsize_inner(table->table2, size);
 	// update table size
 	table->size = size;
-	// Reinsert old keys into respective tables
+	// Reinsert old keys into respective tables (which counts them all again)
+	table->stats.nkeys = 0;
 	for (i = 0; i < old_size; i++) {
 		if (old_inuse_1[i] == true){
-			cuckoo_hash_table_insert(table, old_keys_1[i]);
+			cuckoo_hash_table_upsert(table, old_slots_1[i].key,
+				old_slots_1[i].value, merge_keep);
 		}
 		if (old_inuse_2[i] == true){
-			cuckoo_hash_table_insert(table, old_keys_2[i]);
+			cuckoo_hash_table_upsert(table, old_slots_2[i].key,
+				old_slots_2[i].value, merge_keep);
 		}
 	}
 	// Free arrays
-	free(old_keys_1);
-	free(old_keys_2);
+	free(old_slots_1);
+	free(old_slots_2);
 	free(old_inuse_1);
 	free(old_inuse_2);
 }
@@ -277,10 +613,179 @@ void upsize_inner(InnerTable *table, int size){
 	// Malloc the table arrays
 	table->slots = malloc((sizeof *table->slots) * size);
 	assert(table->slots);
-	table->inuse = malloc((sizeof *table->inuse) * size);
+	table->inuse = malloc((sizeof *table->inuse) * size + INUSE_PADDING);
 	assert(table->inuse);
 	// Set all slots to false
 	for (i = 0; i < size; i++) {
 		table->inuse[i] = false;
 	}
 }
+
+// Put 'slot' (whose key is in neither table) into 'table1' or 'table2', both
+// of 'size' slots, kicking keys back and forth in a loop (rather than by
+// recursion, like try_insert). Returns false if a key is still left without
+// a place after MAX_KICKS kicks, in which case that key has been lost: only
+// use this to fill new tables, which can be thrown away
+static bool place_slot(InnerTable *table1, InnerTable *table2, int size,
+	Slot slot) {
+	int kicks;
+	for (kicks = 0; kicks < MAX_KICKS; kicks++) {
+		InnerTable *inner_table = kicks % 2 == 0 ? table1 : table2;
+		int pos = (kicks % 2 == 0 ? h1(slot.key) : h2(slot.key)) % size;
+		if (inner_table->inuse[pos] == false) {
+			inner_table->inuse[pos] = true;
+			inner_table->slots[pos] = slot;
+			return true;
+		}
+		Slot kicked = inner_table->slots[pos];
+		inner_table->slots[pos] = slot;
+		slot = kicked;
+	}
+	return false;
+}
+
+// Moves every key into new tables of 'size' slots each, unless one of them
+// can't be placed there, in which case the table is left as it was. Returns
+// whether the keys were moved
+static bool rebuild_table(CuckooHashTable *table, int size) {
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+	InnerTable *table1 = new_inner_table(size);
+	InnerTable *table2 = new_inner_table(size);
+	InnerTable *old_tables[] = {table->table1, table->table2};
+	bool placed = true;
+	int t, i;
+	for (t = 0; t < 2 && placed; t++) {
+		for (i = 0; i < table->size && placed; i++) {
+			if (old_tables[t]->inuse[i]) {
+				placed = place_slot(table1, table2, size,
+					old_tables[t]->slots[i]);
+			}
+		}
+	}
+
+	// keep whichever tables hold all of the keys, and free the others
+	if (placed) {
+		table->table1 = table1;
+		table->table2 = table2;
+		table->size = size;
+	} else {
+		old_tables[0] = table1;
+		old_tables[1] = table2;
+	}
+	for (t = 0; t < 2; t++) {
+		free(old_tables[t]->slots);
+		free(old_tables[t]->inuse);
+		cache_line_free(old_tables[t]);
+	}
+	return placed;
+}
+
+// Is 'key' in either of its positions? (without counting the lookup towards
+// moving hot keys, as cuckoo_hash_table_lookup does)
+static bool contains(CuckooHashTable *table, int64 key) {
+	return find_slot(table, key) != NULL;
+}
+
+// The slot holding 'key', or NULL if it's in neither of its positions
+static Slot *find_slot(CuckooHashTable *table, int64 key) {
+	int pos1 = h1(key) % table->size;
+	if (table->table1->inuse[pos1] && table->table1->slots[pos1].key == key) {
+		return &table->table1->slots[pos1];
+	}
+	int pos2 = h2(key) % table->size;
+	if (table->table2->inuse[pos2] && table->table2->slots[pos2].key == key) {
+		return &table->table2->slots[pos2];
+	}
+	return NULL;
+}
+
+#if HAVE_AVX2_KERNEL
+
+// (a * k + b) % p for four keys at once, exactly as h1() and h2() compute it.
+// AVX2 has no 64-bit multiply, so a * k is put together from 32-bit multiplies
+// (a fits in 32 bits), and has no divide, so the remainder is found by folding
+// the high bits back in: p = 2^31 - c, so 2^32 = 2c and 2^31 = c (mod p)
+__attribute__((target("avx2")))
+static __m256i hash4(__m256i k, int64 a, int64 b, int64 p) {
+	__m256i va = _mm256_set1_epi64x(a);
+	__m256i c = _mm256_set1_epi64x((1LL << 31) - p);
+	__m256i lo = _mm256_mul_epu32(k, va);
+	__m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(k, 32), va);
+	__m256i x = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+	x = _mm256_add_epi64(x, _mm256_set1_epi64x(b));
+
+	// x = high * 2^32 + low = high * 2c + low, now below 2^41
+	x = _mm256_add_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(x, 32), _mm256_add_epi64(c, c)),
+		_mm256_and_si256(x, _mm256_set1_epi64x(0xffffffffLL)));
+	// x = high * 2^31 + low = high * c + low, now below 2p
+	x = _mm256_add_epi64(
+		_mm256_mul_epu32(_mm256_srli_epi64(x, 31), c),
+		_mm256_and_si256(x, _mm256_set1_epi64x(0x7fffffffLL)));
+	// so at most one more p to take off
+	__m256i vp = _mm256_set1_epi64x(p);
+	__m256i over = _mm256_cmpgt_epi64(x, _mm256_set1_epi64x(p - 1));
+	return _mm256_sub_epi64(x, _mm256_and_si256(over, vp));
+}
+
+// x % size for four hash values (below 2^31) at once. the quotient is worked
+// out in double precision: with x below 2^31 the division can't round up
+// across a whole number, so taking its floor gives the exact quotient
+__attribute__((target("avx2")))
+static __m256i mod4(__m256i x, int size) {
+	// hash values converted to doubles by putting them in the mantissa of 2^52
+	__m256i magic = _mm256_set1_epi64x(0x4330000000000000LL);
+	__m256d xd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(x, magic)),
+		_mm256_set1_pd(4503599627370496.0));
+	__m256d q = _mm256_floor_pd(_mm256_div_pd(xd, _mm256_set1_pd(size)));
+	__m256i qi = _mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(q));
+	return _mm256_sub_epi64(x,
+		_mm256_mul_epu32(qi, _mm256_set1_epi64x(size)));
+}
+
+// which of the four keys 'k' are at positions 'pos' of 'inner'? returns a
+// lane mask (all ones where the key is there, zero where it isn't)
+__attribute__((target("avx2")))
+static __m256i gather_match4(InnerTable *inner, __m256i k, __m256i pos) {
+	// (each slot is two 8-byte words: the key, then its value)
+	__m256i slots = _mm256_i64gather_epi64((const long long *)inner->slots,
+		_mm256_slli_epi64(pos, 1), 8);
+	// gathers are at least 32 bits wide, so take each slot's 'inuse' byte
+	// from the 4 bytes starting there (hence the padding on 'inuse' arrays)
+	__m128i inuse = _mm256_i64gather_epi32((const int *)inner->inuse, pos, 1);
+	inuse = _mm_and_si128(inuse, _mm_set1_epi32(0xff));
+	__m256i unused = _mm256_cvtepi32_epi64(
+		_mm_cmpeq_epi32(inuse, _mm_setzero_si128()));
+	return _mm256_andnot_si256(unused, _mm256_cmpeq_epi64(slots, k));
+}
+
+// which of the four keys at 'keys' are in 'table'? returns a 4-bit mask
+__attribute__((target("avx2")))
+static int lookup4(CuckooHashTable *table, const int64 *keys) {
+	__m256i k = _mm256_loadu_si256((const __m256i *)keys);
+	__m256i pos1 = mod4(hash4(k, H1_A, H1_B, H1_P), table->size);
+	__m256i pos2 = mod4(hash4(k, H2_A, H2_B, H2_P), table->size);
+	// both positions are always checked: no branches to mispredict
+	__m256i match = _mm256_or_si256(gather_match4(table->table1, k, pos1),
+		gather_match4(table->table2, k, pos2));
+	return _mm256_movemask_pd(_mm256_castsi256_pd(match));
+}
+
+// check as many of the 'n' keys as fit in whole groups of 8, writing a byte
+// of 'found' per group. returns how many keys were checked
+__attribute__((target("avx2")))
+static int lookup_batch_avx2(CuckooHashTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	int i, j;
+	for (i = 0; i + 8 <= n; i += 8) {
+		// start loading the slots of the keys PREFETCH_DISTANCE keys along
+		for (j = i + PREFETCH_DISTANCE; j < i + PREFETCH_DISTANCE + 8 && j < n;
+			j++) {
+			prefetch_key(table, keys[j], 1);
+		}
+		found[i / 8] = lookup4(table, keys + i) | lookup4(table, keys + i + 4) << 4;
+	}
+	return i;
+}
+
+#endif
@@ -11,6 +11,8 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
 
 typedef struct cuckoo_table CuckooHashTable;
 
@@ -20,6 +22,14 @@ CuckooHashTable *new_cuckoo_hash_table(int size);
 // free all memory associated with 'table'
 void free_cuckoo_hash_table(CuckooHashTable *table);
 
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void cuckoo_hash_table_reserve(CuckooHashTable *table, int nkeys);
+
+// shrink 'table' to fit the keys it holds now, giving back the memory it no
+// longer needs
+void cuckoo_hash_table_shrink_to_fit(CuckooHashTable *table);
+
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key);
@@ -28,6 +38,53 @@ bool cuckoo_hash_table_insert(CuckooHashTable *table, int64 key);
 // returns true if found, false if not
 bool cuckoo_hash_table_lookup(CuckooHashTable *table, int64 key);
 
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool cuckoo_hash_table_upsert(CuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool cuckoo_hash_table_get(CuckooHashTable *table, int64 key, int64 *value);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int cuckoo_hash_table_insert_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+// ('found' needs room for (n + 7) / 8 bytes). unlike single lookups, these
+// don't count towards moving hot keys
+void cuckoo_hash_table_lookup_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// cuckoo_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void cuckoo_hash_table_probe_batch(CuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int cuckoo_hash_table_scan(CuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void cuckoo_hash_table_scan_ranges(CuckooHashTable *table,
+	ScanCursor *cursors, int n);
+
+// cuckoo_hash_table_scan(), untimed (see hash_table_probe_scan())
+int cuckoo_hash_table_probe_scan(CuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int cuckoo_hash_table_nkeys(CuckooHashTable *table);
+
 // print the contents of 'table' to stdout
 void cuckoo_hash_table_print(CuckooHashTable *table);
 
@@ -0,0 +1,128 @@
+/* * * * * * * * *
+ * Cursors for scanning the keys of a hash table a chunk at a time: a scan can
+ * stop after any chunk and pick up again later, even if keys have been
+ * inserted in the meantime
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+// marks a cursor whose scan has finished
+#define SCAN_DONE ((int64)-1)
+
+// extendible tables are scanned in order of their addresses with the bits
+// reversed (rightmost bit first), over all 31 bits of a hash value. that way
+// each bucket covers a single run of 2^(31 - depth) positions, so it takes one
+// directory lookup to find and is then skipped over in one step, and the
+// buckets it may later split into stay inside its run: splits never move keys
+// from ahead of the cursor to behind it
+#define SCAN_BITS 31
+
+// where a scan of a table is up to. a zeroed cursor starts a new scan
+typedef struct scan_cursor {
+	int64 pos;	// the slot (or bucket position) to scan next, or SCAN_DONE
+	int skip;	// how many keys there have been returned already, if the
+				// last chunk ended partway through them
+	int nkeys;	// how many keys there were there at the time
+	int depth;	// and the depth of their bucket, in extendible tables
+	int size;	// the size of the table the scan started on, in tables whose
+				// keys all move when the table grows
+	int64 end;	// the position to stop before, in scans of one range of a
+				// table, or 0 to scan to the end of the table
+} ScanCursor;
+
+// where a scan of a table with 'end' positions should stop before
+static inline int64 scan_end(ScanCursor *cursor, int64 end) {
+	return cursor->end && cursor->end < end ? cursor->end : end;
+}
+
+// start the 'n' cursors in 'cursors' on ranges of about the same number of
+// positions, splitting up positions 0 to 'end' - 1 between them. the last
+// range runs to the end of the table, whatever that is by then, and empty
+// ranges (when there are fewer positions than ranges) start out finished
+static inline void scan_split(ScanCursor *cursors, int n, int64 end) {
+	int i;
+	for (i = 0; i < n; i++) {
+		ScanCursor cursor = {0};
+		cursor.pos = end * i / n;
+		if (i < n - 1) {
+			cursor.end = end * (i + 1) / n;
+			if (cursor.end == cursor.pos) {
+				cursor.pos = SCAN_DONE;
+			}
+		}
+		cursors[i] = cursor;
+	}
+}
+
+// finish any of the 'n' cursors in 'cursors' whose range is empty, in a table
+// with 'end' positions
+static inline void scan_skip_empty(ScanCursor *cursors, int n, int64 end) {
+	int i;
+	for (i = 0; i < n; i++) {
+		if (cursors[i].pos >= scan_end(&cursors[i], end)) {
+			cursors[i].pos = SCAN_DONE;
+		}
+	}
+}
+
+// the address for extendible table scan position 'pos': its rightmost
+// SCAN_BITS bits in reverse
+static inline int scan_address(int64 pos) {
+	// reverse all 32 bits by swapping ever larger groups of them, then drop
+	// the bit that was past the last of them
+	unsigned int bits = pos;
+	bits = ((bits >> 1) & 0x55555555) | ((bits & 0x55555555) << 1);
+	bits = ((bits >> 2) & 0x33333333) | ((bits & 0x33333333) << 2);
+	bits = ((bits >> 4) & 0x0f0f0f0f) | ((bits & 0x0f0f0f0f) << 4);
+	bits = ((bits >> 8) & 0x00ff00ff) | ((bits & 0x00ff00ff) << 8);
+	bits = (bits >> 16) | (bits << 16);
+	return bits >> (32 - SCAN_BITS);
+}
+
+// the extendible table scan position after the run of the bucket 'depth' bits
+// deep at position 'pos'
+static inline int64 scan_next(int64 pos, int depth) {
+	return (pos | ((1LL << (SCAN_BITS - depth)) - 1)) + 1;
+}
+
+// scans of extendible tables start loading the directory entry for the bucket
+// this many buckets ahead of the one they are at, so that they can be waiting
+// on several entries at once rather than one after another (see prefetch.h).
+// where entries point to buckets, the bucket is loaded half as far ahead
+// (and, in xuckoon tables, its keys half as far again)
+#define SCAN_AHEAD 8
+
+// the extendible table scan position 'nbuckets' buckets after position 'pos',
+// assuming the buckets up to there are 'depth' bits deep, like the one at
+// 'pos' (most of them will be: the buckets of a table are mostly within a
+// bit or so of the same depth)
+static inline int64 scan_ahead(int64 pos, int depth, int nbuckets) {
+	return pos + ((int64)nbuckets << (SCAN_BITS - depth));
+}
+
+// the range split between cursors[i - 1] and cursors[i] may fall in the
+// middle of the run of a bucket 'depth' bits deep (in an extendible table):
+// if so, move it up to the end of the run, so that only one range has the
+// bucket. runs are nested, so the splits stay in order
+static inline void scan_align_split(ScanCursor *cursors, int i, int depth) {
+	int64 run = 1LL << (SCAN_BITS - depth);
+	cursors[i].pos = (cursors[i].pos + run - 1) & ~(run - 1);
+	cursors[i - 1].end = cursors[i].pos;
+}
+
+// the last chunk stopped partway through the keys at the cursor's position:
+// if there are now 'nkeys' keys there, in a bucket 'depth' deep, can it carry
+// on where it stopped? (if not, those keys have been moved around since, and
+// the scan has to start over from the first of them)
+static inline bool scan_can_resume(ScanCursor *cursor, int nkeys, int depth) {
+	return cursor->nkeys == nkeys && cursor->depth == depth;
+}
+
+#endif
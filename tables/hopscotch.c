@@ -0,0 +1,531 @@
+/* * * * * * * * *
+ * Dynamic hash table using hopscotch hashing: every key is kept within a
+ * small neighbourhood of cells after its home cell, moving other keys along
+ * to make room if it has to (or, if the neighbourhood is crowded out by keys
+ * with nearby home cells, in a stash beside the cells)
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "hopscotch.h"
+#include "prefetch.h"
+#include "cacheline.h"
+#include "stash.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 1
+
+// how many cells (starting with its home cell) a key may be stored in. each
+// cell's 'hop' bitmap has one bit for each of them
+#define NEIGHBOURHOOD 32
+
+// how far past its home cell to look for a free cell for a new key, before
+// giving up and growing the table instead
+#define ADD_RANGE 256
+
+// reserving room for n keys gives the table n + n / RESERVE_SPARE home cells
+#define RESERVE_SPARE 3
+
+// a key which doesn't fit in its neighbourhood while the table is less than
+// this percent full is stashed rather than growing the table: there's plenty
+// of room, just not near its home cell, and when many keys share that home
+// cell (or nearby ones) no table size would ever give them enough room
+#define STASH_BELOW_LOAD 50
+
+// helper structure to store statistics gathered
+typedef struct stats {
+	int nkeys;		// how many keys are being stored in the table
+	int ndisplaced;	// how many times a key has been moved to make room
+	int time;		// how much CPU time has been used to insert/lookup keys
+					// in this table
+} Stats;
+
+// a cell holds one key, and also records (as a bitmap) which of the cells in
+// its neighbourhood hold keys which have it as their home cell
+typedef struct cell {
+	int64 key;			// the key stored here, if any
+	int64 value;		// the value stored with that key
+	unsigned int hop;	// bit i is set if cell (this + i) holds a key from here
+	bool full;			// is there a key stored here?
+	bool stashed;		// have any keys from here been stashed?
+} Cell;
+
+// a hopscotch table is an array of cells. there are NEIGHBOURHOOD - 1 extra
+// cells after the last home cell, so that neighbourhoods never wrap around
+struct hopscotch_table {
+	Cell *cells;	// the cells, 'size' + NEIGHBOURHOOD - 1 of them
+	int size;		// how many home cells there are
+	Stash stash;	// keys which didn't fit in their neighbourhood
+	Stats stats;
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// set up the cells of 'table' for 'size' home cells, all empty
+static void initialise_table(HopscotchHashTable *table, int size) {
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+	table->cells = calloc(size + NEIGHBOURHOOD - 1, sizeof *table->cells);
+	assert(table->cells);
+	table->size = size;
+}
+
+
+// move a key into the free cell 'free' from an earlier cell, as long as that
+// keeps it within its neighbourhood. returns the cell it moved from (which is
+// now free), or -1 if none of the keys before 'free' can move
+static int hop_back(HopscotchHashTable *table, int free) {
+	Cell *cells = table->cells;
+	int home;
+	for (home = free - (NEIGHBOURHOOD - 1); home < free; home++) {
+		// only keys stored before 'free' bring the free cell closer
+		unsigned int hop = cells[home].hop & ((1u << (free - home)) - 1);
+		if (hop) {
+			int from = home + __builtin_ctz(hop);
+			cells[free].key = cells[from].key;
+			cells[free].value = cells[from].value;
+			cells[free].full = true;
+			cells[from].full = false;
+			cells[home].hop ^= (1u << (from - home)) | (1u << (free - home));
+			table->stats.ndisplaced++;
+			return from;
+		}
+	}
+	return -1;
+}
+
+
+// put 'key' (which must not already be in 'table') and its value into a cell
+// within its neighbourhood. returns false if there was no room for it
+static bool place_key(HopscotchHashTable *table, int64 key, int64 value) {
+	Cell *cells = table->cells;
+	int ncells = table->size + NEIGHBOURHOOD - 1;
+	int home = h1(key) % table->size;
+
+	// find the first free cell from the home cell on
+	int free = home;
+	while (free < ncells && free - home < ADD_RANGE && cells[free].full) {
+		free++;
+	}
+	if (free == ncells || free - home == ADD_RANGE) {
+		return false;
+	}
+
+	// and if it's out of the neighbourhood, hop it back until it isn't
+	while (free - home >= NEIGHBOURHOOD) {
+		free = hop_back(table, free);
+		if (free < 0) {
+			return false;
+		}
+	}
+
+	cells[free].key = key;
+	cells[free].value = value;
+	cells[free].full = true;
+	cells[home].hop |= 1u << (free - home);
+	return true;
+}
+
+
+// is 'table' full enough for growing it to be the way to make room for a key
+// which doesn't fit in its neighbourhood? (see STASH_BELOW_LOAD)
+static bool worth_growing(HopscotchHashTable *table) {
+	return table->stats.nkeys * 100LL >= (int64)table->size * STASH_BELOW_LOAD;
+}
+
+
+// put 'key' (which must not already be in 'table') and its value into the
+// stash, marking its home cell so that lookups know to look there
+static void stash_key(HopscotchHashTable *table, int64 key, int64 value) {
+	table->cells[h1(key) % table->size].stashed = true;
+	stash_add(&table->stash, key, value);
+}
+
+
+// put 'key' (which must not already be in 'table') and its value into a cell
+// within its neighbourhood, or into the stash if there's no room for it
+static void place_or_stash(HopscotchHashTable *table, int64 key,
+	int64 value) {
+	if (!place_key(table, key, value)) {
+		stash_key(table, key, value);
+	}
+}
+
+
+// re-hash all keys, including any stashed keys, into 'size' new home cells.
+// keys which still don't fit are stashed
+static void rebuild_table(HopscotchHashTable *table, int size) {
+	Cell *oldcells = table->cells;
+	int oldncells = table->size + NEIGHBOURHOOD - 1;
+	Stash oldstash = table->stash;
+
+	initialise_table(table, size);
+	init_stash(&table->stash);
+	int i;
+	for (i = 0; i < oldncells; i++) {
+		if (oldcells[i].full) {
+			place_or_stash(table, oldcells[i].key, oldcells[i].value);
+		}
+	}
+	for (i = 0; i < oldstash.nkeys; i++) {
+		place_or_stash(table, oldstash.keys[i], oldstash.values[i]);
+	}
+
+	free(oldcells);
+	free_stash(&oldstash);
+}
+
+
+// where is the value of 'key' stored in 'table'? returns NULL if it's not
+// there. only the cells marked in its home cell's bitmap can hold it, so this
+// reads at most the NEIGHBOURHOOD cells after the home cell, and then the
+// stash, but only if keys from the same home cell have been stashed
+static int64 *find_value(HopscotchHashTable *table, int64 key) {
+	int home = h1(key) % table->size;
+	unsigned int hop = table->cells[home].hop;
+	while (hop) {
+		Cell *cell = &table->cells[home + __builtin_ctz(hop)];
+		if (cell->key == key) {
+			return &cell->value;
+		}
+		hop &= hop - 1;
+	}
+	if (table->cells[home].stashed) {
+		return stash_value(&table->stash, key);
+	}
+	return NULL;
+}
+
+
+// start loading the home cell of 'key' (whose bitmap says where to look) and
+// the cells just after it, where its neighbourhood's keys usually are
+static void prefetch_key(HopscotchHashTable *table, int64 key, int stage) {
+	Cell *home = &table->cells[h1(key) % table->size];
+	prefetch(home);
+	prefetch((char *)home + 64);
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in hopscotch_hash_table_upsert(), but untimed)
+static bool upsert_key(HopscotchHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	int64 *stored = find_value(table, key);
+	if (stored) {
+		*stored = merge(*stored, value);
+		return false;
+	}
+
+	// no room in the neighbourhood? make some more space and try again, as
+	// long as the table is full enough for that to help (growing it halves
+	// how full it is, so it only ever grows once per key)
+	while (!place_key(table, key, value)) {
+		if (!worth_growing(table)) {
+			stash_key(table, key, value);
+			break;
+		}
+		rebuild_table(table, table->size * 2);
+	}
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in hopscotch_hash_table_get(), but untimed)
+static bool get_key(HopscotchHashTable *table, int64 key,
+	int64 *value) {
+	int64 *stored = find_value(table, key);
+	if (stored && value) {
+		*value = *stored;
+	}
+	return stored != NULL;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a hopscotch hash table with initial size 'size'
+HopscotchHashTable *new_hopscotch_hash_table(int size) {
+	assert(size > 0);
+	HopscotchHashTable *table = cache_line_alloc(sizeof *table);
+	assert(table);
+
+	initialise_table(table, size);
+	init_stash(&table->stash);
+	table->stats.nkeys = 0;
+	table->stats.ndisplaced = 0;
+	table->stats.time = 0;
+	return table;
+}
+
+
+// free all memory associated with 'table'
+void free_hopscotch_hash_table(HopscotchHashTable *table) {
+	assert(table != NULL);
+	free(table->cells);
+	free_stash(&table->stash);
+	cache_line_free(table);
+}
+
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting that many
+// keys won't need to resize it. neighbourhoods rarely fill up while the table
+// is under three quarters full
+void hopscotch_hash_table_reserve(HopscotchHashTable *table, int nkeys) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int size = nkeys + nkeys / RESERVE_SPARE;
+	if (table->size < size) {
+		rebuild_table(table, size);
+	}
+	table->stats.time += clock() - start_time;
+}
+
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool hopscotch_hash_table_insert(HopscotchHashTable *table, int64 key) {
+	return hopscotch_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool hopscotch_hash_table_upsert(HopscotchHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool inserted = upsert_key(table, key, value, merge);
+	table->stats.time += clock() - start_time;
+	return inserted;
+}
+
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool hopscotch_hash_table_lookup(HopscotchHashTable *table, int64 key) {
+	return hopscotch_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool hopscotch_hash_table_get(HopscotchHashTable *table, int64 key,
+	int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void hopscotch_hash_table_lookup_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	hopscotch_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void hopscotch_hash_table_probe_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
+		}
+	}
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int hopscotch_hash_table_insert_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
+	}
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int hopscotch_hash_table_scan(HopscotchHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int n = hopscotch_hash_table_probe_scan(table, cursor, keys, values, max);
+
+	table->stats.time += clock() - start_time;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void hopscotch_hash_table_scan_ranges(HopscotchHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+
+	// cells (including the extra ones past the last home cell) are split up
+	// evenly, and the cursors told the table's size. the last range takes
+	// the stash too
+	int ncells = table->size + NEIGHBOURHOOD - 1;
+	scan_split(cursors, n, ncells);
+	int i;
+	for (i = 0; i < n; i++) {
+		cursors[i].size = table->size;
+	}
+	scan_skip_empty(cursors, n, ncells + table->stash.nkeys);
+
+	table->stats.time += clock() - start_time;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int hopscotch_hash_table_probe_scan(HopscotchHashTable *table,
+	ScanCursor *cursor, int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+
+	// growing the table moves every key, so if it has grown since the scan
+	// started, the scan has to start over
+	if (cursor->pos != SCAN_DONE && cursor->size != table->size) {
+		cursor->pos = 0;
+		cursor->size = table->size;
+	}
+
+	// keys can be in the extra cells past the last home cell, too, and then
+	// in the stash: stash key i is at scan position 'ncells' plus i
+	int ncells = table->size + NEIGHBOURHOOD - 1;
+	int n = 0;
+	if (cursor->pos != SCAN_DONE) {
+		int64 end = scan_end(cursor, ncells);
+		int64 i;
+		for (i = cursor->pos; i < end && n < max; i++) {
+			if (table->cells[i].full) {
+				keys[n] = table->cells[i].key;
+				if (values) {
+					values[n] = table->cells[i].value;
+				}
+				n++;
+			}
+		}
+		cursor->pos = i;
+
+		// a range ending before the stash is finished once it reaches its end
+		if (i >= end && end < ncells) {
+			cursor->pos = SCAN_DONE;
+		}
+	}
+
+	return scan_stash(&table->stash, ncells, cursor, keys, values, n, max);
+}
+
+
+// how many keys are in 'table'
+int hopscotch_hash_table_nkeys(HopscotchHashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
+}
+
+
+// print the contents of 'table' to stdout
+void hopscotch_hash_table_print(HopscotchHashTable *table) {
+	assert(table != NULL);
+
+	printf("--- table size: %d\n", table->size);
+
+	// print header
+	printf("   address | key\n");
+
+	// print the rows of the hash table (including the extra cells at the end)
+	int i;
+	for (i = 0; i < table->size + NEIGHBOURHOOD - 1; i++) {
+
+		// print the address
+		printf(" %9d | ", i);
+
+		// print the contents of the cell
+		if (table->cells[i].full) {
+			printf("%llu\n", table->cells[i].key);
+		} else {
+			printf("-\n");
+		}
+	}
+
+	// and any keys which had to be stashed
+	for (i = 0; i < table->stash.nkeys; i++) {
+		printf("stash [%llu]\n", table->stash.keys[i]);
+	}
+	printf("--- end table ---\n");
+}
+
+
+// print some statistics about 'table' to stdout
+void hopscotch_hash_table_stats(HopscotchHashTable *table) {
+	assert(table != NULL);
+	printf("--- table stats ---\n");
+
+	// print some information about the table
+	printf("current size: %d slots\n", table->size);
+	printf("current load: %d items\n", table->stats.nkeys);
+	printf(" load factor: %.3f%%\n", table->stats.nkeys * 100.0 / table->size);
+	printf("neighbourhood: %d slots\n", NEIGHBOURHOOD);
+	printf("  keys moved: %d\n", table->stats.ndisplaced);
+	printf("keys stashed: %d\n", table->stash.nkeys);
+
+	// also calculate CPU usage in seconds and print this
+	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
+	printf("    CPU time spent: %.6f sec\n", seconds);
+
+	printf("--- end stats ---\n");
+}
@@ -0,0 +1,90 @@
+/* * * * * * * * *
+ * Dynamic hash table using hopscotch hashing: every key is kept within a
+ * small neighbourhood of cells after its home cell, moving other keys along
+ * to make room if it has to
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef HOPSCOTCH_H
+#define HOPSCOTCH_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
+
+typedef struct hopscotch_table HopscotchHashTable;
+
+// initialise a hopscotch hash table with initial size 'size'
+HopscotchHashTable *new_hopscotch_hash_table(int size);
+
+// free all memory associated with 'table'
+void free_hopscotch_hash_table(HopscotchHashTable *table);
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void hopscotch_hash_table_reserve(HopscotchHashTable *table, int nkeys);
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool hopscotch_hash_table_insert(HopscotchHashTable *table, int64 key);
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool hopscotch_hash_table_lookup(HopscotchHashTable *table, int64 key);
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool hopscotch_hash_table_upsert(HopscotchHashTable *table, int64 key,
+	int64 value, MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool hopscotch_hash_table_get(HopscotchHashTable *table, int64 key,
+	int64 *value);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void hopscotch_hash_table_lookup_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// hopscotch_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void hopscotch_hash_table_probe_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int hopscotch_hash_table_insert_batch(HopscotchHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int hopscotch_hash_table_scan(HopscotchHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void hopscotch_hash_table_scan_ranges(HopscotchHashTable *table,
+	ScanCursor *cursors, int n);
+
+// hopscotch_hash_table_scan(), untimed (see hash_table_probe_scan())
+int hopscotch_hash_table_probe_scan(HopscotchHashTable *table,
+	ScanCursor *cursor, int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int hopscotch_hash_table_nkeys(HopscotchHashTable *table);
+
+// print the contents of 'table' to stdout
+void hopscotch_hash_table_print(HopscotchHashTable *table);
+
+// print some statistics about 'table' to stdout
+void hopscotch_hash_table_stats(HopscotchHashTable *table);
+
+#endif
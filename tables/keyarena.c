@@ -0,0 +1,174 @@
+/* * * * * * * * *
+ * Append-only storage for variable-length (byte string) keys: each key's
+ * bytes are copied in once, and from then on it is referred to by its offset
+ * into the arena
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "keyarena.h"
+
+// the arena starts out with room for this many bytes, and doubles as needed
+#define INITIAL_ARENA_SIZE 4096
+
+// every key is stored as one of these, followed by its bytes. entries are
+// padded out to a multiple of the entry alignment, so that the next one
+// starts aligned too
+typedef struct entry {
+	int64 next;		// offset of the next key in this key's chain, or NO_KEY
+	int64 value;	// the value stored with this key
+	int len;		// how many bytes long the key is
+} Entry;
+
+#define ENTRY_ALIGN (sizeof (int64))
+
+struct key_arena {
+	char *bytes;		// the entries
+	int64 size;			// how many bytes are in use
+	int64 capacity;		// how many bytes there is room for
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// the entry at offset 'offset' in 'arena'
+static Entry *entry_at(KeyArena *arena, int64 offset) {
+	assert(offset < arena->size);
+	return (Entry *)(arena->bytes + offset);
+}
+
+// how many bytes the entry for a key 'len' bytes long takes up
+static int64 entry_size(int len) {
+	int64 size = sizeof (Entry) + len;
+	return (size + ENTRY_ALIGN - 1) / ENTRY_ALIGN * ENTRY_ALIGN;
+}
+
+// mix one more 8-byte word into the hash value 'hash'
+static int64 mix_word(int64 hash, int64 word) {
+	hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+	return hash ^ (hash >> 32);
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise an empty key arena
+KeyArena *new_key_arena() {
+	KeyArena *arena = malloc(sizeof *arena);
+	assert(arena);
+	arena->capacity = INITIAL_ARENA_SIZE;
+	arena->bytes = malloc(arena->capacity);
+	assert(arena->bytes);
+	arena->size = 0;
+	return arena;
+}
+
+
+// free all memory associated with 'arena'
+void free_key_arena(KeyArena *arena) {
+	assert(arena != NULL);
+	free(arena->bytes);
+	free(arena);
+}
+
+
+// full 64-bit hash value of the 'len' bytes at 'key'. the key is read 8
+// bytes at a time, which is only a handful of steps for typical keys
+int64 key_hash(const char *key, int len) {
+	assert(len >= 0);
+	int64 hash = 0x9e3779b97f4a7c15ULL ^ (int64)len;
+	int64 word;
+	while (len >= 8) {
+		memcpy(&word, key, 8);
+		hash = mix_word(hash, word);
+		key += 8;
+		len -= 8;
+	}
+	if (len > 0) {
+		word = 0;
+		memcpy(&word, key, len);
+		hash = mix_word(hash, word);
+	}
+
+	// finish by spreading the high bits back down into the low ones
+	hash ^= hash >> 29;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	return hash ^ (hash >> 32);
+}
+
+
+// copy the 'len' bytes at 'key' into 'arena', along with 'value' and the
+// offset 'next' of the next key in its chain (or NO_KEY)
+// returns the offset of the new key
+int64 key_arena_add(KeyArena *arena, const char *key, int len, int64 value,
+	int64 next) {
+	assert(arena != NULL);
+	assert(len >= 0);
+
+	int64 need = entry_size(len);
+	while (arena->size + need > arena->capacity) {
+		arena->capacity *= 2;
+		arena->bytes = realloc(arena->bytes, arena->capacity);
+		assert(arena->bytes);
+	}
+
+	int64 offset = arena->size;
+	arena->size += need;
+	Entry *entry = entry_at(arena, offset);
+	entry->next = next;
+	entry->value = value;
+	entry->len = len;
+	memcpy(entry + 1, key, len);
+	return offset;
+}
+
+
+// are the 'len' bytes at 'key' the same as the key at offset 'offset'?
+bool key_arena_equals(KeyArena *arena, int64 offset, const char *key,
+	int len) {
+	Entry *entry = entry_at(arena, offset);
+	return entry->len == len && memcmp(entry + 1, key, len) == 0;
+}
+
+
+// the offset of the next key in the chain of the key at offset 'offset'
+int64 key_arena_next(KeyArena *arena, int64 offset) {
+	return entry_at(arena, offset)->next;
+}
+
+
+// where the value of the key at offset 'offset' is stored
+int64 *key_arena_value(KeyArena *arena, int64 offset) {
+	return &entry_at(arena, offset)->value;
+}
+
+
+// the bytes of the key at offset 'offset', storing its length in '*len'
+const char *key_arena_key(KeyArena *arena, int64 offset, int *len) {
+	Entry *entry = entry_at(arena, offset);
+	*len = entry->len;
+	return (const char *)(entry + 1);
+}
+
+
+// the offset of the key stored straight after the key at offset 'offset', or
+// key_arena_size() if it's the last one
+int64 key_arena_after(KeyArena *arena, int64 offset) {
+	return offset + entry_size(entry_at(arena, offset)->len);
+}
+
+
+// how many bytes of 'arena' are in use
+int64 key_arena_size(KeyArena *arena) {
+	assert(arena != NULL);
+	return arena->size;
+}
@@ -0,0 +1,56 @@
+/* * * * * * * * *
+ * Append-only storage for variable-length (byte string) keys: each key's
+ * bytes are copied in once, and from then on it is referred to by its offset
+ * into the arena
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef KEYARENA_H
+#define KEYARENA_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+// marks the end of a chain of keys in the arena
+#define NO_KEY ((int64)-1)
+
+typedef struct key_arena KeyArena;
+
+// initialise an empty key arena
+KeyArena *new_key_arena();
+
+// free all memory associated with 'arena'
+void free_key_arena(KeyArena *arena);
+
+// full 64-bit hash value of the 'len' bytes at 'key'
+int64 key_hash(const char *key, int len);
+
+// copy the 'len' bytes at 'key' into 'arena', along with 'value' and the
+// offset 'next' of the next key in its chain (or NO_KEY)
+// returns the offset of the new key
+int64 key_arena_add(KeyArena *arena, const char *key, int len, int64 value,
+	int64 next);
+
+// are the 'len' bytes at 'key' the same as the key at offset 'offset'?
+bool key_arena_equals(KeyArena *arena, int64 offset, const char *key, int len);
+
+// the offset of the next key in the chain of the key at offset 'offset'
+int64 key_arena_next(KeyArena *arena, int64 offset);
+
+// where the value of the key at offset 'offset' is stored
+int64 *key_arena_value(KeyArena *arena, int64 offset);
+
+// the bytes of the key at offset 'offset', storing its length in '*len'
+const char *key_arena_key(KeyArena *arena, int64 offset, int *len);
+
+// the offset of the key stored straight after the key at offset 'offset' (so
+// that every key can be visited in the order they were added), or
+// key_arena_size() if it's the last one
+int64 key_arena_after(KeyArena *arena, int64 offset);
+
+// how many bytes of 'arena' are in use
+int64 key_arena_size(KeyArena *arena);
+
+#endif
@@ -0,0 +1,86 @@
+/* * * * * * * * *
+ * Making space in the extendible cuckoo tables (xuckoo.c and xuckoon.c) when
+ * a chain of kicks gets too long: choosing which of the buckets along the
+ * chain to split, and setting the key aside in a stash (see stash.h) when no
+ * split could ever make room for it (when the keys fighting over every bucket
+ * along the chain have the same hash values, right up to DIR_MAX_DEPTH bits)
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef KICKS_H
+#define KICKS_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "../inthash.h"
+#include "xtnddir.h"
+#include "cursor.h"
+#include "stash.h"
+
+// how many keys can be kicked out of their buckets while inserting one key,
+// before we give up and split a bucket to make space instead
+#define MAX_KICKS 32
+
+// a bucket visited along a chain of kicks, remembered so that the cheapest of
+// them can be split if the chain gets too long
+typedef struct visit {
+	int table_no;	// which inner table the bucket is in
+	int hash;		// hash value (in that table) of the key put in the bucket
+	int evicted;	// and of the key kicked out of it to make room
+} Visit;
+
+// what splitting one of those buckets would involve
+typedef struct split_option {
+	int depth;		// how many hash value bits the bucket uses
+	int dir_bits;	// how many bits its table's directory uses there
+	unsigned int spread;	// the hash value bits in which the evicted key
+							// differs from the keys now in the bucket
+} SplitOption;
+
+// the hash value bits which splitting a bucket 'depth' bits deep (and then
+// splitting its halves, and so on, up to DIR_MAX_DEPTH bits) would look at
+static inline unsigned int split_bits(int depth) {
+	return ((1u << DIR_MAX_DEPTH) - 1) & ~((1u << depth) - 1);
+}
+
+// which of the 'n' buckets in 'options' is cheapest to split: preferably one
+// which can be split without growing its table's directory, and then the
+// one with the fewest bits (so the most addresses to share out). buckets
+// whose evicted key could never be told apart from their keys are passed
+// over, since splitting them would never make room
+// returns -1 if none of the buckets are worth splitting
+static inline int cheapest_split(const SplitOption *options, int n) {
+	int best = -1;
+	bool best_grows = true;
+	int i;
+	for (i = 0; i < n; i++) {
+		if ((options[i].spread & split_bits(options[i].depth)) == 0) {
+			continue;
+		}
+		bool grows = options[i].depth >= options[i].dir_bits;
+		if (best == -1 || (best_grows && !grows) || (best_grows == grows
+			&& options[i].depth < options[best].depth)) {
+			best = i;
+			best_grows = grows;
+		}
+	}
+	return best;
+}
+
+// the hash value of 'key' in inner table 'table_no' (1 or 2)
+static inline int hash_for(int64 key, int table_no) {
+	if (table_no == 1) {
+		return h1(key);
+	}
+	return h2(key);
+}
+
+// scans go through a table's stash after both of its inner tables (whose
+// scan positions run up to 2^(SCAN_BITS + 1)): stash key i is at this scan
+// position plus i
+#define STASH_SCAN_START (2LL << SCAN_BITS)
+
+#endif
@@ -12,6 +12,21 @@
 #include <time.h>
 
 #include "linear.h"
+#include "prefetch.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 1
+
+// probe blocks are compared with AVX2 or AVX-512 instructions when the CPU
+// has them (checked at run time), where the compiler can target them
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_SIMD_SCAN 1
+#else
+#define HAVE_SIMD_SCAN 0
+#endif
 
 // Define colours used for debugging purposes.
 /*
@@ -25,7 +40,18 @@
 */
 
 // how many cells to advance at a time while looking for a free slot
+// (probes check whole blocks of consecutive cells, so this has to stay 1)
 #define STEP_SIZE 1
+
+// how many consecutive cells are checked at once while probing. the slot and
+// inuse arrays have this many extra cells on the end, holding copies of the
+// cells at the start, so that a block can start anywhere without wrapping
+#define PROBE_BLOCK 8
+
+// checks the PROBE_BLOCK cells starting at 'slots' and 'inuse': returns a
+// bitmask of which hold 'key', and sets '*empty' to a bitmask of which are free
+typedef unsigned int (*BlockScan)(const int64 *slots, const bool *inuse,
+	int64 key, unsigned int *empty);
 // helper structure to store statistics gathered
 typedef struct stats {
 	float collisions;	// how many distinct buckets does the table point to
@@ -39,11 +65,15 @@ typedef struct stats {
 // of boolean markers recording which slots are in use (true) or free (false)
 // important because not-in-use slots might hold garbage data, as they may
 // not have been initialised
+// each key's value is kept in a third parallel array, so that the keys stay
+// packed together for checking whole blocks of them at once
 struct linear_table {
 	int64 *slots;	// array of slots holding keys
+	int64 *values;	// array of the values of those keys
 	bool  *inuse;	// is this slot in use or not?
 	int size;		// the size of both of these arrays right now
 	int load;		// number of keys in the table right now
+	BlockScan scan;	// how to check a block of cells on this CPU
 	Stats stats;
 };
 
@@ -58,12 +88,14 @@ struct linear_table {
 static void initialise_table(LinearHashTable *table, int size) {
 	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
 
-	table->slots = malloc((sizeof *table->slots) * size);
+	table->slots = malloc((sizeof *table->slots) * (size + PROBE_BLOCK));
 	assert(table->slots);
-	table->inuse = malloc((sizeof *table->inuse) * size);
+	table->values = malloc((sizeof *table->values) * size);
+	assert(table->values);
+	table->inuse = malloc((sizeof *table->inuse) * (size + PROBE_BLOCK));
 	assert(table->inuse);
 	int i;
-	for (i = 0; i < size; i++) {
+	for (i = 0; i < size + PROBE_BLOCK; i++) {
 		table->inuse[i] = false;
 	}
 	table->size = size;
@@ -71,38 +103,289 @@ static void initialise_table(LinearHashTable *table, int size) {
 }
 
 
-// double the size of the internal table arrays and re-hash all
+// put 'key' in the cell at 'address', and in the copies of that cell past
+// the end of the table
+static void fill_cell(LinearHashTable *table, int address, int64 key) {
+	int i;
+	for (i = address; i < table->size + PROBE_BLOCK; i += table->size) {
+		table->slots[i] = key;
+		table->inuse[i] = true;
+	}
+}
+
+
+// check a block of cells one cell at a time
+static unsigned int scan_block(const int64 *slots, const bool *inuse,
+	int64 key, unsigned int *empty) {
+	unsigned int match = 0, free = 0;
+	int i;
+	for (i = 0; i < PROBE_BLOCK; i++) {
+		match |= (inuse[i] && slots[i] == key) << i;
+		free |= !inuse[i] << i;
+	}
+	*empty = free;
+	return match;
+}
+
+#if HAVE_SIMD_SCAN
+
+// which of the PROBE_BLOCK inuse flags at 'inuse' are false, as a bitmask
+static inline unsigned int free_cells(const bool *inuse) {
+	__m128i flags = _mm_loadl_epi64((const __m128i *)inuse);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(flags, _mm_setzero_si128())) & 0xff;
+}
+
+// check a block of cells 4 slots at a time
+__attribute__((target("avx2")))
+static unsigned int scan_block_avx2(const int64 *slots, const bool *inuse,
+	int64 key, unsigned int *empty) {
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)slots), k);
+	__m256i hi = _mm256_cmpeq_epi64(
+		_mm256_loadu_si256((const __m256i *)(slots + 4)), k);
+	unsigned int match = _mm256_movemask_pd(_mm256_castsi256_pd(lo))
+		| _mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4;
+	*empty = free_cells(inuse);
+	// a free cell might hold an old copy of the key: it doesn't count
+	return match & ~*empty;
+}
+
+// check a block of cells all 8 slots at once
+__attribute__((target("avx512f")))
+static unsigned int scan_block_avx512(const int64 *slots, const bool *inuse,
+	int64 key, unsigned int *empty) {
+	unsigned int match = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(slots),
+		_mm512_set1_epi64(key));
+	*empty = free_cells(inuse);
+	return match & ~*empty;
+}
+
+#endif
+
+// the best way to check a block of cells on this CPU
+static BlockScan choose_scan() {
+#if HAVE_SIMD_SCAN
+	if (__builtin_cpu_supports("avx512f")) {
+		return scan_block_avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return scan_block_avx2;
+	}
+#endif
+	return scan_block;
+}
+
+
+// step along the table from the home cell of 'key' (a block at a time),
+// looking for it. returns true if it's found, setting '*steps' to how far past
+// the home cell it is. otherwise, sets '*steps' to how far past the home cell
+// the first free cell is (or to the size of the table, if there are no free
+// cells)
+static bool probe(LinearHashTable *table, int64 key, int *steps) {
+	int h = h1(key) % table->size;
+	int distance;
+	for (distance = 0; distance < table->size; distance += PROBE_BLOCK) {
+		unsigned int empty;
+		unsigned int match = table->scan(table->slots + h, table->inuse + h,
+			key, &empty);
+
+		// only cells before the first free cell are part of this key's probe
+		if (empty) {
+			match &= (empty & -empty) - 1;
+		}
+		if (match) {
+			*steps = distance + __builtin_ctz(match);
+			return true;
+		}
+		if (empty) {
+			*steps = distance + __builtin_ctz(empty);
+			return false;
+		}
+
+		// no need to wrap around before the end of the copied cells
+		h += PROBE_BLOCK;
+		if (h >= table->size) {
+			h %= table->size;
+		}
+	}
+	*steps = table->size;
+	return false;
+}
+
+
+// change the size of the internal table arrays to 'size' and re-hash all
 // keys in the old tables
-static void double_table(LinearHashTable *table) {
+static void resize_table(LinearHashTable *table, int size) {
 	int64 *oldslots = table->slots;
+	int64 *oldvalues = table->values;
 	bool  *oldinuse = table->inuse;
 	int oldsize = table->size;
 
-	initialise_table(table, table->size * 2);
+	initialise_table(table, size);
 
 	int i;
 	for (i = 0; i < oldsize; i++) {
 		if (oldinuse[i] == true) {
-			linear_hash_table_insert(table, oldslots[i]);
+			linear_hash_table_upsert(table, oldslots[i], oldvalues[i],
+				merge_keep);
 		}
 	}
 
 	free(oldslots);
+	free(oldvalues);
 	free(oldinuse);
 }
 
 
+// shrink the table to 'size' cells, re-hashing its keys without allocating
+// any new arrays. this works as long as the keys can all be moved out of the
+// way of the smaller table first, to the end of the arrays: i.e. as long as
+// size + PROBE_BLOCK + (the number of keys) <= the current size
+static void shrink_in_place(LinearHashTable *table, int size) {
+	int oldsize = table->size;
+	int nkeys = table->load;
+	assert(size + PROBE_BLOCK + nkeys <= oldsize);
+
+	// pack the keys (and values) into the last 'nkeys' cells. working
+	// backwards, a key never overwrites one that hasn't been moved yet
+	int to = oldsize - 1;
+	int from;
+	for (from = oldsize - 1; from >= 0; from--) {
+		if (table->inuse[from]) {
+			table->slots[to] = table->slots[from];
+			table->values[to] = table->values[from];
+			to--;
+		}
+	}
+
+	// then free up the cells of the smaller table and put the keys back
+	int i;
+	for (i = 0; i < size + PROBE_BLOCK; i++) {
+		table->inuse[i] = false;
+	}
+	table->size = size;
+	table->load = 0;
+	for (from = oldsize - nkeys; from < oldsize; from++) {
+		int64 key = table->slots[from];
+		int steps;
+		probe(table, key, &steps);
+		int cell = (h1(key) % size + steps) % size;
+		table->values[cell] = table->values[from];
+		fill_cell(table, cell, key);
+		table->load++;
+	}
+
+	// and finally hand back the memory past the end of the smaller table
+	table->slots = realloc(table->slots,
+		(sizeof *table->slots) * (size + PROBE_BLOCK));
+	assert(table->slots);
+	table->values = realloc(table->values, (sizeof *table->values) * size);
+	assert(table->values);
+	table->inuse = realloc(table->inuse,
+		(sizeof *table->inuse) * (size + PROBE_BLOCK));
+	assert(table->inuse);
+}
+
+
+// start loading the slot that looking up 'key' starts at (all at once: the
+// slot comes straight from the hash value, so one stage is enough)
+static void prefetch_key(LinearHashTable *table, int64 key, int stage) {
+	int h = h1(key) % table->size;
+	prefetch(&table->slots[h]);
+	prefetch(&table->inuse[h]);
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in linear_hash_table_upsert(), but untimed)
+static bool upsert_key(LinearHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	// need to count our steps to make sure we recognise when the table is full
+	int steps;
+	int h = h1(key) % table->size;
+
+	// step along the array until we find a free space (inuse[]==false),
+	// or until we visit every cell
+	if (probe(table, key, &steps)) {
+		// this key already exists in the table! just update its value
+		h = (h + steps) % table->size;
+		table->values[h] = merge(table->values[h], value);
+		return false;
+	}
+
+	// if we used up all of our steps, then we're back where we started and the
+	// table is full
+	if (steps == table->size) {
+		// let's make some more space and then try to insert this key again!
+		resize_table(table, table->size * 2);
+		return upsert_key(table, key, value, merge);
+
+	} else {
+		// otherwise, we have found a free slot! insert this key right here
+		// If function did a probe, then add the steps taken in the probe to
+		// the total number of steps in the probe.
+		// Also increment collisions.
+		if (steps > 0) {
+			table->stats.total_probes += steps;
+			table->stats.collisions++;
+		}
+		h = (h + steps) % table->size;
+		fill_cell(table, h, key);
+		table->values[h] = value;
+		table->load++;
+		table->stats.nkeys++;
+		return true;
+	}
+}
+
+// compare two keys, for sorting them with qsort()
+static int compare_keys(const void *a, const void *b) {
+	int64 x = *(const int64 *)a;
+	int64 y = *(const int64 *)b;
+	return (x > y) - (x < y);
+}
+
+// put 'key' (which must not already be in 'table') in 'cell', which must be
+// free, and every cell from 'home' up to it must be full
+static void place_key(LinearHashTable *table, int cell, int home, int64 key) {
+	int steps = cell - home;
+	if (steps > 0) {
+		table->stats.total_probes += steps;
+		table->stats.collisions++;
+	}
+	fill_cell(table, cell, key);
+	table->values[cell] = 0;
+	table->load++;
+	table->stats.nkeys++;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in linear_hash_table_get(), but untimed)
+static bool get_key(LinearHashTable *table, int64 key, int64 *value) {
+	// step along until we find the key, a free space (inuse[]==false), or
+	// until we visit every cell
+	int steps;
+	bool found = probe(table, key, &steps);
+	if (found && value) {
+		*value = table->values[(h1(key) % table->size + steps) % table->size];
+	}
+	// if we didn't find it, we have either searched the whole table or come
+	// back to where we started: either way, the key is not in the hash table
+	return found;
+}
+
+
 /* * * *
  * all functions
  */
 
 // initialise a linear probing hash table with initial size 'size'
 LinearHashTable *new_linear_hash_table(int size) {
-	LinearHashTable *table = malloc(sizeof *table);
+	LinearHashTable *table = cache_line_alloc(sizeof *table);
 	assert(table);
 
 	// set up the internals of the table struct with arrays of size 'size'
 	initialise_table(table, size);
+	table->scan = choose_scan();
 	table->stats.nkeys = 0;
 	table->stats.time = 0;
 	table->stats.collisions = 0;
@@ -111,100 +394,287 @@ LinearHashTable *new_linear_hash_table(int size) {
 }
 
 
+// build a linear probing hash table holding the 'n' keys in 'keys', with
+// initial size 'size' or twice as many cells as keys, whichever is bigger.
+// if 'unique' is true, the keys must all be different and aren't checked
+// returns the new table
+LinearHashTable *build_linear_hash_table(int size, const int64 *keys, int n,
+	bool unique) {
+	assert(n >= 0);
+	int start_time = clock(); // start timing
+	int room = n < MAX_TABLE_SIZE / 2 ? n * 2 : MAX_TABLE_SIZE - 1;
+	LinearHashTable *table = new_linear_hash_table(size > room ? size : room);
+	size = table->size;
+
+	// counting sort the keys by home cell. afterwards, the keys for home cell
+	// h end just before sorted[end[h]] (and start at end[h - 1], or 0)
+	int *end = calloc(size, sizeof *end);
+	assert(end);
+	int64 *sorted = malloc(sizeof *sorted * (n > 0 ? n : 1));
+	assert(sorted);
+	int i, home;
+	for (i = 0; i < n; i++) {
+		end[h1(keys[i]) % size]++;
+	}
+	int total = 0;
+	for (home = 0; home < size; home++) {
+		total += end[home];
+		end[home] = total - end[home];
+	}
+	for (i = 0; i < n; i++) {
+		sorted[end[h1(keys[i]) % size]++] = keys[i];
+	}
+
+	// then fill the cells in order: each key goes in its home cell, or if
+	// that's taken, in the cell after the last key placed (which is where
+	// probing would take it). repeated keys are next to each other once each
+	// home cell's keys are sorted
+	int next = 0;
+	i = 0;
+	for (home = 0; home < size && next < size; home++) {
+		int first = i;
+		if (!unique && end[home] - first > 1) {
+			qsort(sorted + first, end[home] - first, sizeof *sorted,
+				compare_keys);
+		}
+		for (; i < end[home] && next < size; i++) {
+			if (!unique && i > first && sorted[i] == sorted[i - 1]) {
+				continue;
+			}
+			int cell = next > home ? next : home;
+			place_key(table, cell, home, sorted[i]);
+			next = cell + 1;
+		}
+	}
+
+	// any keys left over ran off the end of the table: they wrap around to
+	// the free cells at the start, just as if they'd been inserted
+	for (; i < n; i++) {
+		upsert_key(table, sorted[i], 0, merge_keep);
+	}
+
+	free(end);
+	free(sorted);
+	table->stats.time += clock() - start_time;
+	return table;
+}
+
+
 // free all memory associated with 'table'
 void free_linear_hash_table(LinearHashTable *table) {
 	assert(table != NULL);
 
 	// free the table's arrays
 	free(table->slots);
+	free(table->values);
 	free(table->inuse);
 
 	// free the table struct itself
-	free(table);
+	cache_line_free(table);
+}
+
+
+// make room in 'table' for 'nkeys' keys in total, so that inserting that many
+// keys won't need to resize it. the table only grows once it's full, but it's
+// given twice the room so that probes stay short
+void linear_hash_table_reserve(LinearHashTable *table, int nkeys) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int size = nkeys < MAX_TABLE_SIZE / 2 ? nkeys * 2 : MAX_TABLE_SIZE - 1;
+	if (table->size < size) {
+		resize_table(table, size);
+	}
+	table->stats.time += clock() - start_time;
+}
+
+
+// shrink 'table' to twice as many cells as it has keys (the room reserving
+// them would give), if it's bigger than that. when the keys fit beside the
+// smaller table, the arrays are shrunk in place rather than reallocated
+void linear_hash_table_shrink_to_fit(LinearHashTable *table) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int size = table->load > 0 ? table->load * 2 : 1;
+	if (size + PROBE_BLOCK + table->load <= table->size) {
+		shrink_in_place(table, size);
+	} else if (size < table->size) {
+		resize_table(table, size);
+	}
+	table->stats.time += clock() - start_time;
 }
 
 
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool linear_hash_table_insert(LinearHashTable *table, int64 key) {
+	return linear_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool linear_hash_table_upsert(LinearHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
 	assert(table != NULL);
 	int start_time = clock(); // start timing
-	// need to count our steps to make sure we recognise when the table is full
-	int steps = 0;
+	bool inserted = upsert_key(table, key, value, merge);
+	table->stats.time += clock() - start_time;
+	return inserted;
+}
 
-	// calculate the initial address for this key
-	int h = h1(key) % table->size;
-	bool did_probe = false;
-	// step along the array until we find a free space (inuse[]==false),
-	// or until we visit every cell
-	while (table->inuse[h] && steps < table->size) {
-		if (table->slots[h] == key) {
-			// this key already exists in the table! no need to insert
-			table->stats.time += clock() - start_time;
-			return false;
+
+// lookup whether 'key' is inside 'table'
+// returns true if found, false if not
+bool linear_hash_table_lookup(LinearHashTable *table, int64 key) {
+	return linear_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool linear_hash_table_get(LinearHashTable *table, int64 key, int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
+
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void linear_hash_table_lookup_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	linear_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void linear_hash_table_probe_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
 		}
-		
-		// else, keep stepping through the table looking for a free slot
-		h = (h + STEP_SIZE) % table->size;
-		steps++;
-		// Did a probe, so set probe to true
-		did_probe = true;
 	}
-	// If function did a probe, then add the steps taken in the probe to the 
-	// total number of steps in the probe.
-	// Also increment collisions.
+}
 
-	// if we used up all of our steps, then we're back where we started and the
-	// table is full
-	if (steps == table->size) {
-		// let's make some more space and then try to insert this key again!
-		double_table(table);
-		return linear_hash_table_insert(table, key);
 
-	} else {
-		// otherwise, we have found a free slot! insert this key right here
-		if (did_probe){
-			table->stats.total_probes += steps;
-			table->stats.collisions++;
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int linear_hash_table_insert_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
 		}
-		table->slots[h] = key;
-		table->inuse[h] = true;
-		table->load++;
-		table->stats.nkeys++;
-		table->stats.time += clock() - start_time;
-		return true;
 	}
+	table->stats.time += clock() - start_time;
+	return ninserted;
 }
 
 
-// lookup whether 'key' is inside 'table'
-// returns true if found, false if not
-bool linear_hash_table_lookup(LinearHashTable *table, int64 key) {
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int linear_hash_table_scan(LinearHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
 	assert(table != NULL);
 	int start_time = clock(); // start timing
-	// need to count our steps to make sure we recognise when the table is full
-	int steps = 0;
 
-	// calculate the initial address for this key
-	int h = h1(key) % table->size;
+	int n = linear_hash_table_probe_scan(table, cursor, keys, values, max);
 
-	// step along until we find a free space (inuse[]==false), or until we
-	// visit every cell
-	while (table->inuse[h] && steps < table->size) {
+	table->stats.time += clock() - start_time;
+	return n;
+}
 
-		if (table->slots[h] == key) {
-			// found the key!
-			return true;
-		}
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void linear_hash_table_scan_ranges(LinearHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
 
-		// keep stepping
-		h = (h + STEP_SIZE) % table->size;
-		steps++;
+	// slots are split up evenly, and the cursors told the table's size
+	scan_split(cursors, n, table->size);
+	int i;
+	for (i = 0; i < n; i++) {
+		cursors[i].size = table->size;
 	}
+	scan_skip_empty(cursors, n, table->size);
+
 	table->stats.time += clock() - start_time;
-	// we have either searched the whole table or come back to where we started
-	// either way, the key is not in the hash table
-	return false;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int linear_hash_table_probe_scan(LinearHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+
+	// growing the table moves every key, so if it has grown since the scan
+	// started, the scan has to start over
+	if (cursor->pos != SCAN_DONE && cursor->size != table->size) {
+		cursor->pos = 0;
+		cursor->size = table->size;
+	}
+
+	int n = 0;
+	if (cursor->pos != SCAN_DONE) {
+		int end = scan_end(cursor, table->size);
+		int i;
+		for (i = cursor->pos; i < end && n < max; i++) {
+			if (table->inuse[i]) {
+				keys[n] = table->slots[i];
+				if (values) {
+					values[n] = table->values[i];
+				}
+				n++;
+			}
+		}
+		cursor->pos = i < end ? i : SCAN_DONE;
+	}
+
+	return n;
+}
+
+
+// how many keys are in 'table'
+int linear_hash_table_nkeys(LinearHashTable *table) {
+	assert(table != NULL);
+	// (not stats.nkeys, which counts keys again when resizing moves them)
+	return table->load;
 }
 
 
@@ -7,15 +7,31 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
 
 typedef struct linear_table LinearHashTable;
 
 // initialise a linear probing hash table with initial size 'size'
 LinearHashTable *new_linear_hash_table(int size);
 
+// build a linear probing hash table holding the 'n' keys in 'keys' (with
+// value 0), sized for them up front and filled in one pass. if 'unique' is
+// true, the keys must all be different, and aren't checked for repeats
+LinearHashTable *build_linear_hash_table(int size, const int64 *keys, int n,
+	bool unique);
+
 // free all memory associated with 'table'
 void free_linear_hash_table(LinearHashTable *table);
 
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void linear_hash_table_reserve(LinearHashTable *table, int nkeys);
+
+// shrink 'table' to fit the keys it holds now, giving back the memory it no
+// longer needs
+void linear_hash_table_shrink_to_fit(LinearHashTable *table);
+
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool linear_hash_table_insert(LinearHashTable *table, int64 key);
@@ -24,6 +40,51 @@ bool linear_hash_table_insert(LinearHashTable *table, int64 key);
 // returns true if found, false if not
 bool linear_hash_table_lookup(LinearHashTable *table, int64 key);
 
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool linear_hash_table_upsert(LinearHashTable *table, int64 key, int64 value,
+	MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool linear_hash_table_get(LinearHashTable *table, int64 key, int64 *value);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void linear_hash_table_lookup_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// linear_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void linear_hash_table_probe_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int linear_hash_table_insert_batch(LinearHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int linear_hash_table_scan(LinearHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void linear_hash_table_scan_ranges(LinearHashTable *table,
+	ScanCursor *cursors, int n);
+
+// linear_hash_table_scan(), untimed (see hash_table_probe_scan())
+int linear_hash_table_probe_scan(LinearHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int linear_hash_table_nkeys(LinearHashTable *table);
+
 // print the contents of 'table' to stdout
 void linear_hash_table_print(LinearHashTable *table);
 
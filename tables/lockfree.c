@@ -0,0 +1,508 @@
+/* * * * * * * * *
+ * Concurrent hash table using linear probing: any number of threads can insert
+ * keys and look keys up at the same time, without taking any locks. when the
+ * table gets too full, the threads inserting keys work together to move the
+ * keys into a bigger table
+ *
+ * each slot is a single 64-bit word. a thread claims an empty slot for a key
+ * with one compare-and-swap (CAS), so two threads can never claim the same
+ * slot, and a lookup just reads slots. there are no deletions, so once a slot
+ * holds a key it keeps it, until a resize moves the key on and replaces it
+ * with a forwarding marker
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ * Uses code retrieved from linear.c created by
+ * Matt Farrugia <matt.farrugia@unimelb.edu.au>
+ */
+
+// for sched_yield()
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "lockfree.h"
+#include "cacheline.h"
+
+// a slot holding this is empty (so new arrays can just be zeroed)
+#define EMPTY_KEY ((int64)0)
+
+// a slot holding this has been dealt with by a resize: whatever key it held
+// is now in the next array
+#define FORWARDED ((int64)-1)
+
+// the table is resized once more than this fraction of its slots are full
+// (this is the reciprocal, so 2 means half full)
+#define MAX_LOAD_INVERSE 2
+
+// resizing threads claim slots to move in chunks of this many slots
+#define CHUNK_SIZE 1024
+
+// key counts are split over this many counters (stripes), each on a cache
+// line of its own, and each thread only adds to one of them, so that threads
+// inserting keys at the same time don't all fight over a single counter. a
+// count is only added up when it's needed
+#define NSTRIPES 16
+
+// the stripes of an array are only added up to check its load factor after
+// every (array size / LOAD_CHECKS) keys counted on a stripe, so the load can
+// go past its limit by at most about NSTRIPES / LOAD_CHECKS of the array
+// before a resize starts (which is fine: probing only gets slow once the
+// array is nearly full, and a full array starts a resize anyway)
+#define LOAD_CHECKS 256
+
+// the atomic operations used: loads and stores which order the memory
+// accesses around them (so a thread which sees a new array or slot also sees
+// everything written before it), and an atomic add
+#define load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define store_release(ptr, value) __atomic_store_n((ptr), (value), \
+	__ATOMIC_RELEASE)
+#define fetch_add(ptr, n) __atomic_fetch_add((ptr), (n), __ATOMIC_ACQ_REL)
+
+// one stripe of a key count (see NSTRIPES), padded out to a cache line
+typedef union stripe {
+	int count;
+	char padding[CACHE_LINE];
+} Stripe;
+
+// helper structure to store statistics gathered (updated atomically)
+typedef struct stats {
+	Stripe nkeys[NSTRIPES];	// how many keys are being stored in the table
+	int nresizes;	// how many times the table has been resized
+	int nchunks;	// how many chunks of slots have been moved by resizes
+} Stats;
+
+// an array of slots. while an array is being resized, 'next' points to the
+// bigger array its keys are being moved into
+typedef struct array {
+	Stripe count[NSTRIPES];	// how many keys have been put in this array
+	int64 *slots;		// the slots: a key, EMPTY_KEY or FORWARDED
+	int size;			// how many slots there are
+	int check_every;	// how many keys to count on a stripe between load
+						// factor checks (see LOAD_CHECKS)
+	int nchunks;		// how many chunks the slots are split into
+	int next_chunk;		// the next chunk for a resizing thread to move
+	int chunks_done;	// how many chunks have been moved so far
+	struct array *next;		// the array being resized into, or NULL
+	struct array *older;	// the array this one replaced, or NULL
+} Array;
+
+// a lock-free table is the current array, plus whether each of the two key
+// values used as slot markers has been inserted (those are kept out of the
+// slots themselves)
+struct lockfree_table {
+	Array *array;		// the current array
+	int has_empty_key;	// has the key EMPTY_KEY been inserted?
+	int has_forwarded;	// has the key FORWARDED been inserted?
+	Stats stats;
+};
+
+// possible results of trying to insert a key into an array
+typedef enum outcome {
+	INSERTED, PRESENT, RETRY
+} Outcome;
+
+
+/* * * *
+ * helper functions
+ */
+
+// the stripe this thread counts keys on: threads take the stripes in turn
+// the first time they count a key
+static int next_stripe;
+static __thread int my_stripe = -1;
+static int stripe(void) {
+	if (my_stripe < 0) {
+		my_stripe = fetch_add(&next_stripe, 1) % NSTRIPES;
+	}
+	return my_stripe;
+}
+
+// add 'n' to this thread's stripe of 'stripes'. returns the stripe's new count
+static int count_keys(Stripe *stripes, int n) {
+	return fetch_add(&stripes[stripe()].count, n) + n;
+}
+
+// add up all of the stripes of 'stripes'
+static int sum_stripes(Stripe *stripes) {
+	int sum = 0;
+	int i;
+	for (i = 0; i < NSTRIPES; i++) {
+		sum += load_acquire(&stripes[i].count);
+	}
+	return sum;
+}
+
+// compare-and-swap: replace the value at 'ptr' with 'desired', but only if it
+// is still 'expected'. returns true if it was replaced
+static bool cas_slot(int64 *ptr, int64 expected, int64 desired) {
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+static bool cas_flag(int *ptr, int expected, int desired) {
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+static bool cas_array(struct array **ptr, struct array *expected,
+	struct array *desired) {
+	return __atomic_compare_exchange_n(ptr, &expected, desired, false,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// create a new array of 'size' empty slots
+static Array *new_array(int size) {
+	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+	Array *array = cache_line_alloc(sizeof *array);
+	int i;
+	for (i = 0; i < NSTRIPES; i++) {
+		array->count[i].count = 0;
+	}
+	array->slots = calloc(size, sizeof *array->slots);
+	assert(array->slots);
+	array->size = size;
+	array->check_every = size / LOAD_CHECKS > 0 ? size / LOAD_CHECKS : 1;
+	array->nchunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	array->next_chunk = 0;
+	array->chunks_done = 0;
+	array->next = NULL;
+	array->older = NULL;
+	return array;
+}
+
+// free 'array' and all of the arrays it replaced
+static void free_arrays(Array *array) {
+	while (array) {
+		Array *older = array->older;
+		free(array->slots);
+		cache_line_free(array);
+		array = older;
+	}
+}
+
+// try to put 'key' into the first free slot of 'array' after its home slot.
+// returns INSERTED if this thread put it there, PRESENT if it's already there,
+// or RETRY if the array is full or being resized
+static Outcome try_insert(Array *array, int64 key) {
+	int h = h1(key) % array->size;
+	int steps;
+	for (steps = 0; steps < array->size; steps++) {
+		int64 *slot = &array->slots[(h + steps) % array->size];
+		int64 old = load_acquire(slot);
+
+		// an empty slot: claim it, unless another thread gets in first (in
+		// which case, look at what they put there instead)
+		while (old == EMPTY_KEY) {
+			if (cas_slot(slot, EMPTY_KEY, key)) {
+				return INSERTED;
+			}
+			old = load_acquire(slot);
+		}
+
+		if (old == key) {
+			return PRESENT;
+		}
+		if (old == FORWARDED) {
+			// the array is being resized, so this key belongs in the next one
+			return RETRY;
+		}
+	}
+	return RETRY;
+}
+
+// move the keys in chunk 'chunk' of 'array' into the next array, replacing
+// every slot of the chunk (empty or not) with FORWARDED
+static void move_chunk(Array *array, int chunk) {
+	Array *next = load_acquire(&array->next);
+	int end = (chunk + 1) * CHUNK_SIZE;
+	if (end > array->size) {
+		end = array->size;
+	}
+
+	int moved = 0;
+	int i;
+	for (i = chunk * CHUNK_SIZE; i < end; i++) {
+		int64 *slot = &array->slots[i];
+
+		// empty slots are forwarded straight away, so that no thread can
+		// claim them for a key after the key's chunk has been moved
+		if (cas_slot(slot, EMPTY_KEY, FORWARDED)) {
+			continue;
+		}
+
+		// otherwise it holds a key (slots holding keys never change, except
+		// here). copy it over first, and only then mark it as forwarded, so
+		// that lookups always find it in one of the arrays. no other keys
+		// are inserted into the next array until every chunk has been moved,
+		// so this can't fail or need another resize
+		int64 key = load_acquire(slot);
+		if (try_insert(next, key) == INSERTED) {
+			moved++;
+		}
+		store_release(slot, FORWARDED);
+	}
+
+	count_keys(next->count, moved);
+	fetch_add(&array->chunks_done, 1);
+}
+
+// help move the keys of 'array' into its next array, then wait until all of
+// them have been moved, and make the next array the table's current array
+static void help_resize(LockFreeHashTable *table, Array *array) {
+	int chunk;
+	while ((chunk = fetch_add(&array->next_chunk, 1)) < array->nchunks) {
+		move_chunk(array, chunk);
+		fetch_add(&table->stats.nchunks, 1);
+	}
+
+	// other threads may still be moving the chunks they claimed
+	while (load_acquire(&array->chunks_done) < array->nchunks) {
+		sched_yield();
+	}
+
+	// if no other thread has already, swap in the next array
+	cas_array(&table->array, array, load_acquire(&array->next));
+}
+
+// resize 'array' (the current array of 'table') into an array twice the size,
+// or help with the resize if another thread has already started one
+static void start_resize(LockFreeHashTable *table, Array *array) {
+	if (load_acquire(&array->next) == NULL) {
+		Array *next = new_array(array->size * 2);
+		next->older = array;
+		if (cas_array(&array->next, NULL, next)) {
+			fetch_add(&table->stats.nresizes, 1);
+		} else {
+			// another thread got in first: use their array instead
+			free(next->slots);
+			cache_line_free(next);
+		}
+	}
+	help_resize(table, array);
+}
+
+// is 'key' in 'array'? a forwarded slot may have held 'key' before it was
+// moved to the next array, so look there too (the key might still be waiting
+// to be moved from a later slot in this array, so carry on here as well)
+static bool find_key(Array *array, int64 key) {
+	int h = h1(key) % array->size;
+	int steps;
+	for (steps = 0; steps < array->size; steps++) {
+		int64 old = load_acquire(&array->slots[(h + steps) % array->size]);
+		if (old == key) {
+			return true;
+		}
+		if (old == EMPTY_KEY) {
+			return false;
+		}
+		if (old == FORWARDED) {
+			Array *next = load_acquire(&array->next);
+			if (load_acquire(&array->chunks_done) == array->nchunks) {
+				// everything has been moved, so the next array has it or not
+				return find_key(next, key);
+			}
+			if (find_key(next, key)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a lock-free hash table with initial size 'size'
+LockFreeHashTable *new_lockfree_hash_table(int size) {
+	assert(size > 0);
+	LockFreeHashTable *table = cache_line_alloc(sizeof *table);
+
+	table->array = new_array(size);
+	table->has_empty_key = false;
+	table->has_forwarded = false;
+
+	int i;
+	for (i = 0; i < NSTRIPES; i++) {
+		table->stats.nkeys[i].count = 0;
+	}
+	table->stats.nresizes = 0;
+	table->stats.nchunks = 0;
+	return table;
+}
+
+
+// free all memory associated with 'table'. arrays which have been replaced
+// are only freed now, since other threads might have still been reading them
+void free_lockfree_hash_table(LockFreeHashTable *table) {
+	assert(table != NULL);
+	free_arrays(table->array);
+	cache_line_free(table);
+}
+
+
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool lockfree_hash_table_insert(LockFreeHashTable *table, int64 key) {
+	assert(table != NULL);
+
+	// the two marker values can't go in slots, so they're just flags
+	if (key == EMPTY_KEY || key == FORWARDED) {
+		int *flag = key == EMPTY_KEY ? &table->has_empty_key
+			: &table->has_forwarded;
+		if (cas_flag(flag, false, true)) {
+			count_keys(table->stats.nkeys, 1);
+			return true;
+		}
+		return false;
+	}
+
+	while (true) {
+		Array *array = load_acquire(&table->array);
+
+		// a resize is going on: help finish it before inserting anything, so
+		// that the key can't end up in both arrays
+		if (load_acquire(&array->next) != NULL) {
+			help_resize(table, array);
+			continue;
+		}
+
+		switch (try_insert(array, key)) {
+			case INSERTED:
+				// getting too full? move everything into a bigger array
+				// (checked every so often, see LOAD_CHECKS)
+				count_keys(table->stats.nkeys, 1);
+				if (count_keys(array->count, 1) % array->check_every == 0
+					&& (int64)sum_stripes(array->count) * MAX_LOAD_INVERSE
+						>= array->size) {
+					start_resize(table, array);
+				}
+				return true;
+			case PRESENT:
+				return false;
+			case RETRY:
+				// the array is full, or another thread has started resizing
+				// it since we looked
+				start_resize(table, array);
+				break;
+		}
+	}
+}
+
+
+// lookup whether 'key' is inside 'table'. this only ever reads the table,
+// so it never waits for (or helps) any resize going on
+// returns true if found, false if not
+bool lockfree_hash_table_lookup(LockFreeHashTable *table, int64 key) {
+	assert(table != NULL);
+	if (key == EMPTY_KEY) {
+		return load_acquire(&table->has_empty_key);
+	}
+	if (key == FORWARDED) {
+		return load_acquire(&table->has_forwarded);
+	}
+	return find_key(load_acquire(&table->array), key);
+}
+
+
+// how many keys are in 'table'
+int lockfree_hash_table_nkeys(LockFreeHashTable *table) {
+	assert(table != NULL);
+	return sum_stripes(table->stats.nkeys);
+}
+
+
+// copy the keys in 'table' into 'keys', up to 'max' of them (while no keys are
+// being inserted)
+// returns how many keys there are, which may be more than were copied
+int lockfree_hash_table_keys(LockFreeHashTable *table, int64 *keys, int max) {
+	assert(table != NULL);
+	Array *array = load_acquire(&table->array);
+	int n = 0;
+
+	// the two marker keys don't have a slot, so copy them first
+	if (table->has_empty_key) {
+		if (n < max) {
+			keys[n] = EMPTY_KEY;
+		}
+		n++;
+	}
+	if (table->has_forwarded) {
+		if (n < max) {
+			keys[n] = FORWARDED;
+		}
+		n++;
+	}
+
+	int i;
+	for (i = 0; i < array->size; i++) {
+		if (array->slots[i] != EMPTY_KEY) {
+			if (n < max) {
+				keys[n] = array->slots[i];
+			}
+			n++;
+		}
+	}
+	return n;
+}
+
+
+// print the contents of 'table' to stdout (while no keys are being inserted)
+void lockfree_hash_table_print(LockFreeHashTable *table) {
+	assert(table != NULL);
+	Array *array = table->array;
+
+	printf("--- table size: %d\n", array->size);
+
+	// print header
+	printf("   address | key\n");
+
+	// the two marker keys don't have a slot, so print them first
+	if (table->has_empty_key) {
+		printf("         - | %llu\n", EMPTY_KEY);
+	}
+	if (table->has_forwarded) {
+		printf("         - | %llu\n", FORWARDED);
+	}
+
+	// print the rows of the hash table
+	int i;
+	for (i = 0; i < array->size; i++) {
+
+		// print the address
+		printf(" %9d | ", i);
+
+		// print the contents of the slot
+		if (array->slots[i] != EMPTY_KEY) {
+			printf("%llu\n", array->slots[i]);
+		} else {
+			printf("-\n");
+		}
+	}
+
+	printf("--- end table ---\n");
+}
+
+
+// print some statistics about 'table' to stdout. unlike the other tables, no
+// CPU time is recorded: clock() measures every thread at once, and calling it
+// around each operation would cost more than the operation itself
+void lockfree_hash_table_stats(LockFreeHashTable *table) {
+	assert(table != NULL);
+	Array *array = load_acquire(&table->array);
+	int nkeys = sum_stripes(table->stats.nkeys);
+
+	printf("--- table stats ---\n");
+
+	// print some information about the table
+	printf("current size: %d slots\n", array->size);
+	printf("current load: %d items\n", nkeys);
+	printf(" load factor: %.3f%%\n", nkeys * 100.0 / array->size);
+	printf("     resizes: %d\n", load_acquire(&table->stats.nresizes));
+	printf("chunks moved: %d\n", load_acquire(&table->stats.nchunks));
+
+	printf("--- end stats ---\n");
+}
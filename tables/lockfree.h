@@ -0,0 +1,50 @@
+/* * * * * * * * *
+ * Concurrent hash table using linear probing: any number of threads can insert
+ * keys and look keys up at the same time, without taking any locks. when the
+ * table gets too full, the threads inserting keys work together to move the
+ * keys into a bigger table
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef LOCKFREE_H
+#define LOCKFREE_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+typedef struct lockfree_table LockFreeHashTable;
+
+// initialise a lock-free hash table with initial size 'size'
+LockFreeHashTable *new_lockfree_hash_table(int size);
+
+// free all memory associated with 'table' (which no other threads may be
+// using any more)
+void free_lockfree_hash_table(LockFreeHashTable *table);
+
+// insert 'key' into 'table', if it's not in there already. safe to call from
+// any number of threads at once
+// returns true if insertion succeeds, false if it was already in there
+bool lockfree_hash_table_insert(LockFreeHashTable *table, int64 key);
+
+// lookup whether 'key' is inside 'table'. safe to call from any number of
+// threads at once, and never waits for other threads
+// returns true if found, false if not
+bool lockfree_hash_table_lookup(LockFreeHashTable *table, int64 key);
+
+// how many keys are in 'table'
+int lockfree_hash_table_nkeys(LockFreeHashTable *table);
+
+// copy the keys in 'table' into 'keys', up to 'max' of them (while no keys are
+// being inserted)
+// returns how many keys there are, which may be more than were copied
+int lockfree_hash_table_keys(LockFreeHashTable *table, int64 *keys, int max);
+
+// print the contents of 'table' to stdout (while no keys are being inserted)
+void lockfree_hash_table_print(LockFreeHashTable *table);
+
+// print some statistics about 'table' to stdout
+void lockfree_hash_table_stats(LockFreeHashTable *table);
+
+#endif
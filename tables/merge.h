@@ -0,0 +1,33 @@
+/* * * * * * * * *
+ * Ways of combining the value already stored with a key and a new value, for
+ * upserts into hash tables holding a 64-bit value with each key
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include "../inthash.h"
+
+// a merge function takes the value stored with a key and a new value for it,
+// and returns the value to store from now on
+typedef int64 (*MergeFunction)(int64 old, int64 value);
+
+// the new value replaces the old one
+static inline int64 merge_replace(int64 old, int64 value) {
+	return value;
+}
+
+// the old value stays (so an upsert is just an insert)
+static inline int64 merge_keep(int64 old, int64 value) {
+	return old;
+}
+
+// the new value is added on to the old one (e.g. for counting)
+static inline int64 merge_add(int64 old, int64 value) {
+	return old + value;
+}
+
+#endif
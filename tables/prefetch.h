@@ -0,0 +1,41 @@
+/* * * * * * * * *
+ * Helpers for looking up (or inserting) a whole batch of keys at once: while
+ * one key is being looked up, the memory needed for keys a little further
+ * along the batch is requested ahead of time, so that their cache misses
+ * overlap instead of happening one after the other
+ *
+ * tables which have to follow pointers (e.g. directory entry -> bucket ->
+ * keys) prefetch in stages: stage 1 is PREFETCH_DISTANCE keys ahead of the
+ * lookup, stage 2 is PREFETCH_DISTANCE keys further ahead again, and so on,
+ * so that each stage can read what the stage before it prefetched
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdbool.h>
+
+// how many keys ahead of the key being looked up to prefetch for (per stage)
+#define PREFETCH_DISTANCE 16
+
+// start loading the cache line holding 'address', without waiting for it.
+// this is only a hint, so it's fine to prefetch an address that won't be used
+#ifdef __GNUC__
+#define prefetch(address) __builtin_prefetch(address)
+#else
+#define prefetch(address) ((void)(address))
+#endif
+
+// set bit i % 8 of bits[i / 8] if 'value' is true, and clear it if not
+static inline void set_bit(unsigned char *bits, int i, bool value) {
+	if (value) {
+		bits[i / 8] |= 1 << (i % 8);
+	} else {
+		bits[i / 8] &= ~(1 << (i % 8));
+	}
+}
+
+#endif
@@ -0,0 +1,113 @@
+/* * * * * * * * *
+ * Count-min sketch for estimating how often keys are looked up, so that
+ * two-choice hash tables can move their most frequently used keys into the
+ * position they probe first
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "sketch.h"
+
+// the sketch has SKETCH_ROWS rows of 2^SKETCH_BITS small counters. each key
+// has one counter per row, and its estimated count is the smallest of them
+// (the one least inflated by other keys sharing its counters)
+#define SKETCH_ROWS 4
+#define SKETCH_BITS 10
+#define SKETCH_WIDTH (1 << SKETCH_BITS)
+
+// the largest value a counter can hold
+#define MAX_COUNT 255
+
+// after this many additions, all counters are halved
+#define DECAY_PERIOD (SKETCH_WIDTH * 8)
+
+struct sketch {
+	unsigned char counts[SKETCH_ROWS][SKETCH_WIDTH];	// the counters
+	int nadded;			// how many additions since counters were last halved
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// which counter in row 'row' belongs to the key with these hash values
+// (combining the two hash values differently for each row)
+static int counter_index(int row, int hash1, int hash2) {
+	unsigned int combined = (unsigned int)hash1 + (unsigned int)row * hash2;
+	return combined & (SKETCH_WIDTH - 1);
+}
+
+// halve every counter in 'sketch'
+static void decay(Sketch *sketch) {
+	int row, i;
+	for (row = 0; row < SKETCH_ROWS; row++) {
+		for (i = 0; i < SKETCH_WIDTH; i++) {
+			sketch->counts[row][i] /= 2;
+		}
+	}
+	sketch->nadded = 0;
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a sketch with all counts at zero
+Sketch *new_sketch() {
+	Sketch *sketch = calloc(1, sizeof *sketch);
+	assert(sketch);
+	return sketch;
+}
+
+
+// free all memory associated with 'sketch'
+void free_sketch(Sketch *sketch) {
+	assert(sketch);
+	free(sketch);
+}
+
+
+// count one more use of the key with hash values 'hash1' and 'hash2',
+// returning its new estimated count
+int sketch_add(Sketch *sketch, int hash1, int hash2) {
+	assert(sketch);
+
+	// only the smallest counters need to go up (conservative update): the
+	// others already count more than this key's uses
+	int estimate = sketch_estimate(sketch, hash1, hash2);
+	int row;
+	for (row = 0; row < SKETCH_ROWS; row++) {
+		unsigned char *count =
+			&sketch->counts[row][counter_index(row, hash1, hash2)];
+		if (*count == estimate && *count < MAX_COUNT) {
+			(*count)++;
+		}
+	}
+
+	sketch->nadded++;
+	if (sketch->nadded == DECAY_PERIOD) {
+		decay(sketch);
+	}
+	return estimate < MAX_COUNT ? estimate + 1 : MAX_COUNT;
+}
+
+
+// estimated count for the key with hash values 'hash1' and 'hash2'
+int sketch_estimate(Sketch *sketch, int hash1, int hash2) {
+	assert(sketch);
+	int estimate = MAX_COUNT;
+	int row;
+	for (row = 0; row < SKETCH_ROWS; row++) {
+		int count = sketch->counts[row][counter_index(row, hash1, hash2)];
+		if (count < estimate) {
+			estimate = count;
+		}
+	}
+	return estimate;
+}
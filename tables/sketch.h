@@ -0,0 +1,40 @@
+/* * * * * * * * *
+ * Count-min sketch for estimating how often keys are looked up, so that
+ * two-choice hash tables can move their most frequently used keys into the
+ * position they probe first
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+// set to 0 to turn off hot key tracking (and migration) in the two-choice
+// tables (cuckoo, xuckoo and xuckoon)
+#define TRACK_HOT_KEYS 1
+
+// a key found in its second-choice position is moved to its first-choice
+// position once it has been counted this many times
+#define HOT_THRESHOLD 8
+
+typedef struct sketch Sketch;
+
+// initialise a sketch with all counts at zero
+Sketch *new_sketch();
+
+// free all memory associated with 'sketch'
+void free_sketch(Sketch *sketch);
+
+// count one more use of the key with hash values 'hash1' and 'hash2' (from
+// 'h1()' and 'h2()'), returning its new estimated count. counts are halved
+// every so often, so that keys which stop being used cool down again
+int sketch_add(Sketch *sketch, int hash1, int hash2);
+
+// estimated count for the key with hash values 'hash1' and 'hash2'
+int sketch_estimate(Sketch *sketch, int hash1, int hash2);
+
+#endif
@@ -0,0 +1,92 @@
+/* * * * * * * * *
+ * A stash of keys set aside by a hash table which couldn't find them a place,
+ * searched (and scanned) after the rest of the table
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef STASH_H
+#define STASH_H
+
+#include <stdlib.h>
+#include <assert.h>
+#include "../inthash.h"
+#include "cursor.h"
+
+// keys which couldn't be given a place, kept side by side with their values.
+// with reasonable hash functions this stays empty (or very nearly), so
+// lookups only search it when there's something there
+typedef struct stash {
+	int64 *keys;
+	int64 *values;
+	int nkeys;		// how many keys are in the stash
+	int size;		// how many keys it has room for
+} Stash;
+
+// start 'stash' off empty
+static inline void init_stash(Stash *stash) {
+	stash->keys = NULL;
+	stash->values = NULL;
+	stash->nkeys = 0;
+	stash->size = 0;
+}
+
+// free the memory held by 'stash'
+static inline void free_stash(Stash *stash) {
+	free(stash->keys);
+	free(stash->values);
+}
+
+// add 'key' (which mustn't be there already) to 'stash', with its value.
+// keys are only ever added to the end, so scans can walk through a stash by
+// position
+static inline void stash_add(Stash *stash, int64 key, int64 value) {
+	if (stash->nkeys == stash->size) {
+		stash->size = stash->size ? stash->size * 2 : 4;
+		stash->keys = realloc(stash->keys, sizeof *stash->keys * stash->size);
+		assert(stash->keys);
+		stash->values = realloc(stash->values,
+			sizeof *stash->values * stash->size);
+		assert(stash->values);
+	}
+	stash->keys[stash->nkeys] = key;
+	stash->values[stash->nkeys] = value;
+	stash->nkeys++;
+}
+
+// where is the value of 'key' in 'stash'? returns NULL if it's not there
+static inline int64 *stash_value(Stash *stash, int64 key) {
+	int i;
+	for (i = 0; i < stash->nkeys; i++) {
+		if (stash->keys[i] == key) {
+			return &stash->values[i];
+		}
+	}
+	return NULL;
+}
+
+// carry on a scan from position 'cursor->pos' in 'stash', whose key i is at
+// scan position 'start' plus i, copying keys into 'keys' (and their values
+// into 'values', unless it's NULL) from index 'n' until there are 'max' of
+// them, and finishing the scan once past the last key. returns how many keys
+// there are in 'keys' now
+static inline int scan_stash(Stash *stash, int64 start, ScanCursor *cursor,
+	int64 *keys, int64 *values, int n, int max) {
+	while (n < max && cursor->pos != SCAN_DONE) {
+		int64 i = cursor->pos - start;
+		if (i >= stash->nkeys) {
+			cursor->pos = SCAN_DONE;
+			break;
+		}
+		keys[n] = stash->keys[i];
+		if (values) {
+			values[n] = stash->values[i];
+		}
+		n++;
+		cursor->pos++;
+	}
+	return n;
+}
+
+#endif
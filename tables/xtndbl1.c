@@ -8,40 +8,79 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 
 #include "xtndbl1.h"
+#include "xtnddir.h"
+#include "xtndbuild.h"
+#include "prefetch.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 1
+
+// buckets this deep are given overflow pages instead of being split again
+#define MAX_BUCKET_DEPTH 24
+
+// marks the end of a chain of overflow pages
+#define NO_PAGE -1
 
 // macro to calculate the rightmost n bits of a number x
-#define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
+#define rightmostnbits(n, x) ((x) & ((1 << (n)) - 1))
 
 // a bucket stores a single key (full=true) or is empty (full=false)
-// it also knows how many bits are shared between possible keys, and the first 
-// table address that references it
+// it also knows how many bits are shared between possible keys
+// buckets live directly in the directory: every address referencing a bucket
+// holds its own 16-byte copy, so whether a key is in the table takes a single
+// directory lookup. the keys' values are kept out of the way in a dense array
+// of their own, one per key, and are only read once the key has been found.
+// the bucket's id (the first table address which references it) is just the
+// rightmost 'depth' bits of any of these addresses
+// keys whose hash values can't be told apart within MAX_BUCKET_DEPTH bits
+// (e.g. keys with identical hash values) are kept in a chain of overflow pages
 typedef struct bucket {
-	int id;		// a unique id for this bucket, equal to the first address
-				// in the table which points to it
-	int depth;	// how many hash value bits are being used by this bucket
-	bool full;	// does this bucket contain a key
-	int64 key;	// the key stored in this bucket
+	int64 key;		// the key stored in this bucket (the first one, if it
+					// has overflow pages)
+	int slot;		// the index of that key's value in the value array, or
+					// if the bucket has overflow pages, the first page
+	unsigned char depth;	// how many hash value bits are being used by
+							// this bucket
+	bool full;		// does this bucket contain a key
+	bool overflow;	// are all of this bucket's keys (including 'key') kept
+					// in overflow pages
 } Bucket;
 
+// an overflow page holds one key of a bucket, and links to the next page
+typedef struct page {
+	int64 key;		// the key stored in this page
+	int slot;		// the index of its value in the value array
+	int next;		// index of the next overflow page, or NO_PAGE if none
+} Page;
+
 // helper structure to store statistics gathered
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
+	int noverflow;	// how many overflow pages are chained onto buckets
 	int nkeys;		// how many keys are being stored in the table
 	int time;		// how much CPU time has been used to insert/lookup keys
 					// in this table
 } Stats;
 
-// a hash table is an array of slots pointing to buckets holding up to 1 key,
-// along with some usage statistics and information about the number of hash
-// value bits to use for addressing
+// a hash table is a directory of slots holding buckets of up to 1 key (plus
+// any overflow pages), the keys' values, and some usage statistics. the
+// directory keeps track of how many hash value bits to use for addressing each
+// part of the table
 struct xtndbl1_table {
-	Bucket **buckets;	// array of pointers to buckets
-	int size;			// how many entries in the table of pointers (2^depth)
-	int depth;			// how many bits of the hash value to use (log2(size))
+	XtndDir *dir;		// directory of buckets
+	int64 *values;		// every key's value, in the order the keys arrived
+	int nvalues;		// how many values are in use
+	int nslots;			// how many values 'values' has room for
+	Page *pages;		// pool of overflow pages
+	int npages;			// how many pages the pool has room for
+	int freepage;		// first unused page in the pool, or NO_PAGE if none
 	Stats stats;		// collection of statistics about this hash table
 };
 
@@ -49,106 +88,340 @@ struct xtndbl1_table {
  * helper functions
  */
 
-// create a new bucket first referenced from 'first_address', based on 'depth'
-// bits of its keys' hash values
-static Bucket *new_bucket(int first_address, int depth) {
-	Bucket *bucket = malloc(sizeof *bucket);
-	assert(bucket);
+// create a new, empty bucket based on 'depth' bits of its keys' hash values
+// (empty buckets of the same depth are identical, padding and all, so the
+// directory can tell when its entries are copies of one another)
+static Bucket new_bucket(int depth) {
+	Bucket bucket;
+	memset(&bucket, 0, sizeof bucket);
+	bucket.depth = depth;
+	return bucket;
+}
 
-	bucket->id = first_address;
-	bucket->depth = depth;
-	bucket->full = false;
+// the bucket for a key with hash value 'hash' (read only: buckets are changed
+// by writing them back with 'write_bucket()')
+static Bucket *find_bucket(Xtndbl1HashTable *table, int hash) {
+	return xtnd_dir_lookup(table->dir, hash);
+}
 
-	return bucket;
+// overwrite every copy of the bucket for hash value 'hash' with 'bucket'
+// (any pointers into the directory are now invalid)
+static void write_bucket(Xtndbl1HashTable *table, int hash, Bucket *bucket) {
+	xtnd_dir_assign(table->dir, hash, bucket->depth, bucket);
 }
 
-// double the table of bucket pointers, duplicating the bucket pointers in the
-// first half into the new second half of the table
-static void double_table(Xtndbl1HashTable *table) {
-	int size = table->size * 2;
-	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
+// store 'value' for a new key at the end of the value array (growing it if
+// it's full), returning its index
+static int new_value(Xtndbl1HashTable *table, int64 value) {
+	if (table->nvalues == table->nslots) {
+		table->nslots = table->nslots ? table->nslots * 2 : 4;
+		table->values = realloc(table->values, sizeof *table->values
+			* table->nslots);
+		assert(table->values);
+	}
+	table->values[table->nvalues] = value;
+	return table->nvalues++;
+}
 
-	// get a new array of twice as many bucket pointers, and copy pointers down
-	table->buckets = realloc(table->buckets, (sizeof *table->buckets) * size);
-	assert(table->buckets);
-	int i;
-	for (i = 0; i < table->size; i++) {
-		table->buckets[table->size + i] = table->buckets[i];
+// take a page from the pool of overflow pages, growing the pool if it's empty
+static int new_page(Xtndbl1HashTable *table) {
+	if (table->freepage == NO_PAGE) {
+		int old_size = table->npages;
+		table->npages = old_size ? old_size * 2 : 4;
+		table->pages = realloc(table->pages, sizeof *table->pages 
+			* table->npages);
+		assert(table->pages);
+
+		// thread the new pages onto the free list
+		int i;
+		for (i = old_size; i < table->npages; i++) {
+			table->pages[i].next = i + 1 < table->npages ? i + 1 : NO_PAGE;
+		}
+		table->freepage = old_size;
 	}
+	int page = table->freepage;
+	table->freepage = table->pages[page].next;
+	table->stats.noverflow++;
+	return page;
+}
 
-	// finally, increase the table size and the depth we are using to hash keys
-	table->size = size;
-	table->depth++;
+// return a page to the pool of overflow pages
+static void free_page(Xtndbl1HashTable *table, int page) {
+	table->pages[page].next = table->freepage;
+	table->freepage = page;
+	table->stats.noverflow--;
 }
 
-// reinsert a key into the hash table after splitting a bucket --- we can assume
-// that there will definitely be space for this key because it was already
-// inside the hash table previously
-// use 'xtndbl1_hash_table_insert()' instead for inserting new keys
-static void reinsert_key(Xtndbl1HashTable *table, int64 key) {
-	int address = rightmostnbits(table->depth, h1(key));
-	table->buckets[address]->key = key;
-	table->buckets[address]->full = true;
+// the first overflow page of 'bucket', or NO_PAGE if it has none
+static int first_page(Bucket *bucket) {
+	return bucket->overflow ? bucket->slot : NO_PAGE;
 }
 
-// split the bucket in 'table' at address 'address', growing table if necessary
-static void split_bucket(Xtndbl1HashTable *table, int address) {
-	
-	// FIRST,
-	// do we need to grow the table?
-	if (table->buckets[address]->depth == table->depth) {
-		// yep, this bucket is down to its last pointer
-		double_table(table);
+// how many keys are in 'bucket' and its overflow pages
+static int bucket_nkeys(Xtndbl1HashTable *table, Bucket *bucket) {
+	if (!bucket->overflow) {
+		return bucket->full;
 	}
-	// either way, now it's time to split this bucket
+	int nkeys = 0;
+	int page;
+	for (page = first_page(bucket); page != NO_PAGE;
+		page = table->pages[page].next) {
+		nkeys++;
+	}
+	return nkeys;
+}
 
+// which slot of the value array holds the value of 'key': is it in 'bucket'
+// or one of its overflow pages? returns -1 if 'key' is in neither
+static int bucket_slot(Xtndbl1HashTable *table, Bucket *bucket, int64 key) {
+	if (bucket->full && bucket->key == key && !bucket->overflow) {
+		return bucket->slot;
+	}
+	int page;
+	for (page = first_page(bucket); page != NO_PAGE; 
+		page = table->pages[page].next) {
+		if (table->pages[page].key == key) {
+			return table->pages[page].slot;
+		}
+	}
+	return -1;
+}
 
-	// SECOND,
-	// create a new bucket and update both buckets' depth
-	Bucket *bucket = table->buckets[address];
-	int depth = bucket->depth;
-	int first_address = bucket->id;
+// if 'key' (with hash value 'hash') is in the table, replace its value with
+// merge(its value, 'value') and return true. otherwise, return false
+static bool update_value(Xtndbl1HashTable *table, int hash, int64 key,
+	int64 value, MergeFunction merge) {
+	int slot = bucket_slot(table, find_bucket(table, hash), key);
+	if (slot >= 0) {
+		table->values[slot] = merge(table->values[slot], value);
+		return true;
+	}
+	return false;
+}
 
-	int new_depth = depth + 1;
-	bucket->depth = new_depth;
+// could splitting 'bucket' (perhaps a few times over) separate its keys from
+// a new key with hash value 'hash'? not if they all share the same rightmost
+// MAX_BUCKET_DEPTH hash value bits
+static bool can_split(Xtndbl1HashTable *table, Bucket *bucket, int hash) {
+	if (bucket->depth >= MAX_BUCKET_DEPTH) {
+		return false;
+	}
+	int diff = 0;
+	if (bucket->full) {
+		diff |= h1(bucket->key) ^ hash;
+	}
+	int page;
+	for (page = first_page(bucket); page != NO_PAGE; 
+		page = table->pages[page].next) {
+		diff |= h1(table->pages[page].key) ^ hash;
+	}
+	return rightmostnbits(MAX_BUCKET_DEPTH, diff) != 0;
+}
+
+// add 'key' (whose value is in slot 'slot' of the value array) to 'bucket'
+// itself if it's empty, otherwise to a new overflow page at the front of the
+// bucket's chain (moving the bucket's own key into a page first, if it's the
+// bucket's first overflow). the bucket still needs writing back
+static void bucket_push(Xtndbl1HashTable *table, Bucket *bucket, int64 key,
+	int slot) {
+	if (!bucket->full) {
+		bucket->key = key;
+		bucket->slot = slot;
+		bucket->full = true;
+		return;
+	}
+	if (!bucket->overflow) {
+		int page = new_page(table);
+		table->pages[page].key = bucket->key;
+		table->pages[page].slot = bucket->slot;
+		table->pages[page].next = NO_PAGE;
+		bucket->slot = page;
+		bucket->overflow = true;
+	}
+	int page = new_page(table);
+	table->pages[page].key = key;
+	table->pages[page].slot = slot;
+	table->pages[page].next = bucket->slot;
+	bucket->slot = page;
+}
 
-	// new bucket's first address will be a 1 bit plus the old first address
+// store 'key' (with hash value 'hash', and its value in slot 'slot' of the
+// value array) in its bucket, or in one of the bucket's overflow pages if the
+// bucket is full
+// (we can assume that this key is not already in the table)
+static void bucket_add_key(Xtndbl1HashTable *table, int hash, int64 key,
+	int slot) {
+	Bucket bucket = *find_bucket(table, hash);
+	bucket_push(table, &bucket, key, slot);
+	write_bucket(table, hash, &bucket);
+}
+
+// split the bucket for hash value 'hash' in 'table', growing the directory 
+// where necessary
+static void split_bucket(Xtndbl1HashTable *table, int hash) {
+
+	// FIRST,
+	// take a copy of the bucket, which we're about to overwrite
+	Bucket bucket = *find_bucket(table, hash);
+	int depth = bucket.depth;
+	int first_address = rightmostnbits(depth, hash);
+
+	// SECOND,
+	// replace it with two empty buckets one bit deeper: the old bucket's first
+	// address, and a 1 bit plus the old first address
+	// (the directory takes care of growing if it needs to)
+	int new_depth = depth + 1;
 	int new_first_address = 1 << depth | first_address;
-	Bucket *newbucket = new_bucket(new_first_address, new_depth);
+	Bucket empty = new_bucket(new_depth);
+	xtnd_dir_assign(table->dir, first_address, new_depth, &empty);
+	xtnd_dir_assign(table->dir, new_first_address, new_depth, &empty);
 	table->stats.nbuckets++;
-	
-	// THIRD,
-	// redirect every second address pointing to this bucket to the new bucket
-	// construct addresses by joining a bit 'prefix' and a bit 'suffix'
-	// (defined below)
-
-	// suffix: a 1 bit followed by the previous bucket bit address
-	int bit_address = rightmostnbits(depth, first_address);
-	int suffix = (1 << depth) | bit_address;
-
-	// prefix: all bitstrings of length equal to the difference between the new
-	// bucket depth and the table depth
-	// use a for loop to enumerate all possible prefixes less than maxprefix:
-	int maxprefix = 1 << (table->depth - new_depth);
-
-	int prefix;
-	for (prefix = 0; prefix < maxprefix; prefix++) {
-		
-		// construct address by joining this prefix and the suffix
-		int a = (prefix << new_depth) | suffix;
-
-		// redirect this table entry to point at the new bucket
-		table->buckets[a] = newbucket;
-	}
 
 	// FINALLY,
-	// filter the key from the old bucket into its rightful place in the new 
-	// table (which may be the old bucket, or may be the new bucket)
+	// filter the keys from the old bucket (or its overflow pages, which we
+	// can free now) into their rightful places in the new table (which may be
+	// the old bucket, or may be the new bucket). their values stay put
+	if (bucket.full && !bucket.overflow) {
+		bucket_add_key(table, h1(bucket.key), bucket.key, bucket.slot);
+	}
+	int page = first_page(&bucket);
+	while (page != NO_PAGE) {
+		Page copy = table->pages[page];
+		free_page(table, page);
+		bucket_add_key(table, h1(copy.key), copy.key, copy.slot);
+		page = copy.next;
+	}
+}
 
-	// remove and reinsert the key
-	int64 key = bucket->key;
-	bucket->full = false;
-	reinsert_key(table, key);
+// the fewest hash value bits (up to MAX_BUCKET_DEPTH) which address enough
+// buckets to give 'nkeys' keys twice as much room as they need
+static int depth_for(int nkeys) {
+	return depth_for_room(2LL * nkeys, 1, MAX_BUCKET_DEPTH);
+}
+
+// split_to_depth() helper: how many hash value bits the bucket for 'address'
+// uses
+static int bucket_depth(void *table, int address) {
+	return find_bucket(table, address)->depth;
+}
+
+// split_to_depth() helper: split the bucket for 'address'
+static void split_address(void *table, int address) {
+	split_bucket(table, address);
+}
+
+// put the 'n' keys in 'keys' (whose hash values all end in the rightmost
+// 'depth' bits of 'pattern') into a new bucket for those addresses. if more
+// than one key would share it, and a split could tell them apart, build two
+// buckets one bit deeper instead (reordering 'keys')
+static void build_bucket(void *arg, int64 *keys, int n, int pattern,
+	int depth) {
+	Xtndbl1HashTable *table = arg;
+	if (n > 1 && depth < MAX_BUCKET_DEPTH
+		&& keys_can_split(keys, n, MAX_BUCKET_DEPTH)) {
+		int nzero = split_keys(keys, n, depth);
+		build_bucket(table, keys, nzero, pattern, depth + 1);
+		build_bucket(table, keys + nzero, n - nzero, 1 << depth | pattern,
+			depth + 1);
+		return;
+	}
+
+	// fill the bucket (and any overflow pages), then point its addresses at it
+	Bucket bucket = new_bucket(depth);
+	int i;
+	for (i = 0; i < n; i++) {
+		bucket_push(table, &bucket, keys[i], new_value(table, 0));
+	}
+	xtnd_dir_assign(table->dir, pattern, depth, &bucket);
+	table->stats.nbuckets++;
+	table->stats.nkeys += n;
+}
+
+// directory walk helper: print a table entry and, at the first address at
+// which a bucket occurs, the bucket itself
+static void print_entry(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = entry;
+	Xtndbl1HashTable *table = arg;
+	int id = rightmostnbits(bucket->depth, address);
+
+	// table entry
+	printf("%9d | %-9d ", address, id);
+
+	// if this is the first address at which a bucket occurs, print it
+	if (id == address) {
+		printf("%9d ", id);
+		if (bucket->full) {
+			printf("[%llu]", bucket->key);
+		} else {
+			printf("[ ]");
+		}
+
+		// and any overflow pages after it (the last of which holds the
+		// bucket's own key again)
+		int page;
+		for (page = first_page(bucket); page != NO_PAGE; 
+			page = table->pages[page].next) {
+			if (table->pages[page].next != NO_PAGE) {
+				printf(" +[%llu]", table->pages[page].key);
+			}
+		}
+	}
+
+	// end the line
+	printf("\n");
+}
+
+
+// start loading the memory needed to find 'key': its directory entry, which
+// holds its bucket
+static void prefetch_key(Xtndbl1HashTable *table, int64 key, int stage) {
+	xtnd_dir_prefetch(table->dir, h1(key));
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in xtndbl1_hash_table_upsert(), but untimed)
+static bool upsert_key(Xtndbl1HashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	// is this key already there? then just update its value
+	int hash = h1(key);
+	if (update_value(table, hash, key, value, merge)) {
+		return false;
+	}
+
+	// find the bucket for this key
+	Bucket *bucket = find_bucket(table, hash);
+
+	// if not, make space in the table until our target bucket has space, as
+	// long as splitting can actually tell this key apart from the others
+	while (bucket->full && can_split(table, bucket, hash)) {
+		split_bucket(table, hash);
+
+		// and look the bucket up again because we might now need more bits
+		bucket = find_bucket(table, hash);
+	}
+
+	// there's now space (or this key goes in an overflow page)! insert it
+	bucket_add_key(table, hash, key, new_value(table, value));
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in xtndbl1_hash_table_get(), but untimed)
+static bool get_key(Xtndbl1HashTable *table, int64 key,
+	int64 *value) {
+	// find the bucket for this key
+	Bucket *bucket = find_bucket(table, h1(key));
+	
+	// look for the key in that bucket (unless it's empty) or its overflow
+	// pages (usually there are none)
+	int slot = bucket_slot(table, bucket, key);
+	if (slot >= 0 && value) {
+		*value = table->values[slot];
+	}
+
+	return slot >= 0;
 }
 
 
@@ -158,16 +431,22 @@ static void split_bucket(Xtndbl1HashTable *table, int address) {
 
 // initialise a single-key extendible hash table
 Xtndbl1HashTable *new_xtndbl1_hash_table() {
-	Xtndbl1HashTable *table = malloc(sizeof *table);
+	Xtndbl1HashTable *table = cache_line_alloc(sizeof *table);
 	assert(table);
 
-	table->size = 1;
-	table->buckets = malloc(sizeof *table->buckets);
-	assert(table->buckets);
-	table->buckets[0] = new_bucket(0, 0);
-	table->depth = 0;
+	Bucket bucket = new_bucket(0);
+	table->dir = new_xtnd_dir(sizeof bucket, &bucket);
+
+	table->values = NULL;
+	table->nvalues = 0;
+	table->nslots = 0;
+
+	table->pages = NULL;
+	table->npages = 0;
+	table->freepage = NO_PAGE;
 
 	table->stats.nbuckets = 1;
+	table->stats.noverflow = 0;
 	table->stats.nkeys = 0;
 	table->stats.time = 0;
 
@@ -175,113 +454,277 @@ Xtndbl1HashTable *new_xtndbl1_hash_table() {
 }
 
 
+// build a single-key extendible hash table holding the 'n' keys in 'keys',
+// from the bottom up: the keys are partitioned by their hash values, and each
+// bucket is made once, already holding its keys. if 'unique' is true, the
+// keys must all be different and aren't checked
+// returns the new table
+Xtndbl1HashTable *build_xtndbl1_hash_table(const int64 *keys, int n,
+	bool unique) {
+	assert(n >= 0);
+	int start_time = clock(); // start timing
+	Xtndbl1HashTable *table = new_xtndbl1_hash_table();
+
+	// start from as many buckets as xtndbl1_hash_table_reserve() would.
+	// every address gets a bucket, replacing the table's first bucket
+	table->stats.nbuckets = 0;
+	build_buckets(table, keys, n, depth_for(n), unique, build_bucket);
+
+	table->stats.time += clock() - start_time;
+	return table;
+}
+
+
 // free all memory associated with 'table'
 void free_xtndbl1_hash_table(Xtndbl1HashTable *table) {
 	assert(table);
 
-	// loop backwards through the array of pointers, freeing buckets only as we
-	// reach their first reference
-	// (if we loop through forwards, we wouldn't know which reference was last)
-	int i;
-	for (i = table->size-1; i >= 0; i--) {
-		if (table->buckets[i]->id == i) {
-			free(table->buckets[i]);
-		}
-	}
-
-	// free the array of bucket pointers
-	free(table->buckets);
+	// free the directory (and with it, the buckets), the values and the
+	// overflow pages
+	free_xtnd_dir(table->dir);
+	free(table->values);
+	free(table->pages);
 	
 	// free the table struct itself
-	free(table);
+	cache_line_free(table);
 }
 
 
-// insert 'key' into 'table', if it's not in there already
-// returns true if insertion succeeds, false if it was already in there
-bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key) {
+// make room in 'table' for 'nkeys' keys in total, by splitting it into twice
+// as many buckets as that up front. with one key per bucket, keys which share
+// a bucket anyway still split it as usual, but most splits are avoided
+void xtndbl1_hash_table_reserve(Xtndbl1HashTable *table, int nkeys) {
 	assert(table);
 	int start_time = clock(); // start timing
-	
-	// calculate table address
-	int hash = h1(key);
-	int address = rightmostnbits(table->depth, hash);
-	
-	// is this key already there?
-	if (table->buckets[address]->full && table->buckets[address]->key == key) {
-		table->stats.time += clock() - start_time; // add time elapsed
-		return false;
-	}
+	split_to_depth(table, depth_for(nkeys), bucket_depth, split_address);
+	table->stats.time += clock() - start_time;
+}
 
-	// if not, make space in the table until our target bucket has space
-	while (table->buckets[address]->full) {
-		split_bucket(table, address);
 
-		// and recalculate address because we might now need more bits
-		address = rightmostnbits(table->depth, hash);
-	}
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key) {
+	return xtndbl1_hash_table_upsert(table, key, 0, merge_keep);
+}
 
-	// there's now space! we can insert this key
-	table->buckets[address]->key = key;
-	table->buckets[address]->full = true;
-	table->stats.nkeys++;
 
-	// add time elapsed to total CPU time before returning
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool xtndbl1_hash_table_upsert(Xtndbl1HashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool inserted = upsert_key(table, key, value, merge);
 	table->stats.time += clock() - start_time;
-	return true;
+	return inserted;
 }
 
 
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xtndbl1_hash_table_lookup(Xtndbl1HashTable *table, int64 key) {
-	assert(table);
+	return xtndbl1_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool xtndbl1_hash_table_get(Xtndbl1HashTable *table, int64 key,
+	int64 *value) {
+	assert(table != NULL);
 	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
 
-	// calculate table address for this key
-	int address = rightmostnbits(table->depth, h1(key));
-	
-	// look for the key in that bucket (unless it's empty)
-	bool found = false;
-	if (table->buckets[address]->full) {
-		// found it?
-		found = table->buckets[address]->key == key;
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void xtndbl1_hash_table_lookup_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	xtndbl1_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void xtndbl1_hash_table_probe_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
+		}
+	}
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int xtndbl1_hash_table_insert_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
 	}
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int xtndbl1_hash_table_scan(Xtndbl1HashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int n = xtndbl1_hash_table_probe_scan(table, cursor, keys, values, max);
 
-	// add time elapsed to total CPU time before returning result
 	table->stats.time += clock() - start_time;
-	return found;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void xtndbl1_hash_table_scan_ranges(Xtndbl1HashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+
+	// positions are split up evenly, and then each split is moved past the
+	// bucket it falls in the middle of, if any
+	int64 end = 1LL << SCAN_BITS;
+	scan_split(cursors, n, end);
+	int i;
+	for (i = 1; i < n; i++) {
+		Bucket *bucket = find_bucket(table, scan_address(cursors[i].pos));
+		scan_align_split(cursors, i, bucket->depth);
+	}
+	scan_skip_empty(cursors, n, end);
+
+	table->stats.time += clock() - start_time;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int xtndbl1_hash_table_probe_scan(Xtndbl1HashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+
+	// visit each bucket once, in scan order (see cursor.h)
+	int n = 0;
+	while (n < max && cursor->pos != SCAN_DONE) {
+		Bucket *bucket = find_bucket(table, scan_address(cursor->pos));
+
+		// if the last chunk stopped partway through this bucket's overflow
+		// pages and they've changed since, go back over them from the start
+		if (cursor->skip > 0 && !scan_can_resume(cursor,
+			bucket_nkeys(table, bucket), bucket->depth)) {
+			cursor->skip = 0;
+		}
+
+		// copy the keys in the bucket (and its pages) that haven't been
+		// returned yet, as long as there's room for them
+		int i = 0;
+		if (bucket->full && !bucket->overflow) {
+			if (i >= cursor->skip) {
+				keys[n] = bucket->key;
+				if (values) {
+					values[n] = table->values[bucket->slot];
+				}
+				n++;
+			}
+			i++;
+		}
+		int page;
+		for (page = first_page(bucket); page != NO_PAGE && n < max;
+			page = table->pages[page].next) {
+			if (i >= cursor->skip) {
+				keys[n] = table->pages[page].key;
+				if (values) {
+					values[n] = table->values[table->pages[page].slot];
+				}
+				n++;
+			}
+			i++;
+		}
+
+		// ran out of room partway through the pages? pick up here next time
+		if (page != NO_PAGE) {
+			cursor->skip = i;
+			cursor->nkeys = bucket_nkeys(table, bucket);
+			cursor->depth = bucket->depth;
+			break;
+		}
+		cursor->skip = 0;
+
+		// start loading a bucket further ahead
+		int64 ahead = scan_ahead(cursor->pos, bucket->depth, SCAN_AHEAD);
+		if (ahead >> SCAN_BITS == 0) {
+			xtnd_dir_prefetch(table->dir, scan_address(ahead));
+		}
+
+		cursor->pos = scan_next(cursor->pos, bucket->depth);
+		if (cursor->pos >= scan_end(cursor, 1LL << SCAN_BITS)) {
+			cursor->pos = SCAN_DONE;
+		}
+	}
+
+	return n;
+}
+
+
+// how many keys are in 'table'
+int xtndbl1_hash_table_nkeys(Xtndbl1HashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
 }
 
 
 // print the contents of 'table' to stdout
 void xtndbl1_hash_table_print(Xtndbl1HashTable *table) {
 	assert(table);
-	printf("--- table size: %d\n", table->size);
+	printf("--- table size: %d\n", xtnd_dir_size(table->dir));
 
 	// print header
 	printf("  table:               buckets:\n");
 	printf("  address | bucketid   bucketid [key]\n");
 	
 	// print table and buckets
-	int i;
-	for (i = 0; i < table->size; i++) {
-		// table entry
-		printf("%9d | %-9d ", i, table->buckets[i]->id);
-
-		// if this is the first address at which a bucket occurs, print it
-		if (table->buckets[i]->id == i) {
-			printf("%9d ", table->buckets[i]->id);
-			if (table->buckets[i]->full) {
-				printf("[%llu]", table->buckets[i]->key);
-			} else {
-				printf("[ ]");
-			}
-		}
-
-		// end the line
-		printf("\n");
-	}
+	xtnd_dir_walk(table->dir, print_entry, table);
 
 	printf("--- end table ---\n");
 	return;
@@ -294,9 +737,12 @@ void xtndbl1_hash_table_stats(Xtndbl1HashTable *table) {
 	printf("--- table stats ---\n");
 
 	// print some stats about state of the table
-	printf("current table size: %d\n", table->size);
+	printf("current table size: %d\n", xtnd_dir_size(table->dir));
+	printf("   directory depth: %d\n", xtnd_dir_depth(table->dir));
+	printf("   directory nodes: %d\n", xtnd_dir_nnodes(table->dir));
 	printf("    number of keys: %d\n", table->stats.nkeys);
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
+	printf("    overflow pages: %d\n", table->stats.noverflow);
 
 	// also calculate CPU usage in seconds and print this
 	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
@@ -11,15 +11,28 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
 
 typedef struct xtndbl1_table Xtndbl1HashTable;
 
 // initialise a single-key extendible hash table
 Xtndbl1HashTable *new_xtndbl1_hash_table();
 
+// build a single-key extendible hash table holding the 'n' keys in 'keys'
+// (with value 0), making each bucket just once rather than by splitting. if
+// 'unique' is true, the keys must all be different, and aren't checked for
+// repeats
+Xtndbl1HashTable *build_xtndbl1_hash_table(const int64 *keys, int n,
+	bool unique);
+
 // free all memory associated with 'table'
 void free_xtndbl1_hash_table(Xtndbl1HashTable *table);
 
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void xtndbl1_hash_table_reserve(Xtndbl1HashTable *table, int nkeys);
+
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key);
@@ -28,6 +41,51 @@ bool xtndbl1_hash_table_insert(Xtndbl1HashTable *table, int64 key);
 // returns true if found, false if not
 bool xtndbl1_hash_table_lookup(Xtndbl1HashTable *table, int64 key);
 
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool xtndbl1_hash_table_upsert(Xtndbl1HashTable *table, int64 key,
+	int64 value, MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool xtndbl1_hash_table_get(Xtndbl1HashTable *table, int64 key, int64 *value);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void xtndbl1_hash_table_lookup_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// xtndbl1_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void xtndbl1_hash_table_probe_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int xtndbl1_hash_table_insert_batch(Xtndbl1HashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int xtndbl1_hash_table_scan(Xtndbl1HashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void xtndbl1_hash_table_scan_ranges(Xtndbl1HashTable *table,
+	ScanCursor *cursors, int n);
+
+// xtndbl1_hash_table_scan(), untimed (see hash_table_probe_scan())
+int xtndbl1_hash_table_probe_scan(Xtndbl1HashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int xtndbl1_hash_table_nkeys(Xtndbl1HashTable *table);
+
 // print the contents of 'table' to stdout
 void xtndbl1_hash_table_print(Xtndbl1HashTable *table);
 
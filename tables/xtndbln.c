@@ -10,10 +10,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 
 #include "xtndbln.h"
+#include "xtnddir.h"
+#include "xtndbuild.h"
+#include "bucketscan.h"
+#include "prefetch.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 3
 
 /*
 
@@ -29,299 +39,624 @@
 
 #define EMPTY 0
 
-// macro to calculate the rightmost n bits of a number x
-#define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
+// buckets this deep are given overflow pages instead of being split again
+#define MAX_BUCKET_DEPTH 24
+
+// buckets start out with room for bucketsize keys, and can double their room
+// up to this many times before they have to be split
+#define MAX_CAPACITY_STEPS 2
+
+// new keys are held in a buffer of this many keys, and only inserted into
+// their buckets once the buffer fills up (or the table is printed etc.), in
+// hash value order so that each bucket gets all of its new keys together.
+// set to 0 to insert keys straight away
+#define INSERT_BUFFER_SIZE 64
+
+// lookups only search the insert buffer if a key with the same rightmost
+// log2(BUFFER_FILTER_BITS) hash value bits is waiting there, which they can
+// tell from a bitmap of this many bits. with the buffer full, a lookup for a
+// key that isn't there searches it about 6% of the time
+#define BUFFER_FILTER_BITS 1024
 
 // a bucket stores an array of keys
 // it also knows how many bits are shared between possible keys, and the first 
 // table address that references it
+// rather than splitting as soon as they fill up, buckets whose split wouldn't
+// make much room (see should_grow()) first get more room for keys (up to a
+// limit)
+// when more than bucketsize keys can't be told apart within MAX_BUCKET_DEPTH
+// hash value bits (e.g. keys with identical hash values), the rest are kept in
+// a chain of overflow pages, which are just more buckets with the same id
 typedef struct xtndbln_bucket {
 	int id;			// a unique id for this bucket, equal to the first address
 					// in the table which points to it
 	int depth;		// how many hash value bits are being used by this bucket
 	int nkeys;		// number of keys currently contained in this bucket
-	int64 *keys;	// the keys stored in this bucket
+	int capacity;	// number of keys this bucket has room for
+	int64 *keys;	// the keys stored in this bucket, which follow it in
+					// the same block of memory
+	int64 *values;	// the value stored with each key (kept apart from the
+					// keys, so that scans only read the keys)
+	unsigned char *tags;	// a tag for each key (see bucketscan.h), to
+							// rule out most keys without reading them, or
+							// NULL for bucket sizes which don't keep tags
+	struct xtndbln_bucket *overflow;	// next overflow page, or NULL if none
 } Bucket;
 
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
+	int noverflow;	// how many overflow pages are chained onto buckets
+	int ncapacity[MAX_CAPACITY_STEPS + 1];	// how many buckets have room for
+											// bucketsize * 2^i keys
 	int nkeys;		// how many keys are being stored in the table
 	int time;		// how much CPU time has been used to insert/lookup keys
 					// in this table
 } Stats;
-// a hash table is an array of slots pointing to buckets holding up to 
-// bucketsize keys, along with some information about the number of hash value 
-// bits to use for addressing
+
+// a key waiting in the insert buffer, along with its hash value bits reversed
+// (sorting by these puts keys for the same bucket next to each other)
+typedef struct pending {
+	unsigned int order;	// hash value with its rightmost bits first
+	int64 key;			// the key waiting to be inserted
+	int64 value;		// and its value
+} Pending;
+
+// the operations of one instance of xtndblntmpl.h: the table's untimed
+// operations which find or store keys in its buckets, for its bucket size
+// (the public functions below time them)
+typedef struct xtndbln_ops {
+	void (*init)(XtndblNHashTable *table);
+	void (*build)(XtndblNHashTable *table, const int64 *keys, int n,
+		bool unique);
+	void (*reserve)(XtndblNHashTable *table, int nkeys);
+	bool (*upsert)(XtndblNHashTable *table, int64 key, int64 value,
+		MergeFunction merge);
+	bool (*get)(XtndblNHashTable *table, int64 key, int64 *value);
+	void (*probe_batch)(XtndblNHashTable *table, const int64 *keys, int n,
+		unsigned char *found);
+	int (*insert_batch)(XtndblNHashTable *table, const int64 *keys, int n,
+		unsigned char *inserted);
+	void (*flush)(XtndblNHashTable *table);
+} XtndblNOps;
+
+// a hash table is a directory of slots pointing to buckets holding up to 
+// bucketsize keys. the directory keeps track of the number of hash value 
+// bits to use for addressing each part of the table
 struct xtndbln_table {
-	Bucket **buckets;	// array of pointers to buckets
-	int size;			// how many entries in the table of pointers (2^depth)
-	int depth;			// how many bits of the hash value to use (log2(size))
+	const XtndblNOps *ops;	// the operations for this table's bucket size
+	XtndDir *dir;		// directory of pointers to buckets
 	int bucketsize;		// maximum number of keys per bucket
+	Pending *buffer;	// keys waiting to be inserted into their buckets
+	int nbuffered;		// how many keys are in the buffer
+	unsigned char buffered[BUFFER_FILTER_BITS / 8];	// bit h is set if a key
+								// whose hash value ends in h is in the buffer
 	Stats stats;
 };
 
-// create a new bucket first referenced from 'first_address', based on 'depth'
-// bits of its keys' hash values
-static Bucket *new_bucket(int first_address, int depth, int bucketsize) {
-	// Create a new bucket
-	Bucket *bucket = malloc(sizeof *bucket);
-	assert(bucket);
-
-	// Create an array to hold keys
-	bucket->keys = malloc(sizeof(int64) * bucketsize);
-	assert(bucket->keys);
-
-	// Set bucket values to initial values
-	bucket->id = first_address;
-	bucket->depth = depth;
-	bucket->nkeys = 0;
-	return bucket;
-}
-
-// double the table of bucket pointers, duplicating the bucket pointers in the
-// first half into the new second half of the table
-static void double_table(XtndblNHashTable *table) {
-	int size = table->size * 2;
-	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
-
-	// get a new array of twice as many bucket pointers, and copy pointers down
-	table->buckets = realloc(table->buckets, (sizeof *table->buckets) * size);
-	assert(table->buckets);
-	int i;
-	for (i = 0; i < table->size; i++) {
-		table->buckets[table->size + i] = table->buckets[i];
+// which capacity step (0 for bucketsize, 1 for twice that, ...) is 'capacity'
+static int capacity_step(XtndblNHashTable *table, int capacity) {
+	int step = 0;
+	while ((table->bucketsize << step) < capacity) {
+		step++;
 	}
+	return step;
+}
 
-	// finally, increase the table size and the depth we are using to hash keys
-	table->size = size;
-	table->depth++;
+// the smallest capacity step with room for 'nkeys' keys (or the largest step,
+// if none have room)
+static int capacity_for(XtndblNHashTable *table, int nkeys) {
+	int step = capacity_step(table, nkeys);
+	if (step > MAX_CAPACITY_STEPS) {
+		step = MAX_CAPACITY_STEPS;
+	}
+	return table->bucketsize << step;
 }
 
+// should a full 'bucket' be given more room for a new key with hash value
+// 'hash', rather than being split? splitting is the better choice whenever the
+// keys would spread out between the two halves, unless the bucket is already
+// deeper than most, so that splitting it would take the directory deeper
+// just for its sake. if a split would leave most of the keys together
+// (e.g. in a hot part of the hash space), it makes little room, so the bucket
+// grows instead, as long as it still has capacity steps to go
+static bool should_grow(XtndblNHashTable *table, Bucket *bucket, int hash) {
+	if (bucket->capacity >= table->bucketsize << MAX_CAPACITY_STEPS) {
+		return false;
+	}
 
-// reinsert a key into the hash table after splitting a bucket --- we can assume
-// that there will definitely be space for this key because it was already
-// inside the hash table previously
-// use 'xtndbln_hash_table_insert()' instead for inserting new keys
-static void reinsert_key(XtndblNHashTable *table, int64 key) {
-	int address = rightmostnbits(table->depth, h1(key));
-	table->buckets[address]->keys[table->buckets[address]->nkeys] = key;
-	table->buckets[address]->nkeys++;
+	// how many keys would stay together with the new key after a split?
+	int nkeys = 1, ntogether = 1;
+	Bucket *page;
+	for (page = bucket; page; page = page->overflow) {
+		int i;
+		for (i = 0; i < page->nkeys; i++) {
+			ntogether += (((h1(page->keys[i]) ^ hash) >> bucket->depth) & 1) == 0;
+		}
+		nkeys += page->nkeys;
+	}
+	if (4 * ntogether > 3 * nkeys) {
+		return true;
+	}
+
+	// the keys would spread out, so split, unless that would grow the
+	// directory for a bucket that is already deeper than it would be if keys
+	// were spread evenly over buckets of bucketsize keys (with that many keys
+	// per bucket, there'd be nkeys / bucketsize of them, about log2 of that
+	// many bits deep)
+	return bucket->depth >= xtnd_dir_bits(table->dir, hash)
+		&& (int64)table->bucketsize << bucket->depth > table->stats.nkeys;
 }
 
-// split the bucket in 'table' at address 'address', growing table if necessary
-static void split_bucket(XtndblNHashTable *table, int address) {
-	// FIRST,
-	// do we need to grow the table?
-	if (table->buckets[address]->depth == table->depth) {
-		// yep, this bucket is down to its last pointer
-		double_table(table);
+// free 'bucket' along with all of its overflow pages
+static void free_bucket(Bucket *bucket) {
+	while (bucket) {
+		Bucket *next = bucket->overflow;
+		free(bucket);
+		bucket = next;
 	}
-	// either way, now it's time to split this bucket
-	
+}
 
-	// SECOND,
-	// create a new bucket and update both buckets' depth
-	Bucket *bucket = table->buckets[address];
-	int depth = bucket->depth;
-	int first_address = bucket->id;
-
-	int new_depth = depth + 1;
-	bucket->depth = new_depth;
-	// new bucket's first address will be a 1 bit plus the old first address
-	int new_first_address = 1 << depth | first_address;
-	//xtndbln_hash_table_print(table);
-	Bucket *newbucket = new_bucket(new_first_address, new_depth, table->bucketsize);
-	//xtndbln_hash_table_print(table);
-	table->stats.nbuckets++;
-	// THIRD,
-	// redirect every second address pointing to this bucket to the new bucket
-	// construct addresses by joining a bit 'prefix' and a bit 'suffix'
-	// (defined below)
-
-	// suffix: a 1 bit followed by the previous bucket bit address
-	int bit_address = rightmostnbits(depth, first_address);
-	int suffix = (1 << depth) | bit_address;
-
-	// prefix: all bitstrings of length equal to the difference between the new
-	// bucket depth and the table depth
-	// use a for loop to enumerate all possible prefixes less than maxprefix:
-	int maxprefix = 1 << (table->depth - new_depth);
-
-	int prefix;
-	for (prefix = 0; prefix < maxprefix; prefix++) {
-		
-		// construct address by joining this prefix and the suffix
-		int a = (prefix << new_depth) | suffix;
-
-		// redirect this table entry to point at the new bucket
-		table->buckets[a] = newbucket;
+// how many keys are in 'bucket' and its overflow pages
+static int bucket_nkeys(Bucket *bucket) {
+	int nkeys = 0;
+	for (; bucket; bucket = bucket->overflow) {
+		nkeys += bucket->nkeys;
+	}
+	return nkeys;
+}
+
+// find the first page in 'bucket's chain with space for another key, or
+// return NULL if they're all full
+static Bucket *page_with_space(XtndblNHashTable *table, Bucket *bucket) {
+	for (; bucket; bucket = bucket->overflow) {
+		if (bucket->nkeys < bucket->capacity) {
+			return bucket;
+		}
 	}
-	// FINALLY,
-	// filter the key from the old bucket into its rightful place in the new 
-	// table (which may be the old bucket, or may be the new bucket)
-
-	// remove and reinsert the key
-	// remove keys
-	int64 *keys = malloc(sizeof(int64) * table->bucketsize);
-	int count = bucket->nkeys;
+	return NULL;
+}
+
+// could splitting 'bucket' (perhaps a few times over) separate its keys from
+// a new key with hash value 'hash'? not if they all share the same rightmost
+// MAX_BUCKET_DEPTH hash value bits
+static bool can_split(Bucket *bucket, int hash) {
+	if (bucket->depth >= MAX_BUCKET_DEPTH) {
+		return false;
+	}
+	int diff = 0;
+	for (; bucket; bucket = bucket->overflow) {
+		int i;
+		for (i = 0; i < bucket->nkeys; i++) {
+			diff |= h1(bucket->keys[i]) ^ hash;
+		}
+	}
+	return (diff & ((1 << MAX_BUCKET_DEPTH) - 1)) != 0;
+}
+
+// the fewest hash value bits (up to MAX_BUCKET_DEPTH) which address enough
+// buckets to give 'nkeys' keys twice as much room as they need
+static int depth_for(XtndblNHashTable *table, int nkeys) {
+	return depth_for_room(2LL * nkeys, table->bucketsize, MAX_BUCKET_DEPTH);
+}
+
+// split_to_depth() helper: how many hash value bits the bucket for 'address'
+// uses
+static int bucket_depth(void *arg, int address) {
+	XtndblNHashTable *table = arg;
+	return (*(Bucket **)xtnd_dir_lookup(table->dir, address))->depth;
+}
+
+// reverse the 31 bits of hash value 'hash'
+static unsigned int reverse_bits(int hash) {
+	unsigned int reversed = 0;
 	int i;
-	for (i = count-1; i > -1; i--) {
-		keys[i] = bucket->keys[i];
-		bucket->nkeys--;
+	for (i = 0; i < 31; i++) {
+		reversed = reversed << 1 | ((hash >> i) & 1);
 	}
-	// reinsert keys
-	for (i = 0; i < count; i++) {
-		reinsert_key(table, keys[i]);
+	return reversed;
+}
+
+// qsort comparison function for ordering buffered keys by their buckets
+static int compare_pending(const void *a, const void *b) {
+	unsigned int x = ((const Pending *)a)->order;
+	unsigned int y = ((const Pending *)b)->order;
+	return (x > y) - (x < y);
+}
+
+// where is the value of 'key' (with hash value 'hash') in 'table's insert
+// buffer? returns NULL if 'key' isn't waiting there
+static int64 *buffer_value(XtndblNHashTable *table, int hash, int64 key) {
+	// most keys can be ruled out without searching the buffer
+	int bit = hash & (BUFFER_FILTER_BITS - 1);
+	if ((table->buffered[bit / 8] & 1 << (bit % 8)) == 0) {
+		return NULL;
+	}
+	int i;
+	for (i = 0; i < table->nbuffered; i++) {
+		if (table->buffer[i].key == key) {
+			return &table->buffer[i].value;
+		}
 	}
-	free(keys);
+	return NULL;
 }
 
+// directory walk helper: remember each bucket as we reach its first reference
+static void collect_bucket(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = *(Bucket **)entry;
+	Bucket ***next = arg;
+	if (bucket->id == address) {
+		*(*next)++ = bucket;
+	}
+}
+
+// directory walk helper: print a table entry and, at the first address at
+// which a bucket occurs, the bucket itself
+static void print_entry(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = *(Bucket **)entry;
+
+	// table entry
+	printf("%9d | %-9d ", address, bucket->id);
+
+	// if this is the first address at which a bucket occurs, print it now
+	if (bucket->id == address) {
+		printf("%9d ", bucket->id);
+
+		// print the bucket's contents
+		printf("[");
+		for(int j = 0; j < bucket->capacity; j++) {
+			if (j < bucket->nkeys) {
+				printf(" %llu", bucket->keys[j]);
+			} else {
+				printf(" -");
+			}
+		}
+		printf(" ]");
+
+		// and any overflow pages after it
+		Bucket *page;
+		for (page = bucket->overflow; page; page = page->overflow) {
+			printf(" +[");
+			for(int j = 0; j < page->nkeys; j++) {
+				printf(" %llu", page->keys[j]);
+			}
+			printf(" ]");
+		}
+	}
+	// end the line
+	printf("\n");
+}
 
 
+// an instance of the table's operations for each of the common bucket sizes,
+// whose searches go through a bucket's keys that many at a time with fully
+// unrolled loops, and a generic instance for any other size
+#define BUCKET_SLOTS 2
+#include "xtndblntmpl.h"
+#define BUCKET_SLOTS 4
+#include "xtndblntmpl.h"
+#define BUCKET_SLOTS 8
+#include "xtndblntmpl.h"
+#define BUCKET_SLOTS 16
+#include "xtndblntmpl.h"
+#define BUCKET_SLOTS 32
+#include "xtndblntmpl.h"
+#define BUCKET_SLOTS 0
+#include "xtndblntmpl.h"
+
+// the operations for buckets of 'bucketsize' keys
+static const XtndblNOps *ops_for(int bucketsize) {
+	switch (bucketsize) {
+		case 2:  return &xtndbln_ops_2;
+		case 4:  return &xtndbln_ops_4;
+		case 8:  return &xtndbln_ops_8;
+		case 16: return &xtndbln_ops_16;
+		case 32: return &xtndbln_ops_32;
+		default: return &xtndbln_ops_0;
+	}
+}
+
 
 // initialise an extendible hash table with 'bucketsize' keys per bucket
 XtndblNHashTable *new_xtndbln_hash_table(int bucketsize) {
 	// make a new table
 	// malloc table
 	// create a new bucket of depth bucketsize
-	XtndblNHashTable *table = malloc(sizeof(*table));
+	XtndblNHashTable *table = cache_line_alloc(sizeof *table);
 	assert(table);
 
 	// set initial values
-	table->size = 1;
-	table->buckets = malloc(sizeof *table->buckets);
-	assert(table->buckets);
-	table->depth = 0;
-	// make new bucket of bucketsize
-	table->buckets[0] = new_bucket(0, 0, bucketsize);
+	// make new bucket of bucketsize, and a directory pointing to it
+	table->ops = ops_for(bucketsize);
 	table->bucketsize = bucketsize;
+	table->ops->init(table);
+
+	// make space for the insert buffer (if there is one)
+	table->buffer = NULL;
+	if (INSERT_BUFFER_SIZE > 0) {
+		table->buffer = malloc(sizeof *table->buffer * INSERT_BUFFER_SIZE);
+		assert(table->buffer);
+	}
+	table->nbuffered = 0;
+	memset(table->buffered, 0, sizeof table->buffered);
 
 	table->stats.nbuckets = 1;
+	table->stats.noverflow = 0;
+	int i;
+	for (i = 0; i <= MAX_CAPACITY_STEPS; i++) {
+		table->stats.ncapacity[i] = 0;
+	}
+	table->stats.ncapacity[0] = 1;
 	table->stats.nkeys = 0;
 	table->stats.time = 0;
 	return table;
 }
 
 
+// build an n-key extendible hash table with bucket size 'bucketsize' holding
+// the 'n' keys in 'keys', from the bottom up: the keys are partitioned by
+// their hash values, and each bucket is made once, already holding its keys.
+// if 'unique' is true, the keys must all be different and aren't checked
+// returns the new table
+XtndblNHashTable *build_xtndbln_hash_table(int bucketsize, const int64 *keys,
+	int n, bool unique) {
+	assert(n >= 0);
+	int start_time = clock(); // start timing
+	XtndblNHashTable *table = new_xtndbln_hash_table(bucketsize);
+	table->ops->build(table, keys, n, unique);
+
+	table->stats.time += clock() - start_time;
+	return table;
+}
+
+
 // free all memory associated with 'table'
 void free_xtndbln_hash_table(XtndblNHashTable *table) {
 	assert(table);
-	// loop backwards through the array of pointers, freeing buckets only as we
-	// reach their first reference
-	// (if we loop through forwards, we wouldn't know which reference was last)
+	// gather up the buckets as we reach their first reference, and only free
+	// them once we're done (later references would point at freed buckets)
+	Bucket **buckets = malloc(sizeof *buckets * table->stats.nbuckets);
+	assert(buckets);
+	Bucket **next = buckets;
+	xtnd_dir_walk(table->dir, collect_bucket, &next);
 	int i;
-	for (i = table->size-1; i >= 0; i--) {
-		if (table->buckets[i]->id == i) {
-			free(table->buckets[i]->keys);
-			free(table->buckets[i]);
-		}
+	for (i = 0; i < table->stats.nbuckets; i++) {
+		free_bucket(buckets[i]);
 	}
+	free(buckets);
 
-	// free the array of bucket pointers
-	free(table->buckets);
+	// free the directory of bucket pointers, and the insert buffer
+	free_xtnd_dir(table->dir);
+	free(table->buffer);
 	
 	// free the table struct itself
-	free(table);
+	cache_line_free(table);
 }
 
 
 
-// insert 'key' into 'table', if it's not in there already
-// returns true if insertion succeeds, false if it was already in there
-bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key) {
+// make room in 'table' for 'nkeys' keys in total, by splitting it up front
+// into buckets which will be half full on average. the fuller buckets then
+// just get more room (see MAX_CAPACITY_STEPS) rather than splitting
+void xtndbln_hash_table_reserve(XtndblNHashTable *table, int nkeys) {
 	assert(table);
 	int start_time = clock(); // start timing
-	
-	// calculate table address
-	int hash = h1(key);
-	int address = rightmostnbits(table->depth, hash);
-	
-	// is this key already there?
-	int i;
-	for (i = 0; i < table->buckets[address]->nkeys; i++) {
-		if (table->buckets[address]->keys[i] == key) {
-			table->stats.time += clock() - start_time; // add time elapsed
-			return false;
-		}
-	} 
+	table->ops->reserve(table, nkeys);
+	table->stats.time += clock() - start_time;
+}
 
-	// if not, make space in the table until our target bucket has space
-	while (table->buckets[address]->nkeys == table->bucketsize) {
-		split_bucket(table, address);
 
-		// and recalculate address because we might now need more bits
-		address = rightmostnbits(table->depth, hash);
-	}
+// insert 'key' into 'table', if it's not in there already
+// returns true if insertion succeeds, false if it was already in there
+bool xtndbln_hash_table_insert(XtndblNHashTable *table, int64 key) {
+	return xtndbln_hash_table_upsert(table, key, 0, merge_keep);
+}
 
-	// there's now space! we can insert this key
-	table->buckets[address]->keys[table->buckets[address]->nkeys] = key;
-	table->buckets[address]->nkeys++;
-	table->stats.nkeys++;
 
-	// add time elapsed to total CPU time before returning
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool xtndbln_hash_table_upsert(XtndblNHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool inserted = table->ops->upsert(table, key, value, merge);
 	table->stats.time += clock() - start_time;
-	return true;
+	return inserted;
 }
 
 
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xtndbln_hash_table_lookup(XtndblNHashTable *table, int64 key) {
-	assert(table);
+	return xtndbln_hash_table_get(table, key, NULL);
+}
+
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool xtndbln_hash_table_get(XtndblNHashTable *table, int64 key,
+	int64 *value) {
+	assert(table != NULL);
 	int start_time = clock(); // start timing
+	bool found = table->ops->get(table, key, value);
+	table->stats.time += clock() - start_time;
+	return found;
+}
 
-	// calculate table address for this key
-	int address = rightmostnbits(table->depth, h1(key));
-	
-	// look for the key in that bucket (unless it's empty)
-	bool found = false;
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void xtndbln_hash_table_lookup_batch(XtndblNHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	xtndbln_hash_table_probe_batch(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
+
+
+// the untimed lookup_batch, for probing from several threads at once
+void xtndbln_hash_table_probe_batch(XtndblNHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	table->ops->probe_batch(table, keys, n, found);
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int xtndbln_hash_table_insert_batch(XtndblNHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = table->ops->insert_batch(table, keys, n, inserted);
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int xtndbln_hash_table_scan(XtndblNHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	// make sure all keys are in their buckets before scanning them
+	table->ops->flush(table);
+
+	int n = xtndbln_hash_table_probe_scan(table, cursor, keys, values, max);
+
+	table->stats.time += clock() - start_time;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void xtndbln_hash_table_scan_ranges(XtndblNHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+
+	// make sure all keys are in their buckets before scanning them
+	table->ops->flush(table);
+
+	// positions are split up evenly, and then each split is moved past the
+	// bucket it falls in the middle of, if any
+	int64 end = 1LL << SCAN_BITS;
+	scan_split(cursors, n, end);
 	int i;
-	for (i = 0; i < table->buckets[address]->nkeys; i++) {
-		if (table->buckets[address]->keys[i] == key) {
-			// found it!
-			found = true;
-		}
+	for (i = 1; i < n; i++) {
+		Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir,
+			scan_address(cursors[i].pos));
+		scan_align_split(cursors, i, bucket->depth);
 	}
+	scan_skip_empty(cursors, n, end);
 
-	// add time elapsed to total CPU time before returning result
 	table->stats.time += clock() - start_time;
-	return found;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int xtndbln_hash_table_probe_scan(XtndblNHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+	assert(table->nbuffered == 0);
+
+	// visit each bucket once, in scan order (see cursor.h)
+	int n = 0;
+	while (n < max && cursor->pos != SCAN_DONE) {
+		Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir,
+			scan_address(cursor->pos));
+
+		// if the last chunk stopped partway through this bucket and it has
+		// changed since, go back over it from the start
+		if (cursor->skip > 0 && !scan_can_resume(cursor,
+			bucket_nkeys(bucket), bucket->depth)) {
+			cursor->skip = 0;
+		}
+
+		// copy the keys in the bucket (and its overflow pages) that haven't
+		// been returned yet, as long as there's room for them
+		int i = 0;
+		Bucket *page;
+		for (page = bucket; page; page = page->overflow) {
+			int j;
+			for (j = 0; j < page->nkeys && n < max; j++, i++) {
+				if (i >= cursor->skip) {
+					keys[n] = page->keys[j];
+					if (values) {
+						values[n] = page->values[j];
+					}
+					n++;
+				}
+			}
+			if (j < page->nkeys) {
+				break;
+			}
+		}
+
+		// ran out of room partway through the bucket? pick up here next time
+		if (page) {
+			cursor->skip = i;
+			cursor->nkeys = bucket_nkeys(bucket);
+			cursor->depth = bucket->depth;
+			break;
+		}
+		cursor->skip = 0;
+
+		// start loading the directory entry for a bucket further ahead, and
+		// the bucket whose entry was started on half as far back
+		int64 ahead = scan_ahead(cursor->pos, bucket->depth, SCAN_AHEAD);
+		if (ahead >> SCAN_BITS == 0) {
+			xtnd_dir_prefetch(table->dir, scan_address(ahead));
+		}
+		ahead = scan_ahead(cursor->pos, bucket->depth, SCAN_AHEAD / 2);
+		if (ahead >> SCAN_BITS == 0) {
+			prefetch(*(Bucket **)xtnd_dir_lookup(table->dir,
+				scan_address(ahead)));
+		}
+
+		cursor->pos = scan_next(cursor->pos, bucket->depth);
+		if (cursor->pos >= scan_end(cursor, 1LL << SCAN_BITS)) {
+			cursor->pos = SCAN_DONE;
+		}
+	}
+
+	return n;
+}
+
+
+// how many keys are in 'table'
+int xtndbln_hash_table_nkeys(XtndblNHashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
 }
 
 
 // print the contents of 'table' to stdout
 void xtndbln_hash_table_print(XtndblNHashTable *table) {
 	assert(table);
-	printf("--- table size: %d\n", table->size);
+
+	// make sure all keys are in their buckets before printing them
+	int start_time = clock();
+	table->ops->flush(table);
+	table->stats.time += clock() - start_time;
+
+	printf("--- table size: %d\n", xtnd_dir_size(table->dir));
 
 	// print header
 	printf("  table:               buckets:\n");
 	printf("  address | bucketid   bucketid [key]\n");
 	
 	// print table and buckets
-	int i;
-	for (i = 0; i < table->size; i++) {
-		// table entry
-		printf("%9d | %-9d ", i, table->buckets[i]->id);
-
-		// if this is the first address at which a bucket occurs, print it now
-		if (table->buckets[i]->id == i) {
-			printf("%9d ", table->buckets[i]->id);
-
-			// print the bucket's contents
-			printf("[");
-			for(int j = 0; j < table->bucketsize; j++) {
-				if (j < table->buckets[i]->nkeys) {
-					printf(" %llu", table->buckets[i]->keys[j]);
-				} else {
-					printf(" -");
-				}
-			}
-			printf(" ]");
-		}
-		// end the line
-		printf("\n");
-	}
+	xtnd_dir_walk(table->dir, print_entry, NULL);
 
 	printf("--- end table ---\n");
 }
@@ -331,12 +666,25 @@ void xtndbln_hash_table_print(XtndblNHashTable *table) {
 void xtndbln_hash_table_stats(XtndblNHashTable *table) {
 	assert(table);
 
+	// make sure all keys are in their buckets before counting them up
+	int start_time = clock();
+	table->ops->flush(table);
+	table->stats.time += clock() - start_time;
+
 	printf("--- table stats ---\n");
 
 	// print some stats about state of the table
-	printf("current table size: %d\n", table->size);
+	printf("current table size: %d\n", xtnd_dir_size(table->dir));
+	printf("   directory depth: %d\n", xtnd_dir_depth(table->dir));
+	printf("   directory nodes: %d\n", xtnd_dir_nnodes(table->dir));
 	printf("    number of keys: %d\n", table->stats.nkeys);
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
+	printf("    overflow pages: %d\n", table->stats.noverflow);
+	int i;
+	for (i = 0; i <= MAX_CAPACITY_STEPS; i++) {
+		printf("   %3d-key buckets: %d\n", table->bucketsize << i, 
+			table->stats.ncapacity[i]);
+	}
 
 	// also calculate CPU usage in seconds and print this
 	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
@@ -0,0 +1,420 @@
+/* * * * * * * * *
+ * Template for the xtndbln table's operations which find or store keys in
+ * its buckets (see xtndbln.c), for buckets of BUCKET_SLOTS keys, or of any
+ * size if BUCKET_SLOTS is 0. buckets which have grown (or have overflow
+ * pages) are looked through BUCKET_SLOTS keys at a time. each instance fills
+ * in a XtndblNOps with its operations
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+// (no include guard: xtndbln.c includes this once for every instance)
+
+#define new_bucket		SIZED(new_bucket)
+#define resize_bucket	SIZED(resize_bucket)
+#define bucket_value	SIZED(bucket_value)
+#define bucket_add_key	SIZED(bucket_add_key)
+#define reinsert_key	SIZED(reinsert_key)
+#define split_bucket	SIZED(split_bucket)
+#define split_address	SIZED(split_address)
+#define build_bucket	SIZED(build_bucket)
+#define insert_key		SIZED(insert_key)
+#define flush_buffer	SIZED(flush_buffer)
+#define prefetch_key	SIZED(prefetch_key)
+#define upsert_key		SIZED(upsert_key)
+#define get_key			SIZED(get_key)
+#define init_table		SIZED(init_table)
+#define build_table		SIZED(build_table)
+#define reserve_table	SIZED(reserve_table)
+#define probe_keys		SIZED(probe_keys)
+#define insert_keys		SIZED(insert_keys)
+#define xtndbln_ops		SIZED(xtndbln_ops)
+
+// every instance shares the one Bucket type, whose keys, values (and tags)
+// follow it in the same block of memory
+#undef BUCKET_ARRAYS
+#define BUCKET_ARRAYS 0
+
+#include "buckettmpl.h"
+
+// create a new bucket first referenced from 'first_address', based on 'depth'
+// bits of its keys' hash values, with room for 'capacity' keys
+static Bucket *new_bucket(int first_address, int depth, int capacity) {
+	// (zeroed, keys, values, tags and all, so that slots out of use never
+	// hold leftover memory: searches read whole blocks of keys or tags)
+	Bucket *bucket = alloc_bucket(capacity);
+	bucket->id = first_address;
+	bucket->depth = depth;
+	bucket->nkeys = 0;
+	bucket->capacity = capacity;
+	bucket->overflow = NULL;
+	return bucket;
+}
+
+// replace 'bucket' with a copy with room for 'capacity' keys (it must already
+// fit its keys), pointing its addresses in the directory at the copy
+// returns the copy
+static Bucket *resize_bucket(XtndblNHashTable *table, Bucket *bucket,
+	int capacity) {
+	assert(bucket->nkeys <= capacity);
+	table->stats.ncapacity[capacity_step(table, bucket->capacity)]--;
+	table->stats.ncapacity[capacity_step(table, capacity)]++;
+
+	// the keys are kept in the same block of memory as the bucket, so it
+	// moves as a whole (any slots gained start out zeroed)
+	Bucket *resized = new_bucket(bucket->id, bucket->depth, capacity);
+	memcpy(resized->keys, bucket->keys, sizeof(int64) * bucket->nkeys);
+	memcpy(resized->values, bucket->values, sizeof(int64) * bucket->nkeys);
+#if BUCKET_TAGS
+	memcpy(resized->tags, bucket->tags, bucket->nkeys);
+#endif
+	resized->nkeys = bucket->nkeys;
+	resized->overflow = bucket->overflow;
+	xtnd_dir_assign(table->dir, bucket->id, bucket->depth, &resized);
+	free(bucket);
+	return resized;
+}
+
+// where is the value of 'key' stored, in 'bucket' or any of its overflow
+// pages? returns NULL if 'key' isn't there
+static int64 *bucket_value(XtndblNHashTable *table, Bucket *bucket,
+	int64 key) {
+	for (; bucket; bucket = bucket->overflow) {
+		int i = find_slot(bucket, key);
+		if (i >= 0) {
+			return &bucket->values[i];
+		}
+	}
+	return NULL;
+}
+
+// store 'key' and its value in the first page of 'bucket's chain with space,
+// adding a new overflow page to the chain if there is no space
+static void bucket_add_key(XtndblNHashTable *table, Bucket *bucket, int64 key,
+	int64 value) {
+	Bucket *page = page_with_space(table, bucket);
+	if (page == NULL) {
+		page = new_bucket(bucket->id, bucket->depth, table->bucketsize);
+		page->overflow = bucket->overflow;
+		bucket->overflow = page;
+		table->stats.noverflow++;
+	}
+	bucket_put(page, page->nkeys, key, value);
+}
+
+// reinsert a key into the hash table after splitting a bucket --- we can assume
+// that this key is not already in the table, and that it belongs in an overflow
+// page if there's no space for it
+// use 'xtndbln_hash_table_upsert()' instead for inserting new keys
+static void reinsert_key(XtndblNHashTable *table, int64 key, int64 value) {
+	Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir, h1(key));
+	bucket_add_key(table, bucket, key, value);
+}
+
+// split 'bucket' in 'table', growing the directory where necessary
+static void split_bucket(XtndblNHashTable *table, Bucket *bucket) {
+	// FIRST,
+	// work out how many of the keys in the bucket (and its overflow pages)
+	// go to each half
+	int depth = bucket->depth;
+	int count = 0, nnew = 0;
+	Bucket *page;
+	for (page = bucket; page; page = page->overflow) {
+		int i;
+		for (i = 0; i < page->nkeys; i++) {
+			nnew += (h1(page->keys[i]) >> depth) & 1;
+		}
+		count += page->nkeys;
+		if (page != bucket) {
+			table->stats.noverflow--;
+		}
+	}
+
+	// SECOND,
+	// create two new buckets one bit deeper, each with just enough room for
+	// the keys it's about to receive. the new bucket's first address will be
+	// a 1 bit plus the old first address
+	int first_address = bucket->id;
+	int new_first_address = 1 << depth | first_address;
+	int new_depth = depth + 1;
+	int capacity = capacity_for(table, count - nnew);
+	int new_capacity = capacity_for(table, nnew);
+	Bucket *oldhalf = new_bucket(first_address, new_depth, capacity);
+	Bucket *newhalf = new_bucket(new_first_address, new_depth, new_capacity);
+	table->stats.ncapacity[capacity_step(table, bucket->capacity)]--;
+	table->stats.ncapacity[capacity_step(table, capacity)]++;
+	table->stats.ncapacity[capacity_step(table, new_capacity)]++;
+	table->stats.nbuckets++;
+
+	// THIRD,
+	// point the addresses of the old bucket at the two halves: every second
+	// one goes to the new bucket, those whose rightmost 'new_depth' bits
+	// match the new first address (the directory takes care of growing if it
+	// needs to)
+	xtnd_dir_assign(table->dir, first_address, new_depth, &oldhalf);
+	xtnd_dir_assign(table->dir, new_first_address, new_depth, &newhalf);
+
+	// FINALLY,
+	// reinsert the keys, and free the old bucket and its overflow pages
+	for (page = bucket; page; page = page->overflow) {
+		int i;
+		for (i = 0; i < page->nkeys; i++) {
+			reinsert_key(table, page->keys[i], page->values[i]);
+		}
+	}
+	free_bucket(bucket);
+}
+
+// split_to_depth() helper: split the bucket for 'address'
+static void split_address(void *arg, int address) {
+	XtndblNHashTable *table = arg;
+	split_bucket(table, *(Bucket **)xtnd_dir_lookup(table->dir, address));
+}
+
+// put the 'n' keys in 'keys' (whose hash values all end in the rightmost
+// 'depth' bits of 'pattern') into a new bucket for those addresses, with just
+// enough room for them. if that's more room than a bucket can have, and a
+// split could tell them apart, build two buckets one bit deeper instead
+// (reordering 'keys')
+static void build_bucket(void *arg, int64 *keys, int n, int pattern,
+	int depth) {
+	XtndblNHashTable *table = arg;
+	if (n > table->bucketsize << MAX_CAPACITY_STEPS
+		&& depth < MAX_BUCKET_DEPTH
+		&& keys_can_split(keys, n, MAX_BUCKET_DEPTH)) {
+		int nzero = split_keys(keys, n, depth);
+		build_bucket(table, keys, nzero, pattern, depth + 1);
+		build_bucket(table, keys + nzero, n - nzero, 1 << depth | pattern,
+			depth + 1);
+		return;
+	}
+
+	int capacity = capacity_for(table, n);
+	Bucket *bucket = new_bucket(pattern, depth, capacity);
+	xtnd_dir_assign(table->dir, pattern, depth, &bucket);
+	table->stats.ncapacity[capacity_step(table, capacity)]++;
+	table->stats.nbuckets++;
+	int i;
+	for (i = 0; i < n; i++) {
+		bucket_add_key(table, bucket, keys[i], 0);
+	}
+	table->stats.nkeys += n;
+}
+
+// insert a key which is not already in the table into its bucket, making
+// space for it if necessary
+static void insert_key(XtndblNHashTable *table, int64 key, int64 value) {
+	// find the bucket for this key
+	int hash = h1(key);
+	Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+
+	// make space in the table until our target bucket has space:
+	// by giving the bucket more room if splitting it isn't worth it (see
+	// should_grow()) or can't tell this key apart from the others, otherwise
+	// by splitting
+	while (page_with_space(table, bucket) == NULL) {
+		if (should_grow(table, bucket, hash)) {
+			resize_bucket(table, bucket, bucket->capacity * 2);
+		} else if (can_split(bucket, hash)) {
+			split_bucket(table, bucket);
+		} else if (bucket->capacity < table->bucketsize << MAX_CAPACITY_STEPS) {
+			resize_bucket(table, bucket, bucket->capacity * 2);
+		} else {
+			// no more room to be made: this key goes in an overflow page
+			break;
+		}
+
+		// and look the bucket up again because we might now need more bits
+		bucket = *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+	}
+
+	// there's now space (or this key goes in an overflow page)! insert it
+	bucket_add_key(table, bucket, key, value);
+}
+
+// insert all of the keys waiting in 'table's insert buffer, bucket by bucket
+static void flush_buffer(XtndblNHashTable *table) {
+	if (table->nbuffered == 0) {
+		return;
+	}
+
+	// sorting by reversed hash value groups the keys by their rightmost hash
+	// value bits, i.e. by the buckets they're going to, however deep those are
+	qsort(table->buffer, table->nbuffered, sizeof *table->buffer,
+		compare_pending);
+
+	int i;
+	for (i = 0; i < table->nbuffered; i++) {
+		insert_key(table, table->buffer[i].key, table->buffer[i].value);
+	}
+	table->nbuffered = 0;
+	memset(table->buffered, 0, sizeof table->buffered);
+}
+
+// start loading the memory that looking up 'key' will need at stage 'stage':
+// 3 for its directory entry, 2 for its bucket, and 1 for the bucket's keys
+// (and tags), which follow it (each stage reads what the stage before it
+// loaded)
+static void prefetch_key(XtndblNHashTable *table, int64 key, int stage) {
+	int hash = h1(key);
+	if (stage == 3) {
+		xtnd_dir_prefetch(table->dir, hash);
+		return;
+	}
+	Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+	if (stage == 2) {
+		prefetch(bucket);
+	} else {
+#if BUCKET_TAGS
+		prefetch(bucket->tags);
+#endif
+		prefetch(bucket->keys);
+	}
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in xtndbln_hash_table_upsert(), but untimed)
+static bool upsert_key(XtndblNHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	// find the bucket for this key
+	int hash = h1(key);
+	Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+
+	// is this key already there (or on its way)? then just update its value
+	int64 *stored = bucket_value(table, bucket, key);
+	if (stored == NULL) {
+		stored = buffer_value(table, hash, key);
+	}
+	if (stored) {
+		*stored = merge(*stored, value);
+		return false;
+	}
+
+	if (INSERT_BUFFER_SIZE > 0) {
+		// if not, add it to the buffer, inserting the whole buffer once full
+		table->buffer[table->nbuffered].order = reverse_bits(hash);
+		table->buffer[table->nbuffered].key = key;
+		table->buffer[table->nbuffered].value = value;
+		table->nbuffered++;
+		set_bit(table->buffered, hash & (BUFFER_FILTER_BITS - 1), true);
+		if (table->nbuffered == INSERT_BUFFER_SIZE) {
+			flush_buffer(table);
+		}
+	} else {
+		// or insert it straight away if there's no buffer
+		insert_key(table, key, value);
+	}
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in xtndbln_hash_table_get(), but untimed)
+static bool get_key(XtndblNHashTable *table, int64 key,
+	int64 *value) {
+	// find the bucket for this key
+	int hash = h1(key);
+	Bucket *bucket = *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+
+	// look for the key in that bucket (unless it's empty) and its overflow
+	// pages (usually there are none), and then in the insert buffer
+	int64 *stored = bucket_value(table, bucket, key);
+	if (stored == NULL) {
+		stored = buffer_value(table, hash, key);
+	}
+	if (stored && value) {
+		*value = *stored;
+	}
+
+	return stored != NULL;
+}
+
+// give a new 'table' its first bucket, and a directory pointing to it
+static void init_table(XtndblNHashTable *table) {
+	Bucket *bucket = new_bucket(0, 0, table->bucketsize);
+	table->dir = new_xtnd_dir(sizeof bucket, &bucket);
+}
+
+// build the buckets of a new, empty 'table' for the 'n' keys in 'keys' (see
+// build_xtndbln_hash_table())
+static void build_table(XtndblNHashTable *table, const int64 *keys, int n,
+	bool unique) {
+	// every address gets a new bucket, so the table's first bucket can go
+	free_bucket(*(Bucket **)xtnd_dir_lookup(table->dir, 0));
+	table->stats.nbuckets = 0;
+	table->stats.ncapacity[0] = 0;
+
+	// start from as many buckets as xtndbln_hash_table_reserve() would
+	build_buckets(table, keys, n, depth_for(table, n), unique, build_bucket);
+}
+
+// make room in 'table' for 'nkeys' keys in total (as in
+// xtndbln_hash_table_reserve(), but untimed)
+static void reserve_table(XtndblNHashTable *table, int nkeys) {
+	split_to_depth(table, depth_for(table, nkeys), bucket_depth,
+		split_address);
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+// (as in xtndbln_hash_table_probe_batch())
+static void probe_keys(XtndblNHashTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
+		}
+	}
+}
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted (as in
+// xtndbln_hash_table_insert_batch(), but untimed)
+static int insert_keys(XtndblNHashTable *table, const int64 *keys, int n,
+	unsigned char *inserted) {
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
+	}
+	return ninserted;
+}
+
+// this instance's operations
+static const XtndblNOps xtndbln_ops = {
+	.init = init_table,
+	.build = build_table,
+	.reserve = reserve_table,
+	.upsert = upsert_key,
+	.get = get_key,
+	.probe_batch = probe_keys,
+	.insert_batch = insert_keys,
+	.flush = flush_buffer,
+};
+
+#undef BUCKET_SLOTS
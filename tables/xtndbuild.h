@@ -0,0 +1,144 @@
+/* * * * * * * * *
+ * Sizing and building extendible hash tables (xtndbl1.c, xtndbln.c, xuckoo.c
+ * and xuckoon.c) ahead of time: how many hash value bits to start from for a
+ * number of keys, splitting every bucket down to that many bits, and sorting
+ * keys out by their hash values to build the buckets from the bottom up
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef XTNDBUILD_H
+#define XTNDBUILD_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "../inthash.h"
+
+// the fewest hash value bits (up to 'max_depth') which address enough buckets
+// of 'bucketsize' keys to have room for 'room' keys
+static inline int depth_for_room(int64 room, int bucketsize, int max_depth) {
+	int depth = 0;
+	while (depth < max_depth && (1LL << depth) * bucketsize < room) {
+		depth++;
+	}
+	return depth;
+}
+
+// split the buckets of 'table' until every bucket uses at least 'depth' hash
+// value bits. 'bucket_depth(table, address)' is how many bits the bucket for
+// 'address' uses, and 'split(table, address)' splits that bucket
+static inline void split_to_depth(void *table, int depth,
+	int (*bucket_depth)(void *table, int address),
+	void (*split)(void *table, int address)) {
+	int address;
+	for (address = 0; address < 1 << depth; address++) {
+		while (bucket_depth(table, address) < depth) {
+			split(table, address);
+		}
+	}
+}
+
+// compare two keys, for sorting them with qsort()
+static inline int compare_keys(const void *a, const void *b) {
+	int64 x = *(const int64 *)a;
+	int64 y = *(const int64 *)b;
+	return (x > y) - (x < y);
+}
+
+// copy the 'n' keys in 'keys' into a new array, sorted (with a counting sort)
+// by the rightmost 'depth' bits of their (h1) hash values. the keys for
+// address a end just before sorted[end[a]] (and start at end[a - 1], or 0).
+// unless 'unique' is true, repeated keys are dropped, and 'end' accounts for
+// that
+static inline int64 *partition_keys(const int64 *keys, int n, int depth,
+	int **end, bool unique) {
+	int naddresses = 1 << depth;
+	int mask = naddresses - 1;
+	*end = calloc(naddresses, sizeof **end);
+	assert(*end);
+	int64 *sorted = malloc(sizeof *sorted * (n > 0 ? n : 1));
+	assert(sorted);
+
+	int i, address;
+	for (i = 0; i < n; i++) {
+		(*end)[h1(keys[i]) & mask]++;
+	}
+	int total = 0;
+	for (address = 0; address < naddresses; address++) {
+		total += (*end)[address];
+		(*end)[address] = total - (*end)[address];
+	}
+	for (i = 0; i < n; i++) {
+		sorted[(*end)[h1(keys[i]) & mask]++] = keys[i];
+	}
+
+	// repeated keys share an address, so sort each address's keys and then
+	// squeeze out the repeats, moving everything after them down
+	if (!unique) {
+		int kept = 0;
+		i = 0;
+		for (address = 0; address < naddresses; address++) {
+			int first = kept;
+			if ((*end)[address] - i > 1) {
+				qsort(sorted + i, (*end)[address] - i, sizeof *sorted,
+					compare_keys);
+			}
+			for (; i < (*end)[address]; i++) {
+				if (kept == first || sorted[i] != sorted[kept - 1]) {
+					sorted[kept++] = sorted[i];
+				}
+			}
+			(*end)[address] = kept;
+		}
+	}
+	return sorted;
+}
+
+// build the buckets of 'table' for the 'n' keys in 'keys', starting from
+// 'depth' hash value bits: the keys are partitioned by address (see
+// 'partition_keys()'), and 'build(table, keys, n, pattern, depth)' is called
+// for each address's keys, where 'pattern' is the address. 'build' may
+// reorder the keys it's given
+static inline void build_buckets(void *table, const int64 *keys, int n,
+	int depth, bool unique,
+	void (*build)(void *table, int64 *keys, int n, int pattern, int depth)) {
+	int *end;
+	int64 *sorted = partition_keys(keys, n, depth, &end, unique);
+	int address, first = 0;
+	for (address = 0; address < 1 << depth; address++) {
+		build(table, sorted + first, end[address] - first, address, depth);
+		first = end[address];
+	}
+	free(end);
+	free(sorted);
+}
+
+// reorder the 'n' keys in 'keys' so that those whose (h1) hash values have a
+// 0 at bit 'bit' come first. returns how many of them there are
+static inline int split_keys(int64 *keys, int n, int bit) {
+	int nzero = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		if (((h1(keys[i]) >> bit) & 1) == 0) {
+			int64 key = keys[i];
+			keys[i] = keys[nzero];
+			keys[nzero++] = key;
+		}
+	}
+	return nzero;
+}
+
+// could a bucket be split to tell the 'n' keys in 'keys' apart? not if they
+// all share the same rightmost 'max_depth' (h1) hash value bits
+static inline bool keys_can_split(const int64 *keys, int n, int max_depth) {
+	unsigned int diff = 0;
+	int i;
+	for (i = 1; i < n; i++) {
+		diff |= h1(keys[i]) ^ h1(keys[0]);
+	}
+	return (diff & ((1u << max_depth) - 1)) != 0;
+}
+
+#endif
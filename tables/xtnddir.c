@@ -0,0 +1,588 @@
+/* * * * * * * * *
+ * Multi-level directory for extendible hash tables: maps the rightmost bits of
+ * a hash value onto a directory entry (e.g. a bucket pointer), using a radix
+ * trie over the hash bits so that only the parts of the hash space which need
+ * more bits get expanded
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ * Uses code retrieved from xtndbl1.c created by
+ * Matt Farrugia <matt.farrugia@unimelb.edu.au>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "xtnddir.h"
+#include "prefetch.h"
+
+// macro to calculate the rightmost n bits of a number x
+#define rightmostnbits(n, x) ((x) & ((1u << (n)) - 1))
+
+// a segment is a block of up to 2^DIR_SEGMENT_BITS consecutive entries of a
+// node. when a node doubles, its new upper half starts out sharing the
+// segments of its lower half, and a shared segment is only copied once one of
+// its entries is about to be overwritten (copy-on-write). this way, doubling
+// a node costs one pointer per segment rather than one copy per entry
+// (entries are stored as int64s just to keep them suitably aligned)
+typedef struct dir_segment {
+	int refs;			// how many places in the node(s) refer to this segment
+	int64 entries[];	// the entries themselves
+} DirSegment;
+
+// a node is a small extendible directory of its own, resolving up to
+// DIR_LEVEL_BITS more hash value bits after the 'shift' bits resolved by the
+// nodes above it. a node only resolves another bit while it stays dense (see
+// DIR_NODE_SLACK_BYTES): otherwise, an entry which needs more bits is replaced by a
+// child node, so a few deep entries don't make the whole node double
+// only a few entries of a node have children, so rather than a pointer per
+// entry, a node marks those entries in a bitmap and keeps just their children,
+// in order: the child of entry i comes after as many children as there are
+// marked entries before i (see child_of())
+typedef struct dir_node {
+	int shift;			// how many hash value bits are resolved above this node
+	int depth;			// how many more bits this node resolves (log2(size))
+	int units;			// how many distinct entries (e.g. buckets) it holds,
+						// counting each entry with a child once
+	DirSegment **segments;	// the node's 2^depth entries, in segments
+	DirSegment *first;	// the node's only segment, while it has just one
+						// ('segments' then points here, saving an allocation
+						// for each of the many small nodes)
+	int64 *haschild;	// bit i % 64 of haschild[i / 64] is set if entry i has
+						// a child node, or NULL if this node has no children
+	int *rank;			// how many children belong to the entries before
+						// each word of 'haschild'
+	int nchildren;		// how many child nodes this node has
+	struct dir_node **children;	// the child nodes, in order of their entries
+} DirNode;
+
+// a directory is a trie of nodes, along with some information about its size
+struct xtnd_dir {
+	DirNode *root;		// the node resolving the rightmost bits
+	int entrysize;		// how many bytes each entry takes up
+	int slack;			// how many entries a node may hold for each unit
+						// (see DIR_NODE_SLACK_BYTES)
+	int size;			// how many entries across all nodes
+	int depth;			// the most bits resolved for any address
+	int nnodes;			// how many nodes in the trie
+};
+
+
+/* * * *
+ * helper functions
+ */
+
+// how many entries each segment of 'node' holds, and how many segments it has
+static int segment_size(DirNode *node) {
+	return node->depth < DIR_SEGMENT_BITS ? 1 << node->depth
+		: 1 << DIR_SEGMENT_BITS;
+}
+static int nsegments(DirNode *node) {
+	return node->depth < DIR_SEGMENT_BITS ? 1
+		: 1 << (node->depth - DIR_SEGMENT_BITS);
+}
+
+// how many words of 'haschild' 'node' needs: one bit for each entry
+static int nwords(DirNode *node) {
+	return ((1 << node->depth) + 63) / 64;
+}
+
+// the child node of entry 'i' of 'node', or NULL if it has none
+static DirNode *child_of(DirNode *node, int i) {
+	if (node->haschild == NULL) {
+		return NULL;
+	}
+	int64 word = node->haschild[i / 64];
+	int64 bit = 1ULL << (i % 64);
+	if ((word & bit) == 0) {
+		return NULL;
+	}
+	return node->children[node->rank[i / 64]
+		+ __builtin_popcountll(word & (bit - 1))];
+}
+
+// give entry 'i' of 'node' (which has no child yet) the child node 'child'
+static void insert_child(DirNode *node, int i, DirNode *child) {
+	if (node->haschild == NULL) {
+		node->haschild = calloc(nwords(node), sizeof *node->haschild);
+		node->rank = calloc(nwords(node), sizeof *node->rank);
+		assert(node->haschild && node->rank);
+	}
+	int64 bit = 1ULL << (i % 64);
+	assert((node->haschild[i / 64] & bit) == 0);
+	int at = node->rank[i / 64]
+		+ __builtin_popcountll(node->haschild[i / 64] & (bit - 1));
+
+	// make room in the list of children, and account for the new one in the
+	// ranks of the words after it
+	node->children = realloc(node->children,
+		sizeof *node->children * (node->nchildren + 1));
+	assert(node->children);
+	memmove(node->children + at + 1, node->children + at,
+		sizeof *node->children * (node->nchildren - at));
+	node->children[at] = child;
+	node->nchildren++;
+	node->haschild[i / 64] |= bit;
+	int w;
+	for (w = i / 64 + 1; w < nwords(node); w++) {
+		node->rank[w]++;
+	}
+}
+
+// forget all of the children of 'node' (but don't free them)
+static void clear_children(DirNode *node) {
+	free(node->haschild);
+	free(node->rank);
+	free(node->children);
+	node->haschild = NULL;
+	node->rank = NULL;
+	node->nchildren = 0;
+	node->children = NULL;
+}
+
+// create a new (unshared) segment with space for 'size' entries
+static DirSegment *new_segment(XtndDir *dir, int size) {
+	DirSegment *segment = malloc(sizeof *segment
+		+ (size_t)dir->entrysize * size);
+	assert(segment);
+	segment->refs = 1;
+	return segment;
+}
+
+// return a pointer to entry 'i' of 'node' (for reading only)
+static char *node_entry(XtndDir *dir, DirNode *node, int i) {
+	DirSegment *segment = node->segments[i >> DIR_SEGMENT_BITS];
+	return (char *)segment->entries
+		+ (size_t)dir->entrysize * rightmostnbits(DIR_SEGMENT_BITS, i);
+}
+
+// return a pointer to entry 'i' of 'node' for writing, first taking a private
+// copy of its segment if it is still shared with another part of the node
+static char *node_entry_for_writing(XtndDir *dir, DirNode *node, int i) {
+	DirSegment **segment = &node->segments[i >> DIR_SEGMENT_BITS];
+	if ((*segment)->refs > 1) {
+		int size = segment_size(node);
+		DirSegment *copy = new_segment(dir, size);
+		memcpy(copy->entries, (*segment)->entries,
+			(size_t)dir->entrysize * size);
+		(*segment)->refs--;
+		*segment = copy;
+	}
+	return node_entry(dir, node, i);
+}
+
+// create a new node resolving 'depth' bits after 'shift' bits, with room for
+// all of its entries but none of them filled in yet
+static DirNode *alloc_node(XtndDir *dir, int shift, int depth) {
+	DirNode *node = malloc(sizeof *node);
+	assert(node);
+
+	node->shift = shift;
+	node->depth = depth;
+	node->units = 0;
+	if (nsegments(node) == 1) {
+		node->segments = &node->first;
+	} else {
+		node->segments = malloc(sizeof *node->segments * nsegments(node));
+		assert(node->segments);
+	}
+	int i;
+	for (i = 0; i < nsegments(node); i++) {
+		node->segments[i] = new_segment(dir, segment_size(node));
+	}
+	node->haschild = NULL;
+	node->rank = NULL;
+	node->nchildren = 0;
+	node->children = NULL;
+
+	dir->size += 1 << depth;
+	dir->nnodes++;
+	if (shift + depth > dir->depth) {
+		dir->depth = shift + depth;
+	}
+	return node;
+}
+
+// create a new node resolving 0 bits after 'shift' bits, holding a single
+// copy of 'entry'
+static DirNode *new_node(XtndDir *dir, int shift, const void *entry) {
+	DirNode *node = alloc_node(dir, shift, 0);
+	memcpy(node->segments[0]->entries, entry, dir->entrysize);
+	node->units = 1;
+	return node;
+}
+
+// free 'node' itself, but not the nodes below it
+static void free_node_only(XtndDir *dir, DirNode *node) {
+	int i;
+	for (i = 0; i < nsegments(node); i++) {
+		// shared segments are only freed along with their last reference
+		node->segments[i]->refs--;
+		if (node->segments[i]->refs == 0) {
+			free(node->segments[i]);
+		}
+	}
+	if (node->segments != &node->first) {
+		free(node->segments);
+	}
+	clear_children(node);
+	dir->size -= 1 << node->depth;
+	dir->nnodes--;
+	free(node);
+}
+
+// free 'node' and all of the nodes below it
+static void free_node(XtndDir *dir, DirNode *node) {
+	int i;
+	for (i = 0; i < node->nchildren; i++) {
+		free_node(dir, node->children[i]);
+	}
+	free_node_only(dir, node);
+}
+
+// do entries 'i' and 'j' of 'node' belong to the same unit (e.g. bucket)? an
+// entry with a child node below it is a unit of its own
+static bool same_unit(XtndDir *dir, DirNode *node, int i, int j) {
+	if (child_of(node, i) || child_of(node, j)) {
+		return false;
+	}
+	return memcmp(node_entry(dir, node, i), node_entry(dir, node, j),
+		dir->entrysize) == 0;
+}
+
+// count the distinct units among the entries of 'node'. a unit resolving b
+// bits covers the entries whose rightmost b bits match, and only the first of
+// those (the one below 2^b) is counted
+static int count_units(XtndDir *dir, DirNode *node) {
+	int units = 0;
+	int i;
+	for (i = 0; i < 1 << node->depth; i++) {
+		int bits = node->depth;
+		while (bits > 0 && same_unit(dir, node, i, i ^ 1 << (bits - 1))) {
+			bits--;
+		}
+		units += i < 1 << bits;
+	}
+	return units;
+}
+
+// would 'node' still be dense enough (see DIR_NODE_SLACK_BYTES) after
+// doubling?
+static bool can_double(XtndDir *dir, DirNode *node) {
+	return node->depth < DIR_LEVEL_BITS
+		&& 2LL << node->depth <= (int64)dir->slack * node->units;
+}
+
+// one half of the child node 'child' of 'node', after 'node' has doubled and
+// taken over the child's first bit: the child's entries whose index ends in
+// bit 'b', as the child node for entry 'i' of 'node'. returns the new child
+// node, or NULL if the half is just a single entry with no children, which is
+// then written into entry 'i' itself
+static DirNode *half_child(XtndDir *dir, DirNode *node, DirNode *child, int b,
+	int i) {
+	// a single entry: either it has a child of its own, which can move up to
+	// resolve the same bits, or it goes back into 'node'
+	if (child->depth == 1) {
+		if (child_of(child, b)) {
+			return child_of(child, b);
+		}
+		memcpy(node_entry_for_writing(dir, node, i), node_entry(dir, child, b),
+			dir->entrysize);
+		return NULL;
+	}
+
+	// otherwise, take every second entry (and child) into a node one bit
+	// narrower, unless it turns out to hold copies of a single entry
+	DirNode *half = alloc_node(dir, child->shift + 1, child->depth - 1);
+	int k;
+	for (k = 0; k < 1 << half->depth; k++) {
+		memcpy(node_entry(dir, half, k), node_entry(dir, child, 2 * k + b),
+			dir->entrysize);
+		DirNode *grandchild = child_of(child, 2 * k + b);
+		if (grandchild) {
+			insert_child(half, k, grandchild);
+		}
+	}
+	half->units = count_units(dir, half);
+	if (half->units == 1 && half->nchildren == 0) {
+		memcpy(node_entry_for_writing(dir, node, i), node_entry(dir, half, 0),
+			dir->entrysize);
+		free_node_only(dir, half);
+		return NULL;
+	}
+	return half;
+}
+
+// double the entries of 'node', duplicating the entries in the first half
+// into the new second half (just like doubling a flat directory). while the
+// node fits in a single segment this means copying entries, but after that
+// the second half just shares the first half's segments until it's written
+// to. any child nodes are split in two, since 'node' now resolves their
+// first bit itself
+static void double_node(XtndDir *dir, DirNode *node) {
+	int size = 1 << node->depth;
+	assert(size * 2 < MAX_TABLE_SIZE && "error: table has grown too large!");
+
+	if (node->depth < DIR_SEGMENT_BITS) {
+		// grow the one and only segment, copying entries down
+		DirSegment *segment = node->segments[0];
+		assert(segment->refs == 1);
+		segment = realloc(segment, sizeof *segment
+			+ (size_t)dir->entrysize * size * 2);
+		assert(segment);
+		memcpy((char *)segment->entries + (size_t)dir->entrysize * size,
+			segment->entries, (size_t)dir->entrysize * size);
+		node->segments[0] = segment;
+	} else {
+		// get twice as many segment pointers, and share segments down
+		int n = nsegments(node);
+		if (node->segments == &node->first) {
+			node->segments = malloc((sizeof *node->segments) * n * 2);
+			assert(node->segments);
+			node->segments[0] = node->first;
+		} else {
+			node->segments = realloc(node->segments,
+				(sizeof *node->segments) * n * 2);
+			assert(node->segments);
+		}
+		int i;
+		for (i = 0; i < n; i++) {
+			node->segments[n + i] = node->segments[i];
+			node->segments[i]->refs++;
+		}
+	}
+
+	node->depth++;
+	dir->size += size;
+	if (node->shift + node->depth > dir->depth) {
+		dir->depth = node->shift + node->depth;
+	}
+
+	// split each child between its two new entries, which are now different
+	// units (a child only exists where some entry needed more bits). the
+	// halves are collected in entry order, and then replace the old children
+	if (node->nchildren > 0) {
+		DirNode **old = node->children;
+		int nold = node->nchildren;
+		int *entry = malloc(sizeof *entry * nold);
+		assert(entry);
+		int i, k = 0;
+		for (i = 0; i < size; i++) {
+			if (child_of(node, i)) {
+				entry[k++] = i;
+			}
+		}
+		node->children = NULL;
+		clear_children(node);
+
+		DirNode **halves = malloc(sizeof *halves * 2 * nold);
+		assert(halves);
+		for (k = 0; k < nold; k++) {
+			DirNode *child = old[k];
+			assert(child->depth > 0);
+			i = entry[k];
+			halves[2 * k] = half_child(dir, node, child, 0, i);
+			halves[2 * k + 1] = half_child(dir, node, child, 1, size + i);
+			// (any children of its own now belong to the halves)
+			free_node_only(dir, child);
+			node->units++;
+		}
+		for (k = 0; k < nold; k++) {
+			if (halves[2 * k]) {
+				insert_child(node, entry[k], halves[2 * k]);
+			}
+		}
+		for (k = 0; k < nold; k++) {
+			if (halves[2 * k + 1]) {
+				insert_child(node, size + entry[k], halves[2 * k + 1]);
+			}
+		}
+		free(halves);
+		free(entry);
+		free(old);
+	}
+}
+
+// replace entry 'i' of 'node' with a child node, starting out with a single
+// copy of that entry
+static void add_child(XtndDir *dir, DirNode *node, int i) {
+	void *entry = node_entry(dir, node, i);
+	insert_child(node, i, new_node(dir, node->shift + node->depth, entry));
+}
+
+// call 'visit' on every entry in and below 'node', whose addresses all end in
+// the 'node->shift' bits of 'prefix'
+static void walk_node(XtndDir *dir, DirNode *node, int prefix,
+	void (*visit)(void *entry, int address, int bits, void *arg), void *arg) {
+	int i;
+	for (i = 0; i < 1 << node->depth; i++) {
+		int address = (i << node->shift) | prefix;
+		DirNode *child = child_of(node, i);
+		if (child) {
+			walk_node(dir, child, address, visit, arg);
+		} else {
+			visit(node_entry(dir, node, i), address,
+				node->shift + node->depth, arg);
+		}
+	}
+}
+
+
+/* * * *
+ * all functions
+ */
+
+// initialise a directory of entries 'entrysize' bytes wide, resolving 0 bits:
+// every hash value maps to a single copy of 'entry'
+XtndDir *new_xtnd_dir(int entrysize, const void *entry) {
+	XtndDir *dir = malloc(sizeof *dir);
+	assert(dir);
+
+	dir->entrysize = entrysize;
+	dir->slack = DIR_NODE_SLACK_BYTES / entrysize;
+	if (dir->slack < DIR_MIN_SLACK) {
+		dir->slack = DIR_MIN_SLACK;
+	}
+	dir->size = 0;
+	dir->depth = 0;
+	dir->nnodes = 0;
+	dir->root = new_node(dir, 0, entry);
+
+	return dir;
+}
+
+
+// free all memory associated with 'dir' (but not whatever its entries point to)
+void free_xtnd_dir(XtndDir *dir) {
+	assert(dir);
+	free_node(dir, dir->root);
+	free(dir);
+}
+
+
+// return a pointer to the directory entry for hash value 'hash'
+void *xtnd_dir_lookup(XtndDir *dir, int hash) {
+	DirNode *node = dir->root;
+	while (true) {
+		int i = rightmostnbits(node->depth, hash >> node->shift);
+		DirNode *child = child_of(node, i);
+		if (child) {
+			node = child;
+		} else {
+			return node_entry(dir, node, i);
+		}
+	}
+}
+
+
+// start loading the directory entry for hash value 'hash' into the cache,
+// without waiting for it. the nodes above the entry are few and small, so
+// they are usually cached already: it's the entry itself that misses
+void xtnd_dir_prefetch(XtndDir *dir, int hash) {
+	DirNode *node = dir->root;
+	while (true) {
+		int i = rightmostnbits(node->depth, hash >> node->shift);
+		DirNode *child = child_of(node, i);
+		if (child) {
+			node = child;
+		} else {
+			prefetch(node_entry(dir, node, i));
+			return;
+		}
+	}
+}
+
+
+// how many bits of 'hash' the directory currently resolves. an entry used by
+// fewer bits than this can be split without growing the directory
+int xtnd_dir_bits(XtndDir *dir, int hash) {
+	DirNode *node = dir->root;
+	while (true) {
+		int i = rightmostnbits(node->depth, hash >> node->shift);
+		DirNode *child = child_of(node, i);
+		if (child) {
+			node = child;
+		} else {
+			return node->shift + node->depth;
+		}
+	}
+}
+
+
+// point every address whose rightmost 'depth' bits equal those of 'pattern'
+// at a copy of 'entry', growing the directory only where it needs more bits
+void xtnd_dir_assign(XtndDir *dir, int pattern, int depth, const void *entry) {
+	assert(dir);
+	assert(depth <= DIR_MAX_DEPTH && "error: table has grown too deep!");
+
+	// FIRST,
+	// find the node which resolves the last of these 'depth' bits, growing
+	// nodes and adding children along the way as required
+	DirNode *node = dir->root;
+	while (depth > node->shift + node->depth) {
+		if (can_double(dir, node)) {
+			// this node can resolve another bit without getting too sparse
+			double_node(dir, node);
+			continue;
+		}
+
+		// otherwise, the remaining bits are resolved further down
+		int i = rightmostnbits(node->depth, pattern >> node->shift);
+		if (child_of(node, i) == NULL) {
+			add_child(dir, node, i);
+		}
+		node = child_of(node, i);
+	}
+
+	// SECOND,
+	// overwrite every entry in this node agreeing with the pattern. construct
+	// indices by joining a bit 'prefix' and a bit 'suffix', like when
+	// redirecting addresses after splitting a bucket in a flat directory
+	int bits = depth - node->shift;
+	int suffix = rightmostnbits(bits, pattern >> node->shift);
+	int maxprefix = 1 << (node->depth - bits);
+
+	// if these entries were part of a larger unit until now (i.e. they match
+	// the entries which differ from them in their last bit), they're splitting
+	// off a new unit
+	if (bits == 0) {
+		node->units = 1;
+	} else if (same_unit(dir, node, suffix, suffix ^ 1 << (bits - 1))) {
+		node->units++;
+	}
+
+	int prefix;
+	for (prefix = 0; prefix < maxprefix; prefix++) {
+		int i = (prefix << bits) | suffix;
+		assert(child_of(node, i) == NULL);
+		memcpy(node_entry_for_writing(dir, node, i), entry, dir->entrysize);
+	}
+}
+
+
+// call 'visit' on every directory entry, along with the (rightmost bits of
+// the) address it is stored at and the number of bits resolved there
+void xtnd_dir_walk(XtndDir *dir,
+	void (*visit)(void *entry, int address, int bits, void *arg), void *arg) {
+	assert(dir);
+	walk_node(dir, dir->root, 0, visit, arg);
+}
+
+
+// how many entries the directory holds in total, across all of its levels
+int xtnd_dir_size(XtndDir *dir) {
+	return dir->size;
+}
+
+
+// the most bits the directory resolves for any address (its global depth)
+int xtnd_dir_depth(XtndDir *dir) {
+	return dir->depth;
+}
+
+
+// how many nodes (blocks of entries) make up the directory
+int xtnd_dir_nnodes(XtndDir *dir) {
+	return dir->nnodes;
+}
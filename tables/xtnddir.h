@@ -0,0 +1,81 @@
+/* * * * * * * * *
+ * Multi-level directory for extendible hash tables: maps the rightmost bits of
+ * a hash value onto a directory entry (e.g. a bucket pointer), using a radix
+ * trie over the hash bits so that only the parts of the hash space which need
+ * more bits get expanded
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+#ifndef XTNDDIR_H
+#define XTNDDIR_H
+
+#include <stdbool.h>
+#include "../inthash.h"
+
+// the most hash value bits each level of the directory resolves. hash values
+// have 31 bits (see inthash.h), so with 11 bits per level, a lookup in a
+// densely filled directory visits at most 3 levels
+#define DIR_LEVEL_BITS 11
+
+// a level only resolves another bit if it would then have no more than this
+// many bytes of entries for each distinct value (e.g. bucket) among them
+// (though always allowing DIR_MIN_SLACK entries each). entries which need
+// many more bits than their neighbours get levels of their own below it
+// instead, so the directory's size stays proportional to the number of
+// buckets, however unevenly their depths are spread. wide entries (e.g. whole
+// buckets, rather than pointers to them) are costly to copy, so they get less
+// slack
+#define DIR_NODE_SLACK_BYTES 32
+#define DIR_MIN_SLACK 2
+
+// the most hash value bits any directory entry can be resolved by
+#define DIR_MAX_DEPTH 31
+
+// directory entries are stored in blocks of 2^DIR_SEGMENT_BITS, so that growing
+// a large part of the directory never means copying more than this many
+// entries at once
+#define DIR_SEGMENT_BITS 10
+
+typedef struct xtnd_dir XtndDir;
+
+// initialise a directory of entries 'entrysize' bytes wide, resolving 0 bits:
+// every hash value maps to a single copy of 'entry'
+XtndDir *new_xtnd_dir(int entrysize, const void *entry);
+
+// free all memory associated with 'dir' (but not whatever its entries point to)
+void free_xtnd_dir(XtndDir *dir);
+
+// return a pointer to the directory entry for hash value 'hash'
+// (entries may be shared between addresses: only change them through
+// 'xtnd_dir_assign()')
+void *xtnd_dir_lookup(XtndDir *dir, int hash);
+
+// start loading the directory entry for hash value 'hash' into the cache,
+// without waiting for it (see prefetch.h)
+void xtnd_dir_prefetch(XtndDir *dir, int hash);
+
+// how many bits of 'hash' the directory currently resolves. an entry used by
+// fewer bits than this can be split without growing the directory
+int xtnd_dir_bits(XtndDir *dir, int hash);
+
+// point every address whose rightmost 'depth' bits equal those of 'pattern'
+// at a copy of 'entry', growing the directory only where it needs more bits
+void xtnd_dir_assign(XtndDir *dir, int pattern, int depth, const void *entry);
+
+// call 'visit' on every directory entry, along with the (rightmost bits of
+// the) address it is stored at and the number of bits resolved there
+void xtnd_dir_walk(XtndDir *dir,
+	void (*visit)(void *entry, int address, int bits, void *arg), void *arg);
+
+// how many entries the directory holds in total, across all of its levels
+int xtnd_dir_size(XtndDir *dir);
+
+// the most bits the directory resolves for any address (its global depth)
+int xtnd_dir_depth(XtndDir *dir);
+
+// how many nodes (blocks of entries) make up the directory
+int xtnd_dir_nnodes(XtndDir *dir);
+
+#endif
@@ -0,0 +1,233 @@
+/* * * * * * * * *
+ * The parts of the extendible cuckoo tables (xuckoo.c and xuckoon.c) which
+ * work the same way whatever their buckets look like: presizing both inner
+ * tables, batches of lookups and inserts with prefetching, scans through both
+ * inner tables and then the stash, and printing
+ *
+ * before including this, the table defines PREFETCH_STAGES, the types
+ * XuckTable (with inner tables 'table1' and 'table2', and a 'stash') and
+ * InnerTable (with a directory 'dir'), and these functions:
+ *
+ * InnerTable *get_inner_table(XuckTable *table, int table_no)
+ *		inner table 'table_no' (1 or 2) of 'table'
+ * void prefetch_inner(InnerTable *inner_table, int hash, int stage)
+ *		start loading the memory that looking up a key with hash value 'hash'
+ *		will need at stage 'stage' (see prefetch.h), PREFETCH_STAGES being
+ *		its directory entry
+ * bool get_key(XuckTable *table, int64 key, int64 *value)
+ * bool contains(XuckTable *table, int64 key)
+ * bool upsert_key(XuckTable *table, int64 key, int64 value,
+ *	MergeFunction merge)
+ *		the untimed lookup, read-only lookup and upsert
+ * int depth_for(XuckTable *table, int nkeys)
+ *		how many hash value bits to split both inner tables to for 'nkeys' keys
+ * int inner_depth(InnerTable *inner_table, int address)
+ *		how many hash value bits the bucket for 'address' uses
+ * void split_at(XuckTable *table, int address, int table_no)
+ *		split the bucket for 'address' in inner table 'table_no'
+ * int scan_bucket(XuckTable *table, InnerTable *inner_table, int address,
+ *	ScanCursor *cursor, int64 *keys, int64 *values, int *n, int max)
+ *		copy the keys of the bucket for 'address' that 'cursor' hasn't
+ *		returned yet to keys[*n] on (see 'scan_keys()'), and return its depth
+ * void print_entry(void *entry, int address, int bits, void *arg)
+ *		directory walk helper printing the entry for 'address' in the inner
+ *		table 'arg' (and the bucket, at its first address)
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+// (no include guard: xuckoon.c includes this once for every instance)
+
+// one inner table of a table, for split_to_depth()
+typedef struct {
+	XuckTable *table;
+	int table_no;
+} InnerRef;
+
+// split_to_depth() helper: how many hash value bits the bucket for 'address'
+// in the inner table 'arg' refers to uses
+static int bucket_depth(void *arg, int address) {
+	InnerRef *ref = arg;
+	return inner_depth(get_inner_table(ref->table, ref->table_no), address);
+}
+
+// split_to_depth() helper: split the bucket for 'address' in the inner table
+// 'arg' refers to
+static void split_address(void *arg, int address) {
+	InnerRef *ref = arg;
+	split_at(ref->table, address, ref->table_no);
+}
+
+// make room in 'table' for 'nkeys' keys in total, by splitting both inner
+// tables up front until they're at most half full between them (as in
+// *_hash_table_reserve(), but untimed)
+static void reserve_tables(XuckTable *table, int nkeys) {
+	int depth = depth_for(table, nkeys);
+	int table_no;
+	for (table_no = 1; table_no <= 2; table_no++) {
+		InnerRef inner = {table, table_no};
+		split_to_depth(&inner, depth, bucket_depth, split_address);
+	}
+}
+
+// start loading the memory that looking up 'key' will need at stage 'stage',
+// in both inner tables
+static void prefetch_key(XuckTable *table, int64 key, int stage) {
+	prefetch_inner(table->table1, h1(key), stage);
+	prefetch_inner(table->table2, h2(key), stage);
+}
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+// (as in *_hash_table_lookup_batch(), but untimed)
+static void lookup_keys(XuckTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, get_key(table, keys[i], NULL));
+		}
+	}
+}
+
+// lookup_keys(), but never moving a hot key, for probing from several threads
+// at once
+static void probe_keys(XuckTable *table, const int64 *keys, int n,
+	unsigned char *found) {
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			set_bit(found, i, contains(table, keys[i]));
+		}
+	}
+}
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted (as in
+// *_hash_table_insert_batch(), but untimed)
+static int insert_keys(XuckTable *table, const int64 *keys, int n,
+	unsigned char *inserted) {
+	int ninserted = 0;
+	int i, stage;
+	for (i = -PREFETCH_STAGES * PREFETCH_DISTANCE; i < n; i++) {
+		for (stage = 1; stage <= PREFETCH_STAGES; stage++) {
+			int ahead = i + stage * PREFETCH_DISTANCE;
+			if (ahead >= 0 && ahead < n) {
+				prefetch_key(table, keys[ahead], stage);
+			}
+		}
+		if (i >= 0) {
+			bool new_key = upsert_key(table, keys[i], 0, merge_keep);
+			ninserted += new_key;
+			if (inserted) {
+				set_bit(inserted, i, new_key);
+			}
+		}
+	}
+	return ninserted;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+// (as in *_hash_table_scan_ranges(), but untimed)
+static void split_scan(XuckTable *table, ScanCursor *cursors, int n) {
+	// both tables' positions are split up evenly, and then each split is
+	// moved past the bucket it falls in the middle of, if any. the last range
+	// takes the stash too
+	scan_split(cursors, n, STASH_SCAN_START);
+	int i;
+	for (i = 1; i < n; i++) {
+		InnerTable *inner_table = cursors[i].pos >> SCAN_BITS ? table->table2
+			: table->table1;
+		scan_align_split(cursors, i, inner_depth(inner_table,
+			scan_address(cursors[i].pos)));
+	}
+	scan_skip_empty(cursors, n, STASH_SCAN_START + table->stash.nkeys);
+}
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+// (as in *_hash_table_probe_scan())
+static int scan_keys(XuckTable *table, ScanCursor *cursor, int64 *keys,
+	int64 *values, int max) {
+	// visit each bucket once, in scan order (see cursor.h), through the
+	// first table's positions and then the second's, and then the stash
+	int n = 0;
+	int64 end = scan_end(cursor, STASH_SCAN_START);
+	while (n < max && cursor->pos != SCAN_DONE && cursor->pos < end) {
+		InnerTable *inner_table = cursor->pos >> SCAN_BITS ? table->table2
+			: table->table1;
+		int depth = scan_bucket(table, inner_table, scan_address(cursor->pos),
+			cursor, keys, values, &n, max);
+
+		// ran out of room partway through the bucket? pick up there next time
+		if (cursor->skip > 0) {
+			break;
+		}
+
+		// start loading what buckets further ahead in the same table will
+		// need, a stage at a time (see prefetch_inner()): the directory entry
+		// SCAN_AHEAD buckets ahead, and each stage after that for a bucket
+		// half as far ahead as the last
+		int stage;
+		for (stage = PREFETCH_STAGES; stage >= 1; stage--) {
+			int64 ahead = scan_ahead(cursor->pos, depth,
+				SCAN_AHEAD >> (PREFETCH_STAGES - stage));
+			if (ahead >> SCAN_BITS == cursor->pos >> SCAN_BITS) {
+				prefetch_inner(inner_table, scan_address(ahead), stage);
+			}
+		}
+
+		cursor->pos = scan_next(cursor->pos, depth);
+	}
+
+	// a range ending before the stash is finished once it reaches its end
+	if (cursor->pos >= end && end < STASH_SCAN_START) {
+		cursor->pos = SCAN_DONE;
+	}
+	return scan_stash(&table->stash, STASH_SCAN_START, cursor, keys, values, n,
+		max);
+}
+
+// print the contents of 'table' to stdout
+static void print_tables(XuckTable *table) {
+	printf("--- table ---\n");
+
+	// loop through the two tables, printing them
+	InnerTable *innertables[2] = {table->table1, table->table2};
+	int t;
+	for (t = 0; t < 2; t++) {
+		// print header
+		printf("table %d\n", t+1);
+
+		printf("  table:               buckets:\n");
+		printf("  address | bucketid   bucketid [key]\n");
+
+		// print table and buckets
+		xtnd_dir_walk(innertables[t]->dir, print_entry, innertables[t]);
+	}
+
+	// and any keys which had to be stashed
+	int i;
+	for (i = 0; i < table->stash.nkeys; i++) {
+		printf("stash [%llu]\n", table->stash.keys[i]);
+	}
+	printf("--- end table ---\n");
+}
@@ -11,9 +11,20 @@
 */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <time.h>
 #include "xuckoo.h"
+#include "xtnddir.h"
+#include "xtndbuild.h"
+#include "sketch.h"
+#include "prefetch.h"
+#include "kicks.h"
+#include "cacheline.h"
+
+// batch lookups and inserts prefetch for each key in this many stages (see
+// prefetch.h)
+#define PREFETCH_STAGES 1
 /*
 // Use colours for debugging
 #include <windows.h>
@@ -27,116 +38,159 @@
 */
 #define EMPTY 0
 // macro to calculate the rightmost n bits of a number x
-#define rightmostnbits(n, x) (x) & ((1 << (n)) - 1)
+#define rightmostnbits(n, x) ((x) & ((1u << (n)) - 1))
 // a bucket stores a single key (full=true) or is empty (full=false)
-// it also knows how many bits are shared between possible keys, and the first 
-// table address that references it
+// it also knows how many bits are shared between possible keys
+// buckets live directly in their inner table's directory: every address
+// referencing a bucket holds its own 16-byte copy, so checking a bucket for a
+// key takes a single directory lookup. values are kept out of the way in a
+// dense array, one per key, and only read once the key has been found. the
+// bucket's id, the first table address that references it, is the rightmost 
+// 'depth' bits of any of these addresses
 
 typedef struct bucket {
-	int id;		// a unique id for this bucket, equal to the first address
-				// in the table which points to it
-	int depth;	// how many hash value bits are being used by this bucket
-	bool full;	// does this bucket contain a key
 	int64 key;	// the key stored in this bucket
+	int slot;	// the index of that key's value in the value array
+	unsigned char depth;	// how many hash value bits are being used by
+							// this bucket
+	bool full;	// does this bucket contain a key
 } Bucket;
 
 typedef struct stats {
 	int nbuckets;	// how many distinct buckets does the table point to
 	int nkeys;		// how many keys are being stored in the table
+	int nmoved;		// how many hot keys have been moved to table 1
 	int time;		// how much CPU time has been used to insert/lookup keys
 					// in this table
 } Stats;
 
-// an inner table is an extendible hash table with an array of slots pointing 
-// to buckets holding up to 1 key, along with some information about the number 
-// of hash value bits to use for addressing
+// an inner table is an extendible hash table with a directory of slots 
+// holding buckets of up to 1 key. the directory keeps track of the number of
+// hash value bits to use for addressing each part of the table
 typedef struct inner_table {
-	Bucket **buckets;	// array of pointers to buckets
-	int size;			// how many entries in the table of pointers (2^depth)
-	int depth;			// how many bits of the hash value to use (log2(size))
-	int nkeys;			// how many keys are being stored in the table
+	XtndDir *dir;		// directory of buckets
 } InnerTable;
 
-// a xuckoo hash table is just two inner tables for storing inserted keys
+// a xuckoo hash table is just two inner tables for storing inserted keys,
+// and the values of those keys
 struct xuckoo_table {
 	InnerTable *table1;
 	InnerTable *table2;
+	int64 *values;		// every key's value, in the order the keys arrived
+	int nvalues;		// how many values are in use (including those of keys
+						// which have since been stashed)
+	int nslots;			// how many values 'values' has room for
+	Sketch *hot;		// how often keys are being looked up
+	Stash stash;		// keys which no split could find a bucket for
 	Stats stats;
 };
 
+// (the name xuckloops.h knows the table type by)
+typedef struct xuckoo_table XuckTable;
 
-bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos, 
-						int64 orig_key, int loop, int orig_table);
+void try_xuck_insert(XuckooHashTable *table, int64 key, int slot);
+static void promote_if_hot(XuckooHashTable *table, int64 key, int hash1, int hash2);
 
-// Function takes an address and a depth and makes a new bucket
-static Bucket *new_bucket(int first_address, int depth) {
-	// malloc bucket
-	Bucket *bucket = malloc(sizeof *bucket);
-	assert(bucket);
+// Function takes a depth and creates a new, empty bucket (empty buckets of
+// the same depth are identical, padding and all, so the directory can tell
+// when its entries are copies of one another)
+static Bucket new_bucket(int depth) {
+	Bucket bucket;
+	memset(&bucket, 0, sizeof bucket);
+	bucket.depth = depth;
+	return bucket;
+}
 
-	// Set initial values
-	bucket->id = first_address;
-	bucket->depth = depth;
-	bucket->full = false;
+// find the bucket in 'table' for a key with hash value 'hash' (read only:
+// buckets are changed by writing them back with 'write_bucket()')
+static Bucket *find_bucket(InnerTable *table, int hash) {
+	return xtnd_dir_lookup(table->dir, hash);
+}
 
-	return bucket;
+// overwrite every copy of the bucket in 'table' for hash value 'hash' with
+// 'bucket' (any pointers into the directory are now invalid)
+static void write_bucket(InnerTable *table, int hash, Bucket *bucket) {
+	xtnd_dir_assign(table->dir, hash, bucket->depth, bucket);
+}
+
+// Stores 'value' for a new key at the end of the value array of 'table'
+// (growing it if it's full), returning its index
+static int new_value(XuckooHashTable *table, int64 value) {
+	if (table->nvalues == table->nslots) {
+		table->nslots = table->nslots ? table->nslots * 2 : 4;
+		table->values = realloc(table->values, sizeof *table->values
+			* table->nslots);
+		assert(table->values);
+	}
+	table->values[table->nvalues] = value;
+	return table->nvalues++;
 }
 
 // Function creates a new inner table
 static InnerTable *new_inner_table() {
 	// malloc inner table
-	InnerTable *table = malloc(sizeof *table);
+	InnerTable *table = cache_line_alloc(sizeof *table);
 	assert(table);
 
 	// set initial values and return
-	table->size = 1;
-	// Make a new bucket
-	table->buckets = malloc(sizeof *table->buckets);
-	assert(table->buckets);
-	table->buckets[0] = new_bucket(0, 0);
-	
-	table->depth = 0;
-	table->nkeys = 0;
+	// Make a directory holding a single empty bucket
+	Bucket bucket = new_bucket(0);
+	table->dir = new_xtnd_dir(sizeof bucket, &bucket);
 
 	return table;
 };
 
-// Doubles a table's size
-static void double_table(InnerTable *table) {
-	// upsize the table
-	int size = table->size * 2;
-	assert(size < MAX_TABLE_SIZE && "error: table has grown too large!");
-
-	// get a new array of twice as many bucket pointers, and copy pointers down
-	table->buckets = realloc(table->buckets, (sizeof *table->buckets) * size);
-	assert(table->buckets);
-	int i;
-	for (i = 0; i < table->size; i++) {
-		table->buckets[table->size + i] = table->buckets[i];
+// directory walk helper: print a table entry and, at the first address at
+// which a bucket occurs, the bucket itself
+static void print_entry(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = entry;
+	int id = rightmostnbits(bucket->depth, address);
+
+	// table entry
+	printf("%9d | %-9d ", address, id);
+
+	// if this is the first address at which a bucket occurs, print it
+	if (id == address) {
+		printf("%9d ", id);
+		if (bucket->full) {
+			printf("[%llu]", bucket->key);
+		} else {
+			printf("[ ]");
+		}
 	}
 
-	// finally, increase the table size and the depth we are using to hash keys
-	table->size = size;
-	table->depth++;
+	// end the line
+	printf("\n");
+}
+
+// Frees an inner table along with all of its buckets
+static void free_inner_table(InnerTable *table) {
+	free_xtnd_dir(table->dir);
+	cache_line_free(table);
 }
 
-// Reinserts a key to the table
-static void reinsert_key(InnerTable *table, int64 key, int table_no) {
-	int address;
-	// calculate the address
+// Reinserts a key (whose value is in slot 'slot') to the table
+static void reinsert_key(InnerTable *table, int64 key, int slot,
+	int table_no) {
+	int hash;
+	// calculate the hash
 	if (table_no == 1) {
-		address = rightmostnbits(table->depth, h1(key));	
+		hash = h1(key);
 	}
 	else {
-		address = rightmostnbits(table->depth, h2(key));	
+		hash = h2(key);
 	}
 	// Just insert, because we know there's space.
-	table->buckets[address]->key = key;
-	table->buckets[address]->full = true;
+	Bucket bucket = *find_bucket(table, hash);
+	bucket.key = key;
+	bucket.slot = slot;
+	bucket.full = true;
+	write_bucket(table, hash, &bucket);
 }
 
-// split the bucket in 'table' at address 'address', growing table if necessary
-static void split_bucket(XuckooHashTable *table, int address, int table_no) {
+// split the bucket for hash value 'hash' in one of the inner tables of 
+// 'table', growing that table's directory where necessary
+static void split_bucket(XuckooHashTable *table, int hash, int table_no) {
 	// set the inner table depending on the table_no for later code
 	InnerTable *inner_table;
 	if (table_no == 1) {
@@ -147,64 +201,243 @@ static void split_bucket(XuckooHashTable *table, int address, int table_no) {
 	}
 
 	// FIRST,
-	// do we need to grow the table?
-	if (inner_table->buckets[address]->depth == inner_table->depth) {
-		// yep, this bucket is down to its last pointer
-		double_table(inner_table);
-	}
-	// either way, now it's time to split this bucket
+	// take a copy of the bucket, which we're about to overwrite
+	Bucket bucket = *find_bucket(inner_table, hash);
+	int depth = bucket.depth;
+	assert(depth < DIR_MAX_DEPTH);
+	unsigned int first_address = rightmostnbits(depth, hash);
 
 	// SECOND,
-	// create a new bucket and update both buckets' depth
-	Bucket *bucket = inner_table->buckets[address];
-	int depth = bucket->depth;
-	int first_address = bucket->id;
-
+	// replace it with two empty buckets one bit deeper: the old bucket's
+	// first address, and a 1 bit plus the old first address
+	// (the directory takes care of growing if it needs to)
 	int new_depth = depth + 1;
-	bucket->depth = new_depth;
-
-	// new bucket's first address will be a 1 bit plus the old first address
-	int new_first_address = 1 << depth | first_address;
-	Bucket *newbucket = new_bucket(new_first_address, new_depth);
-	
-	// THIRD,
-	// redirect every second address pointing to this bucket to the new bucket
-	// construct addresses by joining a bit 'prefix' and a bit 'suffix'
-	// (defined below)
-
-	// suffix: a 1 bit followed by the previous bucket bit address
-	int bit_address = rightmostnbits(depth, first_address);
-	int suffix = (1 << depth) | bit_address;
-
-	// prefix: all bitstrings of length equal to the difference between the new
-	// bucket depth and the table depth
-	// use a for loop to enumerate all possible prefixes less than maxprefix:
-	int maxprefix = 1 << (inner_table->depth - new_depth);
-
-	int prefix;
-	for (prefix = 0; prefix < maxprefix; prefix++) {
-		
-		// construct address by joining this prefix and the suffix
-		int a = (prefix << new_depth) | suffix;
-
-		// redirect this table entry to point at the new bucket
-		inner_table->buckets[a] = newbucket;
-	}
+	unsigned int new_first_address = 1u << depth | first_address;
+	Bucket empty = new_bucket(new_depth);
+	xtnd_dir_assign(inner_table->dir, first_address, new_depth, &empty);
+	xtnd_dir_assign(inner_table->dir, new_first_address, new_depth, &empty);
 
 	// FINALLY,
 	// filter the key from the old bucket into its rightful place in the new 
 	// table (which may be the old bucket, or may be the new bucket)
-
-	// remove and reinsert the key
-	int64 key = bucket->key;
-	bucket->full = false;
-	reinsert_key(inner_table, key, table_no);
+	if (bucket.full) {
+		reinsert_key(inner_table, bucket.key, bucket.slot, table_no);
+	}
 	table->stats.nbuckets++;
 }
 
+// Returns inner table 'table_no' (1 or 2) of 'table'
+static InnerTable *get_inner_table(XuckooHashTable *table, int table_no) {
+	if (table_no == 1) {
+		return table->table1;
+	}
+	return table->table2;
+}
+
+// Puts 'key' (whose value is in slot 'slot') in its bucket in inner table
+// 'table_no', but only if that bucket is empty. returns true if the key was
+// placed, false if not
+static bool place_if_empty(XuckooHashTable *table, int64 key, int slot,
+	int table_no) {
+	InnerTable *inner_table = get_inner_table(table, table_no);
+	int hash = hash_for(key, table_no);
+	if (find_bucket(inner_table, hash)->full) {
+		return false;
+	}
+	reinsert_key(inner_table, key, slot, table_no);
+	return true;
+}
+
+// If 'key' is in its bucket in inner table 'table_no', replaces its value with
+// merge(its value, 'value') and returns true. otherwise returns false
+static bool update_value(XuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge, int table_no) {
+	InnerTable *inner_table = get_inner_table(table, table_no);
+	int hash = hash_for(key, table_no);
+	Bucket *bucket = find_bucket(inner_table, hash);
+	if (bucket->full == false || bucket->key != key) {
+		return false;
+	}
+	table->values[bucket->slot] = merge(table->values[bucket->slot], value);
+	return true;
+}
+
+// Fills in what splitting the bucket visited in 'visit' would involve
+static void split_option(XuckooHashTable *table, Visit *visit,
+	SplitOption *option) {
+	InnerTable *inner_table = get_inner_table(table, visit->table_no);
+	Bucket *bucket = find_bucket(inner_table, visit->hash);
+	option->depth = bucket->depth;
+	option->dir_bits = xtnd_dir_bits(inner_table->dir, visit->hash);
+	option->spread = 0;
+	if (bucket->full) {
+		option->spread = hash_for(bucket->key, visit->table_no)
+			^ visit->evicted;
+	}
+}
+
+// Splits whichever of the 'nvisits' buckets in 'visits' is cheapest to split
+// (see kicks.h). returns false (without splitting anything) if splitting none
+// of them could ever make room
+static bool split_cheapest(XuckooHashTable *table, Visit *visits, int nvisits) {
+	SplitOption options[MAX_KICKS];
+	int i;
+	for (i = 0; i < nvisits; i++) {
+		split_option(table, &visits[i], &options[i]);
+	}
+	int best = cheapest_split(options, nvisits);
+	if (best == -1) {
+		return false;
+	}
+	split_bucket(table, visits[best].hash, visits[best].table_no);
+	return true;
+}
+
+// Which inner table should a chain of kicks for 'key' start from? the one
+// whose bucket for 'key' would be cheaper to split (see kicks.h), should the
+// chain come back to it, so that the chain doesn't set out from a bucket
+// whose split would double its directory when the other's wouldn't
+static int cheapest_start(XuckooHashTable *table, int64 key) {
+	Visit starts[2];
+	SplitOption options[2];
+	int i;
+	for (i = 0; i < 2; i++) {
+		starts[i].table_no = i + 1;
+		starts[i].hash = hash_for(key, i + 1);
+		starts[i].evicted = starts[i].hash;
+		split_option(table, &starts[i], &options[i]);
+	}
+	int best = cheapest_split(options, 2);
+	if (best == -1) {
+		return 1;
+	}
+	return best + 1;
+}
+
+// the fewest hash value bits (up to DIR_MAX_DEPTH) which address enough
+// buckets in each inner table for 'nkeys' keys, so that the two tables
+// together have twice as much room as the keys need
+static int depth_for(XuckooHashTable *table, int nkeys) {
+	return depth_for_room(nkeys, 1, DIR_MAX_DEPTH);
+}
+
+// how many hash value bits the bucket for 'address' in 'table' uses
+static int inner_depth(InnerTable *table, int address) {
+	return find_bucket(table, address)->depth;
+}
+
+// split the bucket for 'address' in inner table 'table_no' of 'table'
+static void split_at(XuckooHashTable *table, int address, int table_no) {
+	split_bucket(table, address, table_no);
+}
+
+// start loading the memory needed to find a key with hash value 'hash' in
+// 'table': its directory entry, which holds the bucket itself (so there's
+// only the one stage)
+static void prefetch_inner(InnerTable *table, int hash, int stage) {
+	xtnd_dir_prefetch(table->dir, hash);
+}
+
+// copy the key in the bucket for 'address' in 'inner_table' (if there is one)
+// to keys[*n], and its value to values[*n] (unless 'values' is NULL), for
+// scans. returns the bucket's depth. (a bucket never holds more keys than
+// there is room for, so a chunk never stops partway through one)
+static int scan_bucket(XuckooHashTable *table, InnerTable *inner_table,
+	int address, ScanCursor *cursor, int64 *keys, int64 *values, int *n,
+	int max) {
+	Bucket *bucket = find_bucket(inner_table, address);
+	if (bucket->full) {
+		keys[*n] = bucket->key;
+		if (values) {
+			values[*n] = table->values[bucket->slot];
+		}
+		(*n)++;
+	}
+	return bucket->depth;
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in xuckoo_hash_table_upsert(), but untimed)
+static bool upsert_key(XuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	// is this key already there? then just update its value
+	if (update_value(table, key, value, merge, 1)
+		|| update_value(table, key, value, merge, 2)) {
+		return false;
+	}
+	if (table->stash.nkeys > 0) {
+		int64 *stored = stash_value(&table->stash, key);
+		if (stored) {
+			*stored = merge(*stored, value);
+			return false;
+		}
+	}
+	// find a place for the key, kicking others out of the way if need be
+	try_xuck_insert(table, key, new_value(table, value));
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// is 'key' in either of its buckets? (unlike get_key(), this never moves a
+// hot key, so it only ever reads the table)
+static bool contains(XuckooHashTable *table, int64 key) {
+	Bucket *bucket1 = find_bucket(table->table1, h1(key));
+	if (bucket1->full && bucket1->key == key) {
+		return true;
+	}
+	Bucket *bucket2 = find_bucket(table->table2, h2(key));
+	if (bucket2->full && bucket2->key == key) {
+		return true;
+	}
+	return table->stash.nkeys > 0 && stash_value(&table->stash, key) != NULL;
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in xuckoo_hash_table_get(), but untimed)
+static bool get_key(XuckooHashTable *table, int64 key, int64 *value) {
+	// look for the key in its table 1 bucket (unless it's empty)
+	int hash1 = h1(key);
+	Bucket *bucket1 = find_bucket(table->table1, hash1);
+	bool found = bucket1->full && bucket1->key == key;
+	if (found && value) {
+		*value = table->values[bucket1->slot];
+	}
+
+	// and only then in its table 2 bucket
+	if (found == false) {
+		int hash2 = h2(key);
+		Bucket *bucket2 = find_bucket(table->table2, hash2);
+		found = bucket2->full && bucket2->key == key;
+		if (found && value) {
+			*value = table->values[bucket2->slot];
+		}
+
+		// a key which keeps being found here should move to table 1
+		if (found && TRACK_HOT_KEYS) {
+			promote_if_hot(table, key, hash1, hash2);
+		}
+	}
+
+	// failing that, the key might have been stashed
+	if (found == false && table->stash.nkeys > 0) {
+		int64 *stored = stash_value(&table->stash, key);
+		found = stored != NULL;
+		if (found && value) {
+			*value = *stored;
+		}
+	}
+
+	return found;
+}
+
+// the rest of the table's untimed operations, as for xuckoon tables
+#include "xuckloops.h"
+
+
 // initialise an extendible cuckoo hash table
 XuckooHashTable *new_xuckoo_hash_table() {
-	XuckooHashTable *cuckoo = malloc(sizeof* cuckoo);
+	XuckooHashTable *cuckoo = cache_line_alloc(sizeof *cuckoo);
 	assert(cuckoo != NULL);
 	// Create two new inner tables (use helpter function here)
 	cuckoo->table1 = new_inner_table();
@@ -213,9 +446,15 @@ XuckooHashTable *new_xuckoo_hash_table() {
 	//printf("Successfully made table 2!\n");
 	// Then create a cuckoo table and link these to the inner tables
 	//printf("Successfully made cuckoo table!\n");
+	cuckoo->values = NULL;
+	cuckoo->nvalues = 0;
+	cuckoo->nslots = 0;
+	cuckoo->hot = new_sketch();
+	init_stash(&cuckoo->stash);
 	// set 
 	cuckoo->stats.time = 0;
 	cuckoo->stats.nkeys = 0;
+	cuckoo->stats.nmoved = 0;
 	cuckoo->stats.nbuckets = 0;
 	return cuckoo;
 }
@@ -225,125 +464,147 @@ XuckooHashTable *new_xuckoo_hash_table() {
 void free_xuckoo_hash_table(XuckooHashTable *table) {
 	assert(table);
 
-	// loop backwards through the array of pointers, freeing buckets only as we
-	// reach their first reference
-	// (if we loop through forwards, we wouldn't know which reference was last)
-	int i;
-	for (i = table->table1->size-1; i >= 0; i--) {
-		if (table->table1->buckets[i]->id == i) {
-			free(table->table1->buckets[i]);
-		}
-	}
-	for (i = table->table2->size-1; i >= 0; i--) {
-		if (table->table2->buckets[i]->id == i) {
-			free(table->table2->buckets[i]);
-		}
-	}
-
-	// free the array of bucket pointers
-	free(table->table1->buckets);
-	free(table->table2->buckets);
-	free(table->table1);
-	free(table->table2);
+	// free both inner tables, along with their buckets and directories, and
+	// the values
+	free_inner_table(table->table1);
+	free_inner_table(table->table2);
+	free(table->values);
+	free_sketch(table->hot);
+	free_stash(&table->stash);
 	
 	// free the table struct itself
-	free(table);	
+	cache_line_free(table);
+}
+
+
+// make room in 'table' for 'nkeys' keys in total, by splitting both inner
+// tables up front until they're at most half full between them
+void xuckoo_hash_table_reserve(XuckooHashTable *table, int nkeys) {
+	assert(table);
+	int start_time = clock(); // start timing
+	reserve_tables(table, nkeys);
+	table->stats.time += clock() - start_time;
 }
 
 
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key) {
-	assert(table);
+	return xuckoo_hash_table_upsert(table, key, 0, merge_keep);
+}
+
+
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool xuckoo_hash_table_upsert(XuckooHashTable *table, int64 key, int64 value,
+	MergeFunction merge) {
+	assert(table != NULL);
 	int start_time = clock(); // start timing
-	// is this key already there?
-	if (xuckoo_hash_table_lookup(table, key) == true) {
-		return false;
-	}
-	// Initialise variables
-	int hash;
-	int address;
-	// Check size of each, if table1 has less or equal keys (according to spec)
-	// then insert to table2 instead.
-	if (table->table1->nkeys <= table->table2->nkeys) {
-		hash = h1(key);
-		address = rightmostnbits(table->table1->depth, hash);
-		try_xuck_insert(table, key, address, key, 0, 1);
-	}
-	else {
-		hash = h2(key);
-		address = rightmostnbits(table->table2->depth, hash);
-		try_xuck_insert(table, key, address, key, 1, 2);
-	}
-	// add time elapsed to total CPU time before returning
+	bool inserted = upsert_key(table, key, value, merge);
 	table->stats.time += clock() - start_time;
-	return true;
+	return inserted;
 }
 
 
 // lookup whether 'key' is inside 'table'
 // returns true if found, false if not
 bool xuckoo_hash_table_lookup(XuckooHashTable *table, int64 key) {
-	assert(table);
-	int start_time = clock(); // start timing
+	return xuckoo_hash_table_get(table, key, NULL);
+}
 
-	// calculate table address for this key
-	int address = rightmostnbits(table->table1->depth, h1(key));
-	int address2 = rightmostnbits(table->table2->depth, h2(key));
-	// look for the key in that bucket (unless it's empty)
-	bool found = false;
-	if (table->table1->buckets[address]->full) {
-		// found it?
-		found = table->table1->buckets[address]->key == key;
-	}
-	if (table->table2->buckets[address2]->full && found == false) {
-		// found it?
-		found = table->table2->buckets[address2]->key == key;
-	}
 
-	// add time elapsed to total CPU time before returning result
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool xuckoo_hash_table_get(XuckooHashTable *table, int64 key, int64 *value) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	bool found = get_key(table, key, value);
 	table->stats.time += clock() - start_time;
 	return found;
 }
 
 
-// print the contents of 'table' to stdout
-void xuckoo_hash_table_print(XuckooHashTable *table) {
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not.
+// memory for the keys coming up is prefetched while each key is looked up
+void xuckoo_hash_table_lookup_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
 	assert(table != NULL);
+	int start_time = clock(); // start timing
+	lookup_keys(table, keys, n, found);
+	table->stats.time += clock() - start_time;
+}
 
-	printf("--- table ---\n");
-
-	// loop through the two tables, printing them
-	InnerTable *innertables[2] = {table->table1, table->table2};
-	int t;
-	for (t = 0; t < 2; t++) {
-		// print header
-		printf("table %d\n", t+1);
-
-		printf("  table:               buckets:\n");
-		printf("  address | bucketid   bucketid [key]\n");
-		
-		// print table and buckets
-		int i;
-		for (i = 0; i < innertables[t]->size; i++) {
-			// table entry
-			printf("%9d | %-9d ", i, innertables[t]->buckets[i]->id);
-
-			// if this is the first address at which a bucket occurs, print it
-			if (innertables[t]->buckets[i]->id == i) {
-				printf("%9d ", innertables[t]->buckets[i]->id);
-				if (innertables[t]->buckets[i]->full) {
-					printf("[%llu]", innertables[t]->buckets[i]->key);
-				} else {
-					printf("[ ]");
-				}
-			}
 
-			// end the line
-			printf("\n");
-		}
-	}
-	printf("--- end table ---\n");
+// the untimed lookup_batch, for probing from several threads at once
+void xuckoo_hash_table_probe_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found) {
+	assert(table != NULL);
+	probe_keys(table, keys, n, found);
+}
+
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there. memory for
+// the keys coming up is prefetched while each key is inserted
+// returns how many of the keys were inserted
+int xuckoo_hash_table_insert_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+	int ninserted = insert_keys(table, keys, n, inserted);
+	table->stats.time += clock() - start_time;
+	return ninserted;
+}
+
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to
+// returns how many keys were copied, which is 0 once the scan has finished
+int xuckoo_hash_table_scan(XuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	int start_time = clock(); // start timing
+
+	int n = xuckoo_hash_table_probe_scan(table, cursor, keys, values, max);
+
+	table->stats.time += clock() - start_time;
+	return n;
+}
+
+// split a scan of 'table' into 'n' ranges, one for each cursor in 'cursors'
+void xuckoo_hash_table_scan_ranges(XuckooHashTable *table,
+	ScanCursor *cursors, int n) {
+	assert(table != NULL);
+	assert(n > 0);
+	int start_time = clock(); // start timing
+	split_scan(table, cursors, n);
+	table->stats.time += clock() - start_time;
+}
+
+// the untimed scan, for scanning ranges of 'table' from several threads
+int xuckoo_hash_table_probe_scan(XuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max) {
+	assert(table != NULL);
+	assert(cursor != NULL);
+	return scan_keys(table, cursor, keys, values, max);
+}
+
+
+// how many keys are in 'table'
+int xuckoo_hash_table_nkeys(XuckooHashTable *table) {
+	assert(table != NULL);
+	return table->stats.nkeys;
+}
+
+
+// print the contents of 'table' to stdout
+void xuckoo_hash_table_print(XuckooHashTable *table) {
+	assert(table != NULL);
+	print_tables(table);
 }
 
 
@@ -354,10 +615,12 @@ void xuckoo_hash_table_stats(XuckooHashTable *table) {
 	printf("--- table stats ---\n");
 
 	// print some stats about state of the table
-	printf("current tab 1 size: %d\n", table->table1->size);
-	printf("current tab 2 size: %d\n", table->table2->size);
+	printf("current tab 1 size: %d\n", xtnd_dir_size(table->table1->dir));
+	printf("current tab 2 size: %d\n", xtnd_dir_size(table->table2->dir));
 	printf("    number of keys: %d\n", table->stats.nkeys);
 	printf(" number of buckets: %d\n", table->stats.nbuckets);
+	printf("    hot keys moved: %d\n", table->stats.nmoved);
+	printf("     keys in stash: %d\n", table->stash.nkeys);
 
 	// also calculate CPU usage in seconds and print this
 	float seconds = table->stats.time * 1.0 / CLOCKS_PER_SEC;
@@ -366,55 +629,99 @@ void xuckoo_hash_table_stats(XuckooHashTable *table) {
 	printf("--- end stats ---\n");
 }
 
-// Recursive function which performs cuckoo hash
-bool try_xuck_insert(XuckooHashTable *table, int64 key, int orig_pos, 
-						int64 orig_key, int loop, int orig_table){
-	int address; 
-	int hash;
-	int table_no;
-	// Check which table the function is currently in. Assign variables
-	// accordingly.
-	loop++;
-	InnerTable *inner_table;
-	if (loop % 2 == 0) {
-		inner_table = table->table2;
-		hash = h2(key);
-		table_no = 2;
+// Function which performs cuckoo hash: puts 'key' (whose value is in slot
+// 'slot') in one of its buckets, moving keys between their buckets (and
+// splitting a bucket when there are too many moves) until every key has a
+// place
+void try_xuck_insert(XuckooHashTable *table, int64 key, int slot) {
+	Visit visits[MAX_KICKS];
+	while (true) {
+		// if either of this key's buckets is empty, that's all there is to it
+		if (place_if_empty(table, key, slot, 1)
+			|| place_if_empty(table, key, slot, 2)) {
+			return;
+		}
+
+		// otherwise kick keys along, starting from the table where a split
+		// would cost the least
+		int table_no = cheapest_start(table, key);
+		int kicks;
+		for (kicks = 0; kicks < MAX_KICKS; kicks++) {
+			// swap our key with the key in its bucket in this table
+			InnerTable *inner_table = get_inner_table(table, table_no);
+			int hash = hash_for(key, table_no);
+			Bucket bucket = *find_bucket(inner_table, hash);
+			visits[kicks].table_no = table_no;
+			visits[kicks].hash = hash;
+
+			int64 evicted = bucket.key;
+			int evicted_slot = bucket.slot;
+			visits[kicks].evicted = hash_for(evicted, table_no);
+			bucket.key = key;
+			bucket.slot = slot;
+			write_bucket(inner_table, hash, &bucket);
+
+			// and see whether the kicked out key fits in the other table
+			key = evicted;
+			slot = evicted_slot;
+			table_no = 3 - table_no;
+			if (place_if_empty(table, key, slot, table_no)) {
+				return;
+			}
+		}
+
+		// the chain is too long (maybe a cycle), so make space somewhere
+		// along it and try again with the key we're left holding, unless
+		// there's nowhere a split could help: then the key gets stashed
+		if (split_cheapest(table, visits, MAX_KICKS) == false) {
+			stash_add(&table->stash, key, table->values[slot]);
+			return;
+		}
 	}
-	else {
-		inner_table = table->table1;
-		hash = h1(key);
-		table_no = 1;
+}
+
+// Counts a lookup of 'key', found in table 2, and if it's been looked up often
+// enough, moves it to its bucket in table 1 (as long as whatever is there is
+// less popular and has somewhere to go in table 2)
+static void promote_if_hot(XuckooHashTable *table, int64 key, int hash1, int hash2) {
+	int count = sketch_add(table->hot, hash1, hash2);
+	if (count < HOT_THRESHOLD) {
+		return;
 	}
-	address = rightmostnbits(inner_table->depth, hash);
-	// If there is a long cuckoo chain (according to spec) then split.
-	if (((address == orig_pos) && (key == orig_key) && loop > 3) || 
-		loop > table->table1->size+table->table2->size) {
-		// split bucket in the current table
-		split_bucket(table, address, table_no);
-
-		// and recalculate address because we might now need more bits
-		address = rightmostnbits(inner_table->depth, hash);
-		// reinsert key after there is space made
-		//loop = 0;
-		return xuckoo_hash_table_insert(table, key);
+	Bucket bucket1 = *find_bucket(table->table1, hash1);
+	Bucket bucket2 = *find_bucket(table->table2, hash2);
+
+	// nothing in the way? just move over
+	int slot = bucket2.slot;
+	if (bucket1.full == false) {
+		reinsert_key(table->table1, key, slot, 1);
+		bucket2.full = false;
+		write_bucket(table->table2, hash2, &bucket2);
+		table->stats.nmoved++;
+		return;
 	}
-	// check if there is already something in the position, if there is,
-	// then push new value into that bucket, and take the key to be rehashed
-	// and try inserting the rehash key into the opposite table
-	if (inner_table->buckets[address]->full == true){
-		int64 rehash_key = inner_table->buckets[address]->key;
-		inner_table->buckets[address]->key = key;
-		return try_xuck_insert(table, rehash_key, orig_pos, orig_key, 
-							loop, orig_table);
+
+	// otherwise the key in the way has to go to table 2, either into the 
+	// bucket we're leaving, or into an empty bucket
+	int64 resident = bucket1.key;
+	int resident_slot = bucket1.slot;
+	int resident_hash1 = h1(resident);
+	int resident_hash2 = h2(resident);
+	if (sketch_estimate(table->hot, resident_hash1, resident_hash2) >= count) {
+		return;
 	}
-	else {
-		// otherwise, just insert the key and return true
-		inner_table->buckets[address]->key = key;
-		inner_table->buckets[address]->full = true;
-		inner_table->nkeys++;
-		table->stats.nkeys++;
-		return true;
+	if (rightmostnbits(bucket2.depth, resident_hash2)
+		== rightmostnbits(bucket2.depth, hash2)) {
+		// same bucket: just swap the two keys over
+		reinsert_key(table->table2, resident, resident_slot, 2);
+	} else {
+		if (find_bucket(table->table2, resident_hash2)->full) {
+			return;
+		}
+		reinsert_key(table->table2, resident, resident_slot, 2);
+		bucket2.full = false;
+		write_bucket(table->table2, hash2, &bucket2);
 	}
-	//return true;
+	reinsert_key(table->table1, key, slot, 1);
+	table->stats.nmoved++;
 }
@@ -13,6 +13,8 @@
 
 #include <stdbool.h>
 #include "../inthash.h"
+#include "merge.h"
+#include "cursor.h"
 
 typedef struct xuckoo_table XuckooHashTable;
 
@@ -22,6 +24,10 @@ XuckooHashTable *new_xuckoo_hash_table();
 // free all memory associated with 'table'
 void free_xuckoo_hash_table(XuckooHashTable *table);
 
+// make room in 'table' for 'nkeys' keys in total, so that inserting them
+// needs few or no resizes
+void xuckoo_hash_table_reserve(XuckooHashTable *table, int nkeys);
+
 // insert 'key' into 'table', if it's not in there already
 // returns true if insertion succeeds, false if it was already in there
 bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key);
@@ -30,6 +36,51 @@ bool xuckoo_hash_table_insert(XuckooHashTable *table, int64 key);
 // returns true if found, false if not
 bool xuckoo_hash_table_lookup(XuckooHashTable *table, int64 key);
 
+// insert 'key' into 'table' with value 'value' if it's not in there already,
+// otherwise replace its value with merge(its value, 'value')
+// returns true if 'key' was inserted, false if it was already in there
+bool xuckoo_hash_table_upsert(XuckooHashTable *table, int64 key,
+	int64 value, MergeFunction merge);
+
+// lookup whether 'key' is inside 'table', and if so, store its value in
+// '*value' (unless 'value' is NULL)
+// returns true if found, false if not
+bool xuckoo_hash_table_get(XuckooHashTable *table, int64 key, int64 *value);
+
+// lookup whether each of the 'n' keys in 'keys' is inside 'table', setting
+// bit i % 8 of found[i / 8] if keys[i] is found and clearing it if not
+void xuckoo_hash_table_lookup_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// xuckoo_hash_table_lookup_batch(), untimed (see hash_table_probe_batch())
+void xuckoo_hash_table_probe_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *found);
+
+// insert each of the 'n' keys in 'keys' into 'table', if it's not in there
+// already. if 'inserted' isn't NULL, set bit i % 8 of inserted[i / 8] if
+// keys[i] was inserted and clear it if it was already in there
+// returns how many of the keys were inserted
+int xuckoo_hash_table_insert_batch(XuckooHashTable *table, const int64 *keys,
+	int n, unsigned char *inserted);
+
+// copy up to 'max' keys from 'table' into 'keys' (and their values into
+// 'values', unless it's NULL), carrying on from where 'cursor' is up to (see
+// cursor.h). returns how many keys were copied, which is 0 once the scan has
+// finished
+int xuckoo_hash_table_scan(XuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// split a scan of 'table' into 'n' ranges (see hash_table_scan_ranges())
+void xuckoo_hash_table_scan_ranges(XuckooHashTable *table,
+	ScanCursor *cursors, int n);
+
+// xuckoo_hash_table_scan(), untimed (see hash_table_probe_scan())
+int xuckoo_hash_table_probe_scan(XuckooHashTable *table, ScanCursor *cursor,
+	int64 *keys, int64 *values, int max);
+
+// how many keys are in 'table'
+int xuckoo_hash_table_nkeys(XuckooHashTable *table);
+
 // print the contents of 'table' to stdout
 void xuckoo_hash_table_print(XuckooHashTable *table);
 
@@ -0,0 +1,557 @@
+/* * * * * * * * *
+ * Template for the xuckoon table's operations (see xuckoon.c), for buckets of
+ * BUCKET_SLOTS keys, kept inside the buckets themselves, or of any size if
+ * BUCKET_SLOTS is 0. each instance fills in a XuckoonOps with its operations
+ *
+ * created for COMP20007 Design of Algorithms - Assignment 2, 2017
+ * by Samuel Xu
+ */
+
+// (no include guard: xuckoon.c includes this once for every instance)
+
+#define Bucket				SIZED(Bucket)
+#define new_bucket			SIZED(new_bucket)
+#define find_bucket			SIZED(find_bucket)
+#define new_inner_table		SIZED(new_inner_table)
+#define free_inner_table	SIZED(free_inner_table)
+#define collect_bucket		SIZED(collect_bucket)
+#define print_entry			SIZED(print_entry)
+#define split_bucket		SIZED(split_bucket)
+#define move_a_resident		SIZED(move_a_resident)
+#define find_value			SIZED(find_value)
+#define split_cheapest		SIZED(split_cheapest)
+#define depth_for			SIZED(depth_for)
+#define inner_depth			SIZED(inner_depth)
+#define split_at			SIZED(split_at)
+#define prefetch_inner		SIZED(prefetch_inner)
+#define upsert_key			SIZED(upsert_key)
+#define contains			SIZED(contains)
+#define get_key				SIZED(get_key)
+#define try_xuckoon_insert	SIZED(try_xuckoon_insert)
+#define promote_if_hot		SIZED(promote_if_hot)
+#define scan_bucket			SIZED(scan_bucket)
+#define xuckoon_ops			SIZED(xuckoon_ops)
+// (and the names xuckloops.h defines)
+#define InnerRef			SIZED(InnerRef)
+#define bucket_depth		SIZED(bucket_depth)
+#define split_address		SIZED(split_address)
+#define reserve_tables		SIZED(reserve_tables)
+#define prefetch_key		SIZED(prefetch_key)
+#define lookup_keys			SIZED(lookup_keys)
+#define probe_keys			SIZED(probe_keys)
+#define insert_keys			SIZED(insert_keys)
+#define split_scan			SIZED(split_scan)
+#define scan_keys			SIZED(scan_keys)
+#define print_tables		SIZED(print_tables)
+
+// buckets of a fixed size keep their keys in arrays of their own
+#undef BUCKET_ARRAYS
+#define BUCKET_ARRAYS (BUCKET_SLOTS > 0)
+
+// a bucket stores up to BUCKET_SLOTS keys (or the inner table's bucketsize,
+// in the generic instance)
+// it also knows how many bits are shared between possible keys, and the first
+// table address that references it
+typedef struct {
+	int id;			// a unique id for this bucket, equal to the first address
+					// in the table which points to it
+	int depth;		// how many hash value bits are being used by this bucket
+	int nkeys;		// number of keys currently contained in this bucket
+#if BUCKET_ARRAYS
+#if BUCKET_TAGS
+	unsigned char tags[BUCKET_SLOTS];	// a tag for each key (see
+										// bucketscan.h)
+#endif
+	int64 keys[BUCKET_SLOTS];	// the keys stored in this bucket
+	int64 values[BUCKET_SLOTS];	// the value stored with each key (kept
+								// apart from the keys, so that scans only
+								// read the keys)
+#else
+	int64 *keys;	// the keys stored in this bucket
+	int64 *values;	// the value stored with each key
+	unsigned char *tags;	// a tag for each key (see bucketscan.h), to
+							// rule out most keys without reading them
+#endif
+} Bucket;
+
+#include "buckettmpl.h"
+
+static void try_xuckoon_insert(XuckoonHashTable *table, int64 key,
+	int64 value);
+static void promote_if_hot(XuckoonHashTable *table, int64 key, int hash1,
+	int hash2);
+
+// find the bucket in 'table' for a key with hash value 'hash'
+static Bucket *find_bucket(InnerTable *table, int hash) {
+	return *(Bucket **)xtnd_dir_lookup(table->dir, hash);
+}
+
+// create a new bucket first referenced from 'first_address', based on 'depth'
+// bits of its keys' hash values
+static Bucket *new_bucket(int first_address, int depth, int bucketsize) {
+	// (zeroed, as are the tags, so that slots out of use never hold leftover
+	// memory: scans read whole blocks of keys or tags)
+#if BUCKET_ARRAYS
+	Bucket *bucket = calloc(1, sizeof *bucket);
+	assert(bucket);
+#else
+	Bucket *bucket = alloc_bucket(bucketsize);
+#endif
+	bucket->id = first_address;
+	bucket->depth = depth;
+	bucket->nkeys = 0;
+	return bucket;
+}
+
+static InnerTable *new_inner_table(int bucketsize) {
+	InnerTable *table = cache_line_alloc(sizeof *table);
+	assert(table);
+
+	Bucket *bucket = new_bucket(0, 0, bucketsize);
+	table->dir = new_xtnd_dir(sizeof bucket, &bucket);
+	table->nbuckets = 1;
+	table->bucketsize = bucketsize;
+	return table;
+};
+
+// directory walk helper: remember each bucket as we reach its first reference
+static void collect_bucket(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = *(Bucket **)entry;
+	Bucket ***next = arg;
+	if (bucket->id == address) {
+		*(*next)++ = bucket;
+	}
+}
+
+// directory walk helper: print a table entry and, at the first address at
+// which a bucket occurs, the bucket itself
+static void print_entry(void *entry, int address, int bits, void *arg) {
+	Bucket *bucket = *(Bucket **)entry;
+	InnerTable *table = arg;
+
+	// table entry
+	printf("%9d | %-9d ", address, bucket->id);
+
+	// if this is the first address at which a bucket occurs, print it now
+	if (bucket->id == address) {
+		printf("%9d ", bucket->id);
+		// print the bucket's contents
+		print_keys(bucket, SLOTS(table));
+	}
+	// end the line
+	printf("\n");
+}
+
+// free an inner table along with all of its buckets
+static void free_inner_table(InnerTable *table) {
+	// gather up the buckets as we reach their first reference, and only free
+	// them once we're done (later references would point at freed buckets)
+	Bucket **buckets = malloc(sizeof *buckets * table->nbuckets);
+	assert(buckets);
+	Bucket **next = buckets;
+	xtnd_dir_walk(table->dir, collect_bucket, &next);
+	int i;
+	for (i = 0; i < table->nbuckets; i++) {
+		free(buckets[i]);
+	}
+	free(buckets);
+
+	// free the directory of bucket pointers, and the table itself
+	free_xtnd_dir(table->dir);
+	cache_line_free(table);
+}
+
+// split 'bucket' in one of the inner tables of 'table', growing that table's
+// directory where necessary
+static void split_bucket(XuckoonHashTable *table, Bucket *bucket,
+	int table_no) {
+	InnerTable *inner_table = get_inner_table(table, table_no);
+
+	// FIRST,
+	// create a new bucket and update both buckets' depth
+	int depth = bucket->depth;
+	assert(depth < DIR_MAX_DEPTH);
+	unsigned int first_address = bucket->id;
+
+	int new_depth = depth + 1;
+	bucket->depth = new_depth;
+
+	// new bucket's first address will be a 1 bit plus the old first address
+	unsigned int new_first_address = 1u << depth | first_address;
+	Bucket *newbucket = new_bucket(new_first_address, new_depth,
+		inner_table->bucketsize);
+	inner_table->nbuckets++;
+	table->stats.nbuckets++;
+
+	// SECOND,
+	// redirect every second address pointing to this bucket to the new bucket:
+	// those whose rightmost 'new_depth' bits match the new first address
+	// (the directory takes care of growing if it needs to)
+	xtnd_dir_assign(inner_table->dir, new_first_address, new_depth, &newbucket);
+
+	// FINALLY,
+	// partition the old bucket's keys in place: those with a 1 at bit 'depth'
+	// of their hash values move over to the new bucket, and the rest stay put
+	int i = 0;
+	while (i < bucket->nkeys) {
+		if ((hash_for(bucket->keys[i], table_no) >> depth) & 1) {
+			bucket_move(bucket, i, newbucket);
+		} else {
+			i++;
+		}
+	}
+}
+
+// Looks through the keys in 'bucket' (in inner table 'table_no') for one whose
+// bucket in the other table has space. if there is one, it moves over there
+// and 'key' (with its value) takes its place. returns true if the key was
+// placed, false if not
+static bool move_a_resident(XuckoonHashTable *table, Bucket *bucket,
+	int table_no, int64 key, int64 value) {
+	int other_no = 3 - table_no;
+	InnerTable *other = get_inner_table(table, other_no);
+	int i;
+	for (i = 0; i < bucket->nkeys; i++) {
+		int64 resident = bucket->keys[i];
+		int hash = hash_for(resident, other_no);
+		Bucket *alternate = find_bucket(other, hash);
+		if (alternate->nkeys < SLOTS(other)) {
+			bucket_put(alternate, alternate->nkeys, resident,
+				bucket->values[i]);
+			bucket_put(bucket, i, key, value);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Where is the value of 'key' (with hash value 'hash' in inner table
+// 'table_no') stored? returns NULL if it's not in its bucket there
+static int64 *find_value(XuckoonHashTable *table, int64 key, int hash,
+	int table_no) {
+	InnerTable *inner_table = get_inner_table(table, table_no);
+	Bucket *bucket = find_bucket(inner_table, hash);
+	int i = find_slot(bucket, key);
+	if (i < 0) {
+		return NULL;
+	}
+	return &bucket->values[i];
+}
+
+// Splits whichever of the 'nvisits' buckets in 'visits' is cheapest to split
+// (see kicks.h). returns false (without splitting anything) if splitting none
+// of them could ever make room
+static bool split_cheapest(XuckoonHashTable *table, Visit *visits,
+	int nvisits) {
+	SplitOption options[MAX_KICKS];
+	int i, j;
+	for (i = 0; i < nvisits; i++) {
+		int table_no = visits[i].table_no;
+		InnerTable *inner_table = get_inner_table(table, table_no);
+		Bucket *bucket = find_bucket(inner_table, visits[i].hash);
+		options[i].depth = bucket->depth;
+		options[i].dir_bits = xtnd_dir_bits(inner_table->dir, visits[i].hash);
+		options[i].spread = 0;
+		for (j = 0; j < bucket->nkeys; j++) {
+			options[i].spread |= hash_for(bucket->keys[j], table_no)
+				^ visits[i].evicted;
+		}
+	}
+	int best = cheapest_split(options, nvisits);
+	if (best == -1) {
+		return false;
+	}
+	InnerTable *inner_table = get_inner_table(table, visits[best].table_no);
+	split_bucket(table, find_bucket(inner_table, visits[best].hash),
+		visits[best].table_no);
+	return true;
+}
+
+// the fewest hash value bits (up to DIR_MAX_DEPTH) which address enough
+// buckets in each inner table for 'nkeys' keys, so that the two tables
+// together have twice as much room as the keys need
+static int depth_for(XuckoonHashTable *table, int nkeys) {
+	return depth_for_room(nkeys, SLOTS(table->table1), DIR_MAX_DEPTH);
+}
+
+// how many hash value bits the bucket for 'address' in 'table' uses
+static int inner_depth(InnerTable *table, int address) {
+	return find_bucket(table, address)->depth;
+}
+
+// split the bucket for 'address' in inner table 'table_no' of 'table'
+static void split_at(XuckoonHashTable *table, int address, int table_no) {
+	split_bucket(table, find_bucket(get_inner_table(table, table_no),
+		address), table_no);
+}
+
+// start loading the memory that looking up a key with hash value 'hash' in
+// inner table 'table' will need at stage 'stage': 3 for its directory entry,
+// 2 for its bucket, and 1 for the bucket's keys (and tags), which don't all
+// share the bucket's cache line (each stage reads what the stage before it
+// loaded)
+static void prefetch_inner(InnerTable *table, int hash, int stage) {
+	if (stage == 3) {
+		xtnd_dir_prefetch(table->dir, hash);
+		return;
+	}
+	Bucket *bucket = find_bucket(table, hash);
+	if (stage == 2) {
+		prefetch(bucket);
+	} else {
+#if BUCKET_TAGS
+		prefetch(bucket->tags);
+#endif
+		prefetch(bucket->keys);
+	}
+}
+
+// insert 'key' into 'table' with value 'value', or merge 'value' into its
+// value if it's already there (as in xuckoon_hash_table_upsert(), but untimed)
+static bool upsert_key(XuckoonHashTable *table, int64 key,
+	int64 value, MergeFunction merge) {
+	// is this key already there? then just update its value
+	int64 *stored = find_value(table, key, h1(key), 1);
+	if (stored == NULL) {
+		stored = find_value(table, key, h2(key), 2);
+	}
+	if (stored == NULL && table->stash.nkeys > 0) {
+		stored = stash_value(&table->stash, key);
+	}
+	if (stored) {
+		*stored = merge(*stored, value);
+		return false;
+	}
+	// find a place for the key, moving others out of the way if need be
+	try_xuckoon_insert(table, key, value);
+	table->stats.nkeys++;
+
+	return true;
+}
+
+// is 'key' in either of its buckets? (unlike get_key(), this never moves a
+// hot key, so it only ever reads the table)
+static bool contains(XuckoonHashTable *table, int64 key) {
+	return find_value(table, key, h1(key), 1) != NULL
+		|| find_value(table, key, h2(key), 2) != NULL
+		|| (table->stash.nkeys > 0 && stash_value(&table->stash, key) != NULL);
+}
+
+// lookup whether 'key' is inside 'table', storing its value in '*value'
+// (as in xuckoon_hash_table_get(), but untimed)
+static bool get_key(XuckoonHashTable *table, int64 key,
+	int64 *value) {
+	// look for the key in its table 1 bucket (unless it's empty)
+	int hash1 = h1(key);
+	int64 *stored = find_value(table, key, hash1, 1);
+
+	// and only then in its table 2 bucket
+	if (stored == NULL) {
+		int hash2 = h2(key);
+		stored = find_value(table, key, hash2, 2);
+
+		// a key which keeps being found here should move to table 1
+		// (which moves its value too: read it first)
+		if (stored && value) {
+			*value = *stored;
+		}
+		if (stored && TRACK_HOT_KEYS) {
+			promote_if_hot(table, key, hash1, hash2);
+		}
+
+		// failing that, the key might have been stashed
+		if (stored == NULL && table->stash.nkeys > 0) {
+			stored = stash_value(&table->stash, key);
+			if (stored && value) {
+				*value = *stored;
+			}
+		}
+	} else if (value) {
+		*value = *stored;
+	}
+
+	return stored != NULL;
+}
+
+// copy the keys of the bucket for 'address' in 'inner_table' that 'cursor'
+// hasn't returned yet to keys[*n] on (and their values to values[*n] on,
+// unless 'values' is NULL), as long as there's room for them. returns the
+// bucket's depth
+static int scan_bucket(XuckoonHashTable *table, InnerTable *inner_table,
+	int address, ScanCursor *cursor, int64 *keys, int64 *values, int *n,
+	int max) {
+	Bucket *bucket = find_bucket(inner_table, address);
+
+	// if the last chunk stopped partway through this bucket and it has
+	// changed since, go back over it from the start
+	if (cursor->skip > 0
+		&& !scan_can_resume(cursor, bucket->nkeys, bucket->depth)) {
+		cursor->skip = 0;
+	}
+
+	int i;
+	for (i = cursor->skip; i < bucket->nkeys && *n < max; i++) {
+		keys[*n] = bucket->keys[i];
+		if (values) {
+			values[*n] = bucket->values[i];
+		}
+		(*n)++;
+	}
+
+	// ran out of room partway through? remember where
+	if (i < bucket->nkeys) {
+		cursor->skip = i;
+		cursor->nkeys = bucket->nkeys;
+		cursor->depth = bucket->depth;
+	} else {
+		cursor->skip = 0;
+	}
+	return bucket->depth;
+}
+
+#include "xuckloops.h"
+
+// Function which performs bucketised cuckoo hash: puts 'key' (and its value)
+// in one of its buckets, moving keys between their buckets (and splitting a
+// bucket when there are too many moves) until every key has a place
+static void try_xuckoon_insert(XuckoonHashTable *table, int64 key,
+	int64 value) {
+	Visit visits[MAX_KICKS];
+	while (true) {
+		// if either of this key's buckets has space, use the emptier one
+		int hash1 = h1(key);
+		int hash2 = h2(key);
+		Bucket *bucket1 = find_bucket(table->table1, hash1);
+		Bucket *bucket2 = find_bucket(table->table2, hash2);
+		if (bucket2->nkeys < bucket1->nkeys) {
+			bucket_put(bucket2, bucket2->nkeys, key, value);
+			return;
+		}
+		if (bucket1->nkeys < SLOTS(table->table1)) {
+			bucket_put(bucket1, bucket1->nkeys, key, value);
+			return;
+		}
+
+		// otherwise move keys along, starting in table 1
+		int table_no = 1;
+		Bucket *bucket = bucket1;
+		int kicks;
+		for (kicks = 0; kicks < MAX_KICKS; kicks++) {
+			visits[kicks].table_no = table_no;
+			visits[kicks].hash = hash_for(key, table_no);
+
+			// before kicking anyone out, see if any of this bucket's keys can
+			// move straight to its other bucket, making room for our key
+			if (move_a_resident(table, bucket, table_no, key, value)) {
+				return;
+			}
+
+			// if not, swap our key with one of the bucket's keys (a different
+			// slot each time, so that we don't go around in circles)
+			int slot = kicks % bucket->nkeys;
+			int64 evicted = bucket->keys[slot];
+			int64 evicted_value = bucket->values[slot];
+			visits[kicks].evicted = hash_for(evicted, table_no);
+			bucket_put(bucket, slot, key, value);
+
+			// and see whether the kicked out key fits in the other table
+			key = evicted;
+			value = evicted_value;
+			table_no = 3 - table_no;
+			InnerTable *inner_table = get_inner_table(table, table_no);
+			int hash = hash_for(key, table_no);
+			bucket = find_bucket(inner_table, hash);
+			if (bucket->nkeys < SLOTS(inner_table)) {
+				bucket_put(bucket, bucket->nkeys, key, value);
+				return;
+			}
+		}
+
+		// the search has gone on too long, so make space somewhere along the
+		// way and try again with the key we're left holding, unless there's
+		// nowhere a split could help: then the key gets stashed
+		if (split_cheapest(table, visits, MAX_KICKS) == false) {
+			stash_add(&table->stash, key, value);
+			return;
+		}
+	}
+}
+
+// Counts a lookup of 'key', found in table 2, and if it's been looked up often
+// enough, moves it to its bucket in table 1. if that bucket is full, its least
+// popular key (if it's less popular than this one, and has somewhere to go in
+// table 2) swaps places with it
+static void promote_if_hot(XuckoonHashTable *table, int64 key, int hash1,
+	int hash2) {
+	int count = sketch_add(table->hot, hash1, hash2);
+	if (count < HOT_THRESHOLD) {
+		return;
+	}
+	int bucketsize = SLOTS(table->table1);
+	Bucket *bucket1 = find_bucket(table->table1, hash1);
+	Bucket *bucket2 = find_bucket(table->table2, hash2);
+	int slot2 = find_slot(bucket2, key);
+	int64 value = bucket2->values[slot2];
+
+	// space in table 1? just move over
+	if (bucket1->nkeys < bucketsize) {
+		bucket_put(bucket1, bucket1->nkeys, key, value);
+		bucket_remove(bucket2, slot2);
+		table->stats.nmoved++;
+		return;
+	}
+
+	// otherwise find the least popular key in the way
+	int coldest = -1;
+	int coldest_count = count;
+	int coldest_hash2 = 0;
+	int i;
+	for (i = 0; i < bucket1->nkeys; i++) {
+		int64 resident = bucket1->keys[i];
+		int resident_hash2 = h2(resident);
+		int resident_count = sketch_estimate(table->hot, h1(resident),
+			resident_hash2);
+		if (resident_count < coldest_count) {
+			coldest = i;
+			coldest_count = resident_count;
+			coldest_hash2 = resident_hash2;
+		}
+	}
+	if (coldest == -1) {
+		return;
+	}
+
+	// and send it to table 2, either into the slot we're leaving, or into
+	// its own bucket if that has space
+	int64 resident = bucket1->keys[coldest];
+	int64 resident_value = bucket1->values[coldest];
+	Bucket *resident_bucket2 = find_bucket(table->table2, coldest_hash2);
+	if (resident_bucket2 == bucket2) {
+		bucket_put(bucket2, slot2, resident, resident_value);
+	} else if (resident_bucket2->nkeys < bucketsize) {
+		bucket_put(resident_bucket2, resident_bucket2->nkeys, resident,
+			resident_value);
+		bucket_remove(bucket2, slot2);
+	} else {
+		return;
+	}
+	bucket_put(bucket1, coldest, key, value);
+	table->stats.nmoved++;
+}
+
+// this instance's operations
+static const XuckoonOps xuckoon_ops = {
+	.new_inner = new_inner_table,
+	.free_inner = free_inner_table,
+	.reserve = reserve_tables,
+	.upsert = upsert_key,
+	.get = get_key,
+	.lookup_batch = lookup_keys,
+	.probe_batch = probe_keys,
+	.insert_batch = insert_keys,
+	.scan_ranges = split_scan,
+	.probe_scan = scan_keys,
+	.print = print_tables,
+};
+
+#undef BUCKET_SLOTS